@@ -0,0 +1,24 @@
+#!/bin/bash
+#
+# Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+#
+# Compute time and wave field memory of the velocity-stress engine against the displacement
+# engine (OPTEWE_ENGINE) on a size^3 grid. The displacement engine needs rigid boundaries and a
+# single rank, so both run without a PML border (OPTEWE_GHOST_BORDER unset).
+
+if [ "$#" -ne 3 ]; then
+    echo "Usage: <script> #size #iterations #threads"
+    exit 1
+fi
+
+export LD_LIBRARY_PATH=/usr/local/lib:$LD_LIBRARY_PATH
+export OMP_NUM_THREADS=$3
+
+cd ../bin
+echo "engine compute_seconds wave_field_MiB"
+for engine in velocity-stress displacement; do
+    OPTEWE_ENGINE=${engine} ./optewe-mp $1 $1 $1 $2 $3 1 > engine_${engine}.txt
+    compute=$(grep "Compute time" engine_${engine}.txt | awk '{print $NF}')
+    memory=$(grep "#Engine" engine_${engine}.txt | awk -F', ' '{print $2}' | awk '{print $1}')
+    echo "${engine} ${compute} ${memory}"
+done
@@ -0,0 +1,27 @@
+#!/bin/bash
+#
+# Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+#
+# Runs the decomposed code on one and on several ranks of the same machine and compares
+# the receiver files. The binary must be built with "make mpi INSTRUMENTATION=-DSAVE_RECEIVERS".
+
+if [ "$#" -ne 4 ]; then
+    echo "Usage: <script> #size #iterations #threads #ranks"
+    exit 1
+fi
+
+export LD_LIBRARY_PATH=/usr/local/lib:$LD_LIBRARY_PATH
+export OMP_NUM_THREADS=$3
+
+cd ../bin
+mpirun -np 1 ./optewe-mpi $1 $1 $1 $2 $3 1 > /dev/null
+mv receivers.csv receivers_1.csv
+mpirun -np $4 ./optewe-mpi $1 $1 $1 $2 $3 1 > /dev/null
+mv receivers.csv receivers_$4.csv
+
+if cmp -s receivers_1.csv receivers_$4.csv; then
+    echo "Receivers on 1 and $4 ranks are identical"
+else
+    echo "Receivers on 1 and $4 ranks differ"
+    exit 1
+fi
@@ -0,0 +1,31 @@
+#!/bin/bash
+#
+# Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+#
+# Compares one thread per core, two threads per core and one compute thread per core
+# with a prefetch thread on its SMT sibling.
+
+if [ "$#" -ne 4 ]; then
+    echo "Usage: <script> #size #iterations #cores #prefetch_distance"
+    exit 1
+fi
+
+size=$1
+niterations=$2
+cores=$3
+distance=$4
+
+export LD_LIBRARY_PATH=/usr/local/lib:$LD_LIBRARY_PATH
+cd ../bin
+
+echo "# 1 thread per core"
+export KMP_AFFINITY="granularity=fine,compact,1,0"
+OMP_NUM_THREADS=${cores} ./optewe-mp ${size} ${size} ${size} ${niterations} ${cores} 2
+
+echo "# 2 threads per core"
+export KMP_AFFINITY="granularity=fine,compact"
+OMP_NUM_THREADS=$((2 * cores)) ./optewe-mp ${size} ${size} ${size} ${niterations} $((2 * cores)) 2
+
+echo "# 1 compute thread + 1 prefetch thread per core"
+export KMP_AFFINITY="granularity=fine,compact"
+OMP_NUM_THREADS=${cores} OPTEWE_SMT_PREFETCH=${distance} ./optewe-mp ${size} ${size} ${size} ${niterations} ${cores} 2
@@ -0,0 +1,25 @@
+#!/bin/bash
+#
+# Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+#
+# Tunes the per-kernel thread table once and reuses it for the measured run.
+
+if [ "$#" -ne 3 ]; then
+    echo "Usage: <script> #size #iterations #threads"
+    exit 1
+fi
+
+export LD_LIBRARY_PATH=/usr/local/lib:$LD_LIBRARY_PATH
+export OMP_NUM_THREADS=$3
+export KMP_AFFINITY="granularity=core,compact"
+# Let threads that are not used by a kernel sleep right away instead of spinning. The Intel
+# build sets the block time itself, other runtimes read the wait policy at start-up.
+export KMP_BLOCKTIME=0
+export OMP_WAIT_POLICY=passive
+export OPTEWE_THREAD_TABLE="threads_$1_t$3.cfg"
+
+cd ../bin
+if [ ! -f "${OPTEWE_THREAD_TABLE}" ]; then
+    OPTEWE_TUNE_THREADS=1 ./optewe-mp $1 $1 $1 1 $3 2 > /dev/null
+fi
+./optewe-mp $1 $1 $1 $2 $3 2
@@ -0,0 +1,25 @@
+#!/bin/bash
+#
+# Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+#
+# Shot throughput of the 2D (x-z) build against the 3D build at the same Nx and Nz. Every
+# binary runs #shots independent shots side by side (OPTEWE_SHOTS) and reports shots per hour.
+# Build both with "make && make 2d".
+
+if [ "$#" -ne 4 ]; then
+    echo "Usage: <script> #size #iterations #threads #shots"
+    exit 1
+fi
+
+export LD_LIBRARY_PATH=/usr/local/lib:$LD_LIBRARY_PATH
+export OMP_NUM_THREADS=$3
+export OPTEWE_SHOTS=$4
+
+cd ../bin
+echo "build compute_seconds shots_per_hour"
+for binary in optewe-2d optewe-mp; do
+    ./${binary} $1 $1 $1 $2 $3 1 > throughput_${binary}.txt
+    compute=$(grep "Compute time" throughput_${binary}.txt | awk '{print $NF}')
+    rate=$(grep "Shots per hour" throughput_${binary}.txt | awk '{print $NF}')
+    echo "${binary} ${compute} ${rate}"
+done
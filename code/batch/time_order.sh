@@ -0,0 +1,65 @@
+#!/bin/bash
+#
+# Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+#
+# Dispersion against cost of the second- (leapfrog) and the fourth-order time stepping. A
+# fourth-order run with the small reference time step is taken as the exact solution, and the
+# runs at multiples of that step are compared with it at the common times (relative L2 error of
+# all receiver traces). The binary must be built with "make INSTRUMENTATION=-DSAVE_RECEIVERS".
+
+if [ "$#" -lt 6 ]; then
+    echo "Usage: <script> #size #threads #record_length #source_frequency #reference_dt #multiples..."
+    exit 1
+fi
+
+export LD_LIBRARY_PATH=/usr/local/lib:$LD_LIBRARY_PATH
+export OMP_NUM_THREADS=$2
+export OPTEWE_RECORD_LENGTH=$3
+export OPTEWE_SOURCE_FREQUENCY=$4
+
+size=$1
+dt_ref=$5
+shift 5
+
+cd ../bin
+OPTEWE_TIME_ORDER=4 OPTEWE_DT=$dt_ref ./optewe-mp $size $size $size 1 $OMP_NUM_THREADS 1 > /dev/null
+mv receivers.csv receivers_reference.csv
+
+echo "order dt compute_seconds relative_error"
+for m in "$@"; do
+    dt=$(awk "BEGIN {print $dt_ref * $m}")
+    for order in 2 4; do
+        compute=$(OPTEWE_TIME_ORDER=$order OPTEWE_DT=$dt ./optewe-mp $size $size $size 1 $OMP_NUM_THREADS 1 \
+                  | grep "Compute time" | awk '{print $NF}')
+        error=$(python3 - receivers.csv receivers_reference.csv $m <<'EOF'
+import math, sys
+
+# Traces of the receiver file: the position of every receiver is followed by one block of
+# samples per component
+def traces(name):
+    lines = [l.strip() for l in open(name) if l.strip()]
+    blocks = []
+    for l in lines[2:]:
+        if " " in l:
+            continue
+        try:
+            sample = float(l)
+        except ValueError:
+            blocks.append([])
+            continue
+        blocks[-1].append(sample)
+    return blocks
+
+step = int(sys.argv[3])
+num = den = 0.0
+for run, ref in zip(traces(sys.argv[1]), traces(sys.argv[2])):
+    ref = ref[::step]
+    for a, b in zip(run, ref):
+        num += (a - b) ** 2
+        den += b * b
+print(math.sqrt(num / den) if den > 0.0 else float("nan"))
+EOF
+)
+        echo "$order $dt $compute $error"
+    done
+done
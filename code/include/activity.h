@@ -0,0 +1,62 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 19, 2026
+ * Comment: Activity mask of the wave fields. The fields start at zero and the sources feed a
+ * few points, so early in a run most of the grid is quiescent. The local grid is cut into
+ * cubic tiles, and a tile becomes active once the fastest P-wave from the sources, plus a margin
+ * for the reach of the stencils ahead of it, could have arrived anywhere in it. The kernels of
+ * the time step only sweep boxes covering the active tiles; all other points stay at zero.
+ * Tiles and boxes are laid out on the global grid, so every rank computes the same points and
+ * the result does not depend on the decomposition.
+ */
+
+#ifndef ACTIVITY_H
+#define ACTIVITY_H
+
+#include <memory>
+
+#include "fd3d.h"
+#include "region.h"
+
+struct activity_s {
+  int tile;    // Edge of the tiles in points
+  int n[3];    // Global grid size along x, y and z
+  int ntiles[3];    // Tiles of the global grid along x, y and z
+  int source[2][3];    // Global corners of the box around the source points, inclusive
+  real vp_max;    // Largest P-velocity of the model
+  real spacing;    // Smallest sampling of the grid, which turns distances into points
+  int margin;    // Points kept active ahead of the fastest wave
+  int min_planes;    // Thinnest box along z, so the planes of a box keep all threads busy
+  char* active;    // Tiles that may hold non-zero values, x fastest
+  long nactive;
+  region_t* boxes;    // Global boxes covering the active tiles, made of whole z-slabs of tiles
+  int nboxes;
+  bool complete;    // All tiles are active, and the kernels sweep their whole region
+  double active_points;    // Computed points inside the boxes, and all computed points, summed
+  double total_points;    // over the steps
+};
+
+typedef struct activity_s activity_t;
+
+// Sets up the mask of the global grid given by dims for the wave fields of waves
+// (waves->activity) and a source at the global point (x, y, z). Does nothing for a tile of 0
+// points, which keeps every kernel on its whole region.
+void activity_setup(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<dims_t> dims, const int x, const int y,
+                    const int z, const real vp_max, const int tile, const int margin, const int min_planes);
+
+// Adds a source at the global point (x, y, z). The mask then grows from the box around all the
+// source points, which keeps every tile a wave can reach active. Does nothing without a mask.
+void add_activity_source(std::shared_ptr<fdm3d_t> waves, const int x, const int y, const int z);
+
+// Activates the tiles the fields may have reached at time t, before the step that takes them
+// there. Does nothing without a mask.
+void advance_activity(std::shared_ptr<fdm3d_t> waves, const real t);
+
+// Box b of the mask in the local grid of waves
+region_t local_box(std::shared_ptr<fdm3d_t> waves, const int b);
+
+// Fraction of the computed point updates that lay in active tiles so far
+double activity_work_ratio(const activity_t* activity);
+
+void free_activity_arrays(activity_t* activity);
+
+#endif // ACTIVITY_H
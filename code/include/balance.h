@@ -0,0 +1,52 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Load balancing of the domain decomposition. The cost of the grid is described by a
+ * profile per axis: the cost of every plane of the global grid, summed over the plane. The cuts
+ * of each axis are placed so that every part gets an equal share of that axis' profile. The
+ * profile is either estimated from the grid (absorbing borders are more expensive than the
+ * interior) or measured from the time every rank spends in the kernels.
+ */
+
+#ifndef BALANCE_H
+#define BALANCE_H
+
+#include <memory>
+
+#include "decomp.h"
+#include "dims.h"
+#include "fd3d.h"
+#include "model3d.h"
+
+struct cost_profile_s {
+  int n[3];    // Global grid size along x, y and z
+  double* weights[3];    // Cost of every plane along x, y and z
+};
+
+typedef struct cost_profile_s cost_profile_t;
+
+// Cost of a point in the absorbing border is border_cost, every other computed point costs 1
+std::shared_ptr<cost_profile_t> estimate_cost_profile(std::shared_ptr<dims_t> dims, const double border_cost);
+
+// Cost of a point is the kernel time of the rank that computes it divided by its number of points
+std::shared_ptr<cost_profile_t> measured_cost_profile(std::shared_ptr<decomp_t> decomp, const double* seconds);
+
+// Cuts (procs[d] + 1 per axis) that split every axis into parts of equal cost
+void weighted_cuts(std::shared_ptr<cost_profile_t> profile, const int* procs, int* cuts[3]);
+
+// Re-partitions the grid so that every part gets an equal share of the profile. Must be called
+// before the local fields are allocated.
+void apply_cost_profile(std::shared_ptr<decomp_t> decomp, std::shared_ptr<cost_profile_t> profile);
+
+// Ratio of the slowest rank to the mean, from the kernel time of every rank
+double load_imbalance(std::shared_ptr<decomp_t> decomp, const double* seconds);
+
+// Re-partitions the grid if the kernel times of the ranks drift apart by more than tolerance
+// (relative to the mean), moving the fields and the model to the new layout. Returns true if
+// the layout changed.
+bool rebalance(std::shared_ptr<decomp_t> decomp, std::shared_ptr<dims_t> global_dims,
+               std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+               const double seconds, const double tolerance);
+
+void free_cost_profile_arrays(std::shared_ptr<cost_profile_t> profile);
+
+#endif // BALANCE_H
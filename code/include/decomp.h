@@ -0,0 +1,112 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Cartesian domain decomposition of the grid over MPI ranks. Every rank stores its
+ * own part of the grid plus a halo of half_length points on each side, which is refreshed
+ * from the neighbouring ranks once per half step. With a halo depth of m steps the halo is
+ * 2 * m * half_length points wide instead and is refreshed once every m steps. Without
+ * HAVE_MPI the grid is a single part and the halo exchange does nothing.
+ */
+
+#ifndef DECOMP_H
+#define DECOMP_H
+
+#include <memory>
+#include <vector>
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
+#include "dims.h"
+
+// Maximum number of fields exchanged in one call to exchange_halos
+constexpr int kMaxHaloFields = 9;
+
+struct decomp_s {
+  int rank;    // Rank of this process
+  int nranks;    // Total number of ranks
+  int nthreads;    // Threads of the halo copies
+  int procs[3];    // Number of ranks along x, y and z
+  int coords[3];    // Position of this rank in the process grid
+  int neighbours[6];    // Ranks at -x, +x, -y, +y, -z, +z (-1 at the edge of the grid)
+  int depth;    // Steps between halo exchanges, 0 exchanges every half step
+  int halo;    // Width of the halo in grid points
+  int global_n[3];    // Global grid size (with ghost borders) along x, y and z
+  int* cuts[3];    // Along x, y and z: first computed index of every part, then the end of the computed range
+  int offset[3];    // Global index of local index 0 along x, y and z
+  int local_n[3];    // Local grid size (with halos) along x, y and z
+  int own_begin[3];    // First local index owned by this rank
+  int own_end[3];    // One past the last local index owned by this rank
+  size_t buffer_size[6];    // Number of values in the halo buffers of each face
+  real* send[6];    // Halo buffers sent towards the neighbour at each face
+  real* recv[6];    // Halo buffers received from the neighbour at each face
+  real* pending[kMaxHaloFields];    // Fields of the exchange in flight
+  int npending;    // Number of fields of the exchange in flight
+#ifdef HAVE_MPI
+  MPI_Comm comm;    // Cartesian communicator
+  MPI_Request requests[12];    // Requests of the exchange in flight
+  int nrequests;
+#endif
+};
+
+typedef struct decomp_s decomp_t;
+
+// Splits the grid over all ranks, or keeps it in one part on every rank if distributed is false.
+// The halos are copied to and from the buffers on nthreads threads.
+std::shared_ptr<decomp_t> decomp_setup(std::shared_ptr<dims_t> dims, const int nthreads,
+                                       const bool distributed = true);
+// Re-partitions the grid for a halo refreshed every depth steps (0: every half step). Must be
+// called before the local fields are allocated.
+void set_halo_depth(std::shared_ptr<decomp_t> decomp, const int depth);
+// Deepest halo depth whose halo a neighbour can fill from its own points: 2 * depth * half_length
+// points in the thinnest part along every split axis. INT_MAX if no axis is split.
+int max_halo_depth(std::shared_ptr<decomp_t> decomp);
+
+// Re-partitions the grid along the given cuts (procs[d] + 1 entries per axis, see decomp_s).
+// The local fields have to be reallocated afterwards.
+void set_cuts(std::shared_ptr<decomp_t> decomp, int* const cuts[3]);
+
+std::shared_ptr<dims_t> local_dims(std::shared_ptr<decomp_t> decomp, std::shared_ptr<dims_t> dims);
+
+// True if the global grid point lies in the part owned by this rank
+bool owns_point(std::shared_ptr<decomp_t> decomp, const int x, const int y, const int z);
+
+// Refresh the halos of the given local fields from the neighbouring ranks
+void exchange_halos(std::shared_ptr<decomp_t> decomp, const std::vector<real*>& fields);
+
+// Non-blocking variant: begin posts the messages for all six faces at once, finish waits for
+// them and fills the halos. Only the faces are exchanged, the edges and corners of the halo
+// are left as they are, which is all the axis-aligned stencils need. The owned points next to
+// the halo must not change in between.
+void begin_halo_exchange(std::shared_ptr<decomp_t> decomp, const std::vector<real*>& fields);
+void finish_halo_exchange(std::shared_ptr<decomp_t> decomp);
+
+// Moves the owned points of each field from the layout given by the old cuts, offset and local
+// size to the current layout. The halos of the new fields are not filled.
+void move_owned_points(std::shared_ptr<decomp_t> decomp, int* const old_cuts[3], const int* old_offset,
+                       const int* old_n, const std::vector<real*>& from, const std::vector<real*>& to);
+
+// Time of one message to a neighbour (seconds) and the bandwidth to it (bytes per second),
+// the worst over all ranks. Both are 0 when no rank has a neighbour.
+void measure_links(std::shared_ptr<decomp_t> decomp, double* latency, double* bandwidth);
+
+// Element-wise sum of a buffer over all ranks, the result ends up on rank 0
+void reduce_to_root(std::shared_ptr<decomp_t> decomp, real* buffer, const size_t count);
+double max_over_ranks(std::shared_ptr<decomp_t> decomp, const double value);
+
+// The value of every rank on rank 0, in rank order
+void gather_to_root(std::shared_ptr<decomp_t> decomp, const int value, int* values);
+
+// The count values of every rank on rank 0, one rank after the other. counts holds the count of
+// every rank; gathered and counts are only used on rank 0.
+void gather_to_root(std::shared_ptr<decomp_t> decomp, const int* values, const int count, int* gathered,
+                    const int* counts);
+void gather_to_root(std::shared_ptr<decomp_t> decomp, const real* values, const int count, real* gathered,
+                    const int* counts);
+
+// The value of every rank, in rank order, on every rank
+void gather_from_ranks(std::shared_ptr<decomp_t> decomp, const double value, double* values);
+
+void free_decomp_arrays(std::shared_ptr<decomp_t> decomp);
+
+#endif // DECOMP_H
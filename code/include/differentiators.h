@@ -11,6 +11,7 @@
 #include <memory>
 #include <cstring>
 #include "mem_utils.h"
+#include "region.h"
 
 /* Todo: Add boundary treatment of the operators! Now they start half operator length in the model in all dimensions.
          Check that the indices in the array is correct related to the operator position!
@@ -21,27 +22,97 @@
 // Operator half length
 constexpr int half_length = 8;
 
+// Stencil border along y. The x-z (P-SV) build, -DELASTIC_2D, has a single y-plane and takes no
+// y-derivatives, so nothing is left out along y there.
+#ifdef ELASTIC_2D
+constexpr int half_length_y = 0;
+#else
+constexpr int half_length_y = half_length;
+#endif
+
+// Stencil border along axis d (0: x, 1: y, 2: z)
+inline int stencil_border(const int d) {
+  return (d == 1) ? half_length_y : half_length;
+}
+
+// The computed points of an nx x ny x nz grid, all points at least a stencil border from its faces
+inline region_t computed_region(const int nx, const int ny, const int nz) {
+  return make_region(half_length, nx - half_length, half_length_y, ny - half_length_y, half_length, nz - half_length);
+}
+
 // Weights in front of operators
 constexpr real W[half_length] = {1.2627, -0.1312, 0.0412, -0.0170, 0.0076, -0.0034, 0.0014, -0.0005};
 
+// Weights of the lower-order operators of half length 2 to 4 (see the table below), used in the
+// absorbing layers where accuracy matters little
+constexpr int kMaxShellOrder = 4;
+constexpr real W_low[kMaxShellOrder + 1][kMaxShellOrder] = {
+  {0.0, 0.0, 0.0, 0.0},
+  {1.0029, 0.0, 0.0, 0.0},
+  {1.1466, -0.0498, 0.0, 0.0},
+  {1.2049, -0.0841, 0.0100, 0.0},
+  {1.2327, -0.1049, 0.0211, -0.0038}
+};
+
+template <int L>
+inline const real* operator_weights() { return W_low[L]; }
+
+// Sum of the magnitudes of the weights of the full operator. The derivative of the shortest
+// wave on the grid (two points per wavelength) is 2 / h times this sum, the largest of all
+// operators in use, so it sets the stability limit of the time step.
+inline real operator_weight_sum() {
+  real sum = 0.0;
+  for (int l = 0; l < half_length; l++) {
+    sum += (W[l] < 0.0) ? -W[l] : W[l];
+  }
+  return sum;
+}
+
+template <>
+inline const real* operator_weights<half_length>() { return W; }
+
+// Enables helper threads on the SMT siblings that prefetch distance rows ahead in the
+// y- and z-derivatives (0 disables them). Each kernel then runs 2 * nthreads threads.
+void set_smt_prefetch(const int distance);
+
+// Half length (2 to 4) of the operator used outside the full-order box by the variants of the
+// derivatives below that take one. half_length uses the full operator everywhere, as does any
+// other order, with a warning.
+void set_shell_order(const int order);
+
+// The derivatives are computed for the points in region r, which must lie at least half_length
+// points inside the grid. Points of to outside r are left untouched.
+
 // Differentiation for dimension one (innermost dimension)
-void dx_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const int nz, const real scale, const int nthreads);
-void dx_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const int nz, const real scale, const int nthreads);
+void dx_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const real scale, const int nthreads);
+void dx_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const real scale, const int nthreads);
 
 // Differentiation for dimension two (middle dimension)
-void dy_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const int nz, const real scale, const int nthreads);
-void dy_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const int nz, const real scale, const int nthreads);
+void dy_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const real scale, const int nthreads);
+void dy_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const real scale, const int nthreads);
 
 // Differentiation for dimension three (outer dimension)
-void dz_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const int nz, const real scale, const int nthreads);
-void dz_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const int nz, const real scale, const int nthreads);
+void dz_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const real scale, const int nthreads);
+void dz_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const real scale, const int nthreads);
+
+// Same, with the full operator for the points of r inside the box full and the shell operator
+// (see set_shell_order) for the rest. The stencils of the full-order points still reach into
+// the shell, only the points of the shell are differentiated at lower order.
+void dx_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const region_t& full, const real scale, const int nthreads);
+void dx_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const region_t& full, const real scale, const int nthreads);
+void dy_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const region_t& full, const real scale, const int nthreads);
+void dy_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const region_t& full, const real scale, const int nthreads);
+
+// The z-derivatives take the scale of every z-plane instead, for grids with non-uniform dz
+void dz_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const region_t& full, const real* scales, const int nthreads);
+void dz_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const region_t& full, const real* scales, const int nthreads);
 
 
 /* Weights to have if other operators are used... DO NOT REMOVE!
 L=1: 1.0029f
 
 L=2: 1.1466f
-     0.0498f
+    -0.0498f
 
 L=3: 1.2049f
     -0.0841f
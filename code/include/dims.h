@@ -18,13 +18,18 @@ struct dims_s {
   int ny; // Size for y-axis (dimension 3)
   int nt; // Size for time axis
   int ghost_border;    // Number of points in ghost border layer for PML layers
+  bool free_surface;    // Free surface at the top of the grid instead of a PML layer
   int nz_ghost;    // Size for z-axis (dimension 1) with ghost borders included
   int nx_ghost;    // Size for x-axis (dimension 2) with ghost borders included
   int ny_ghost;    // Size for y-axis (dimension 3) with ghost borders included
-  real dz;    // Sampling for z-axis (dimension 1)
+  real dz;    // Sampling for z-axis (dimension 1), at the top of the grid
+  real dz_growth;    // Ratio of the z-sampling of a plane to that of the plane above it (1: uniform)
   real dx;    // Sampling for x-axis (dimension 2)
   real dy;    // Sampling for y-axis (dimension 3)
   real dt;    // Sampling for time axis
+  int x0;    // Global x-index of the first local point (non-zero for a decomposed grid)
+  int y0;    // Global y-index of the first local point (non-zero for a decomposed grid)
+  int z0;    // Global z-index of the first local point (non-zero for a decomposed grid)
 };
 
 typedef struct dims_s dims_t;
@@ -41,6 +46,12 @@ std::shared_ptr<dims_t> size_setup(const int nx,
                                    const real dz,
                                    const real dx,
                                    const real dy,
-                                   const real dt);
+                                   const real dt,
+                                   const bool free_surface = false);
+
+// Sampling along z at the global plane k, which may lie half way between two planes, and the
+// depth of that plane below global plane 0
+real plane_spacing(std::shared_ptr<dims_t> dims, const real k);
+real plane_depth(std::shared_ptr<dims_t> dims, const real k);
 
 #endif // DIMS_H
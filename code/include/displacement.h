@@ -0,0 +1,57 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 19, 2026
+ * Comment: Second-order displacement engine. With the stresses eliminated, the leapfrog scheme
+ * of step_engine reads u(n+1) = 2 u(n) - u(n-1) + dt^2 / rho D C D u(n) for the displacements u,
+ * with D the staggered derivatives and C the stiffness. The engine keeps the displacements of
+ * two time levels, as u(n) and the velocities (u(n) - u(n-1)) / dt in the velocity fields of
+ * the waves, so the source, receiver and model layers work unchanged. The stresses C D u(n) are
+ * evaluated on the fly in buffers of a slab of z-planes that moves through the grid, and the
+ * differentiator fields are not needed. That is 6 grid-sized fields instead of 12.
+ *
+ * The engine covers rigid boundaries on a single rank with leapfrog steps. The memory variables
+ * of the PML, the free surface and the halo exchange need the stress fields, and a run that asks
+ * for them uses the velocity-stress engine. So does the thread tuner, which is skipped.
+ */
+
+#ifndef DISPLACEMENT_H
+#define DISPLACEMENT_H
+
+#include <memory>
+
+#include "fd3d.h"
+#include "model3d.h"
+#include "step_engine.h"
+
+struct displacement_s {
+  real* u[3];    // Displacements along x, y and z, at the positions of vx, vy and vz
+  real* s[6];    // Stresses sxx, syy, szz, sxy, syz and sxz of the slab and half_length planes on
+                 // either side of it
+  int slab;    // Planes of the velocity updates per slab
+  int planes;    // Planes of the stress buffers, slab + 2 * half_length
+  real source_stress;    // Normal stress put in by a stress source so far
+  int source[3];    // Local position of the stress source, (-1, -1, -1) if not stored here
+};
+
+typedef struct displacement_s displacement_t;
+
+// Displacements and stress buffers for the local grid of waves, which is set up without stresses
+std::shared_ptr<displacement_t> displacement_setup(std::shared_ptr<fdm3d_t> waves, const int slab);
+
+// Puts in the source of time step it like insert_source does. A stress source is added to the
+// stresses of its point each time they are evaluated.
+void insert_displacement_source(std::shared_ptr<displacement_t> disp, std::shared_ptr<fdm3d_t> waves,
+                                std::shared_ptr<model3d_t> model, real* source, const int source_type,
+                                const int x, const int y, const int z, const int direction, const int it);
+
+// One time step: the velocities from the stresses of the current displacements, slab by slab,
+// then the displacements from the velocities
+void displacement_time_step(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                            std::shared_ptr<displacement_t> disp, const int nthreads,
+                            std::shared_ptr<step_timing_t> timing);
+
+// Bytes of the wave fields of the engine
+double displacement_bytes(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<displacement_t> disp);
+
+void free_displacement_arrays(std::shared_ptr<displacement_t> disp);
+
+#endif // DISPLACEMENT_H
@@ -0,0 +1,16 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Optional run-time settings read from OPTEWE_* environment variables.
+ */
+
+#ifndef ENV_H
+#define ENV_H
+
+#include <string>
+#include "common.h"
+
+int env_int(const char* name, const int fallback);
+real env_real(const char* name, const real fallback);
+std::string env_string(const char* name, const std::string& fallback);
+
+#endif // ENV_H
@@ -24,22 +24,31 @@ struct fdm3d_s {
   real* del3;    // Temporary differentiator field
   bool free_surface;    // If we have free surface or not
   int ghost_border;    // Number of points in ghost border for PML layers
+  struct pml3d_s* pml;    // Memory variables of the PML layers, NULL without a ghost border
+  struct activity_s* activity;    // Tiles the fields may have reached, NULL to compute everything
+  struct plane_samples_s* samples;    // Receivers the kernels sample, NULL to leave them to save_receivers
   int nt;        // Size for time axis
   int nz;        // Size for z-axis (dimension 1)
   int nx;        // Size for x-axis (dimension 2)
   int ny;        // Size for y-axis (dimension 3)
   real dt;    // Sampling for time axis
-  real dz;    // Sampling for z-axis (dimension 1)
+  real dz;    // Sampling for z-axis (dimension 1), at the top of the grid
+  real* inv_dz[2];    // 1 / dz of every local z-plane at integer [0] and half [1] positions
   real dx;    // Sampling for x-axis (dimension 2)
   real dy;    // Sampling for y-axis (dimension 3)
   int nz_ghost;    // Size for z-axis (dimension 1) with ghost borders included
   int nx_ghost;    // Size for x-axis (dimension 2) with ghost borders included
   int ny_ghost;    // Size for y-axis (dimension 3) with ghost borders included
+  int x0;    // Global x-index of the first local point
+  int y0;    // Global y-index of the first local point
+  int z0;    // Global z-index of the first local point
 };
 
 typedef struct fdm3d_s fdm3d_t;
 
-std::shared_ptr<fdm3d_t> fdm3d_setup(std::shared_ptr<dims_t> dims);
+// Without stresses only the velocity fields are allocated, and the stress and differentiator
+// fields are left NULL (for the displacement engine, see displacement.h)
+std::shared_ptr<fdm3d_t> fdm3d_setup(std::shared_ptr<dims_t> dims, const bool stresses = true);
 void free_wave_arrays(std::shared_ptr<fdm3d_t> waves);
 
 #endif // FD3D_H
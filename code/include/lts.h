@@ -0,0 +1,63 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Local time stepping along z. The planes whose velocity and sampling need the full
+ * time step form the fine zone; the planes above and below it are stable with rate times that
+ * step and form the coarse zones, which are updated once every rate steps. Next to each
+ * interface the fine stencils read half_length coarse planes (the strip), whose stresses are
+ * extrapolated and whose velocities are interpolated to the fine times, and the coarse stencils
+ * read half_length fine planes (the edge), whose velocities are averaged over the fine steps.
+ * A rate of 1 reduces to the ordinary leapfrog step.
+ */
+
+#ifndef LTS_H
+#define LTS_H
+
+#include <memory>
+
+#include "decomp.h"
+#include "fd3d.h"
+#include "model3d.h"
+#include "pml3d.h"
+#include "region.h"
+#include "step_engine.h"
+
+struct lts_s {
+  int rate;    // Fine steps per coarse step (1: local time stepping off)
+  int fine_k0;    // The planes [fine_k0, fine_k1) of the local grid form the fine zone
+  int fine_k1;
+  region_t fine;    // Computed points of the fine zone
+  region_t coarse[2];    // Computed points of the coarse zones
+  int ncoarse;
+  int strip_k0[2];    // First plane of the strip and the edge at every interface
+  int edge_k0[2];
+  real coarse_dt;    // Swapped with waves->dt and waves->pml while the coarse zones are updated
+  pml3d_t* coarse_pml;
+  real* stress_now[6];    // Strip stresses at the start of the coarse step ...
+  real* stress_prev[6];    // ... and at the start of the one before
+  real* v_old[3];    // Strip velocities before and after the coarse velocity update
+  real* v_new[3];
+  real* v_sum[3];    // Edge velocities summed over the fine steps, and the last ones
+  real* v_last[3];
+  bool started;    // The first coarse step has no previous stresses to extrapolate from
+};
+
+typedef struct lts_s lts_t;
+
+// Splits the local grid into the fine zone and the coarse zones for the given rate, from the
+// P-velocities of the model and the sampling of every plane. Local time stepping stays off
+// (rate 1) on a decomposed grid, and when no coarse zone would be left.
+std::shared_ptr<lts_t> lts_setup(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                                 std::shared_ptr<decomp_t> decomp, const int rate);
+
+// One fine time step (ctx->it). The coarse velocities are updated at the first fine step of
+// every coarse step and the coarse stresses at the last one.
+void lts_time_step(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                   std::shared_ptr<thread_table_t> threads, std::shared_ptr<lts_t> lts,
+                   step_context_t* ctx, std::shared_ptr<step_timing_t> timing);
+
+// Grid point updates per fine step relative to updating all planes every step
+double lts_work_ratio(std::shared_ptr<lts_t> lts);
+
+void free_lts_arrays(std::shared_ptr<lts_t> lts);
+
+#endif // LTS_H
@@ -9,5 +9,6 @@
 #include "common.h"
 
 void zero_data(real* buffer, const int nx, const int ny, const int nz);
+void zero_data(real* buffer, const int nx, const int ny, const int nz, const int nthreads);
 
 #endif //MEMORY_UTILS_H
@@ -6,6 +6,8 @@
 #ifndef MODEL3D_H
 #define MODEL3D_H
 
+#include <string>
+
 #include "dims.h"
 #include "mem_utils.h"
 
@@ -19,10 +21,23 @@ struct model3d_s {
   real* l;    // Input Lambda model (compliance version of lambda)
   real* m;    // Input Mu model (compliance version of mu)
   bool Vp, Vs, Rho, Lambda, Mu, L, M; // Booleans set to 1 if arrays are created.
+  char* shear_free;    // Planes whose shear stresses stay zero (fluid, mu = 0, see classify_fluid_planes)
+  char* normal_only;    // Planes whose velocities only see normal stresses: shear-free within half_length planes
 };
 
 typedef struct model3d_s model3d_t;
 
+// Horizontal layers, each reaching down to the top of the next one
+struct layers_s {
+  int n;    // Number of layers
+  real* top;    // Depth of the top of every layer below the top of the grid, increasing
+  real* rho;
+  real* vp;
+  real* vs;
+};
+
+typedef struct layers_s layers_t;
+
 std::shared_ptr<model3d_t> model_setup(std::shared_ptr<dims_t> dims);
 void free_model_arrays(std::shared_ptr<model3d_t> model);
 void set_uniform_model(std::shared_ptr<model3d_t> model,
@@ -31,4 +46,30 @@ void set_uniform_model(std::shared_ptr<model3d_t> model,
                        const real _vp,
                        const real _vs);
 
+// Layers from a description of the form "top rho vp vs top rho vp vs ...". An empty description
+// gives a single layer with the given parameters, and so does, with a warning, one that is not
+// whole groups of numbers with increasing tops, rho > 0, vp > 0 and vs >= 0.
+std::shared_ptr<layers_t> read_layers(const std::string& description,
+                                      const real _rho,
+                                      const real _vp,
+                                      const real _vs);
+real layers_vp_max(std::shared_ptr<layers_t> layers);
+
+// Largest stable time step of the leapfrog scheme for the layered model on the grid of dims:
+// dt * vp * weight_sum * sqrt(1/dx^2 + 1/dy^2 + 1/dz^2) <= 1 at every plane, times safety
+real stable_time_step(std::shared_ptr<dims_t> dims, std::shared_ptr<layers_t> layers,
+                      const real weight_sum, const real safety);
+void set_layered_model(std::shared_ptr<model3d_t> model,
+                       std::shared_ptr<dims_t> dims,
+                       std::shared_ptr<layers_t> layers);
+void free_layers_arrays(std::shared_ptr<layers_t> layers);
+
+// Marks the planes of the local grid of dims where the shear stresses never leave zero: mu is
+// zero in the plane and the one below (the shear stresses average mu over both), or, above a
+// free surface, in the plane they are mirrored from. The step engine skips the shear stresses
+// there, and updates the velocities from the normal stresses alone half_length planes further
+// inside the fluid, so the coupling at the fluid-solid interface stays complete. Called by
+// set_uniform_model and set_layered_model.
+void classify_fluid_planes(std::shared_ptr<model3d_t> model, std::shared_ptr<dims_t> dims);
+
 #endif // MODEL3D_H
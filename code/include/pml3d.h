@@ -0,0 +1,55 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Convolutional PML (C-PML) absorbing boundaries in the ghost_border slabs of the grid.
+ * Every derivative across a slab is replaced by del / kappa + psi, where the memory variable
+ * psi = b * psi + a * del is kept per derivative kernel. The memory variables only cover the
+ * slabs along the axis of their derivative, and the correction is a separate kernel applied
+ * to the part of a region that lies in those slabs, so the interior kernels stay unchanged.
+ */
+
+#ifndef PML3D_H
+#define PML3D_H
+
+#include <memory>
+
+#include "decomp.h"
+#include "fd3d.h"
+#include "region.h"
+#include "thread_table.h"
+
+struct pml3d_s {
+  int width;    // Points in the layer at every side of the global grid but a free surface (ghost_border)
+  real vp_max;    // Largest P-velocity of the model, sets the damping
+  real a_max;    // Frequency shift alpha at the inner edge of the layer
+  real k_max;    // Stretching kappa at the outer edge of the layer
+  int n[3];    // Local grid size along x, y and z
+  int lo_end[3];    // Along axis d the layer covers the local indices [0, lo_end) ...
+  int hi_begin[3];    // ... and [hi_begin, n)
+  real* a[3][2];    // Coefficients along x, y and z at integer [0] and half [1] grid positions
+  real* b[3][2];
+  real* kappa_inv[3][2];
+  real* psi[kNumKernels][2];    // Memory variables of the derivative kernels at the low and high side
+};
+
+typedef struct pml3d_s pml3d_t;
+
+// Sets up the layer of the local grid of waves (waves->pml). Does nothing without a ghost border.
+void pml_setup(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<decomp_t> decomp,
+               const real vp_max, const real a_max, const real k_max);
+
+// Applies the C-PML correction to the derivative del computed by kernel for the points of r in
+// the layer. Does nothing if pml is NULL.
+void apply_pml(pml3d_t* pml, const kernel_id kernel, real* del, const region_t& r, const int nthreads);
+
+// Moves the memory variables of the owned points from the layer of the old layout (see
+// move_owned_points) to the layer of the current one
+void move_pml_points(std::shared_ptr<decomp_t> decomp, int* const old_cuts[3], const int* old_offset,
+                     pml3d_t* from, pml3d_t* to);
+
+// Box of the local grid outside all layers, where the derivatives use the full operator. The
+// whole grid without a PML.
+region_t full_order_region(std::shared_ptr<fdm3d_t> waves);
+
+void free_pml_arrays(pml3d_t* pml);
+
+#endif // PML3D_H
@@ -7,12 +7,22 @@
 #define PRINT_H
 
 #include "common.h"
+#include "thread_table.h"
 #include <iostream>
 #include <iomanip>
 
 void print_application_info(std::string app_name, const int source_type, const int Nx, const int Ny,
                             const int Nz, const int Nt);
 void print_omp_info(const unsigned int num_threads);
+void print_thread_table(std::shared_ptr<thread_table_t> table);
+void print_decomp_info(const int nranks, const int* procs, const int halo_depth);
+void print_time_step_info(const real dt, const real dt_stable, const int time_order);
+void print_lts_info(const int rate, const int fine_k0, const int fine_k1, const double work_ratio);
+void print_activity_info(const int tile, const double work_ratio);
+void print_engine_info(const std::string& engine, const double wave_bytes);
+void print_fluid_info(const double work_ratio);
+void print_exposed_communication(const double exposed_seconds, const int Nt);
+void print_shots_summary(const int nshots, const int threads_per_shot, const double elapsed_seconds);
 void print_perf_summary(const double mlups, const double compute_timer);
 void print_3D(const real* __restrict__ buffer, const int Nx, const int Ny, const int Nz);
 void print_2D(const real* __restrict__ buffer, const int Nx, const int Ny);
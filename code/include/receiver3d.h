@@ -7,6 +7,10 @@
 #define RECEIVER3D_H
 
 #include "fd3d.h"
+#include "decomp.h"
+#include "receiver_geometry.h"
+#include "step_forward.h"
+#include "trace_writer.h"
 #include <fstream>
 
 struct receiver3d_s {
@@ -17,26 +21,66 @@ struct receiver3d_s {
   real* vx;        // Array for Vx receivers
   real* vz;        // Array for Vz receivers
   real* vy;        // Array for Vy receivers
-  bool P, Vz, Vx, Vy;    // Booleans to control which field is defined
+  real* d;        // Array for dilatation rate receivers
+  bool P, Vz, Vx, Vy, D;    // Booleans to control which field is defined
   int* x;        // x position fo receiver
   int* y;        // z position fo receiver
   int* z;        // y position fo receiver
+  int* order;        // All receivers sorted by z, y and x, NULL until they are first located
+  int nlocal;        // Receivers in the part of this rank, -1 until they are located
+  int* local;        // Numbers of the local receivers, in the order of their offsets
+  int* offset;        // Linear offsets of the local receivers in the wave fields, ascending
+  int nfields;        // Fields recorded per receiver and step
+  int nstaged;        // Steps in the staging buffer
+  int first;        // Time step of the first staged step
+  real* staging;        // Staged values, time-major: kStagedSteps steps of nfields x nlocal values,
+                        // and the pending step
+  bool fused[5];        // Fields (P, Vx, Vy, Vz, D) the kernels sample into the staging buffer
+  int nsources;        // Points of the sources
+  long long* sources;        // Keys (see set_receiver_sources) of the source points, ascending
+  int* plane_first;        // Local receivers of plane k are plane_first[k] <= r < plane_first[k + 1]
+  int* column[2];        // Local x and y of the local receivers
+  int* near;        // Local receivers within one point of a source, whose fields the sources
+  int nnear;        // change after the kernels sampled them
+  int pending;        // Step the kernels sample, -1 if none
+  plane_samples_t samples;        // Staging row of the pending step, handed to the kernels
+  trace_writer_t* writer;        // Trace file the staged steps stream to, NULL to keep the traces
+  int* owned;        // Rank 0 of a trace file: the local receivers of every rank, in rank order,
+  int* owned_count;        // and how many each rank has, as the ranks stage them
+  real* gathered;        // Rank 0 of a trace file: the staged steps of every rank, in rank order
 };
 
 typedef struct receiver3d_s receiver3d_t;
 
+// Fields a receiver can record, in the order of the staged steps and of the receiver file:
+// pressure, Vx, Vy, Vz and the dilatation rate dVx/dx + dVy/dy + dVz/dz
+const int kReceiverFields = 5;
+
+// Fields of receiver type rectype (see README): 1 P, 2 P-Vz, 3 OBC (P-Vz-Vx-Vy), 4 Vz-Vx-Vy,
+// 5 Vz, 6 Vx, 7 Vy, 8 dilatation rate. False, with no field set, for other types.
+bool receiver_type_fields(const int rectype, bool* fields);
+
+// Without traces the n x nt arrays are not allocated, and the receivers have to stream
 std::shared_ptr<receiver3d_t> receiver3d_setup(const int _n,
-                                               const int _ny,
-                                               const bool _P,
-                                               const bool _Vx,
-                                               const bool _Vy,
-                                               const bool _Vz);
+                                               const int _nt,
+                                               const int _rectype,
+                                               const bool traces = true);
 int determine_receiver_value(const int Nz);
 void setup_receiver_for_verification(std::shared_ptr <receiver3d_t> receiver,
                                      const int Nz,
                                      const int x_source,
                                      const int y_source,
                                      const int z_source);
+// The sources at the n global points (x, y, z), of which the receivers next to one are sampled
+// again after the source went in. The layouts below set the one source they are placed around.
+void set_receiver_sources(std::shared_ptr <receiver3d_t> receiver, const int n, const int* x, const int* y,
+                          const int* z);
+// Receivers at the positions of a geometry file, for a source at (x_source, y_source, z_source)
+void setup_receiver_geometry(std::shared_ptr <receiver3d_t> receiver,
+                             std::shared_ptr <receiver_geometry_t> geometry,
+                             const int x_source,
+                             const int y_source,
+                             const int z_source);
 void setup32(std::shared_ptr <receiver3d_t> receiver, const int x_source, const int y_source, const int z_source);
 void setup64(std::shared_ptr <receiver3d_t> receiver, const int x_source, const int y_source, const int z_source);
 void setup128(std::shared_ptr <receiver3d_t> receiver, const int x_source, const int y_source, const int z_source);
@@ -44,8 +88,42 @@ void setup256(std::shared_ptr <receiver3d_t> receiver, const int x_source, const
 void setup512(std::shared_ptr <receiver3d_t> receiver, const int x_source, const int y_source, const int z_source);
 void setup1024(std::shared_ptr <receiver3d_t> receiver, const int x_source, const int y_source, const int z_source);
 
-void save_receivers(std::shared_ptr<receiver3d_t> rec, std::shared_ptr<fdm3d_t> waves, const int _it);
-void write_receiver_file(std::shared_ptr<receiver3d_t> rec, std::shared_ptr<dims_t> dims);
+// Steps gathered into the staging buffer before they are transposed into the traces
+const int kStagedSteps = 64;
+
+// Lets the velocity updates (and, with pressure, the normal stress updates) of time_step sample
+// the receivers of the next step as they finish each plane, instead of save_receivers gathering
+// them afterwards. Only for the leapfrog step of time_step, and pressure without a free surface,
+// whose update of the surface follows the kernel. The dilatation rate is always sampled by the
+// normal stress update of time_step, from the derivatives it takes of the velocities, into the
+// step saved last; a run that records it uses the leapfrog step.
+void fuse_receivers(std::shared_ptr<receiver3d_t> rec, const bool velocities, const bool pressure);
+
+// Linear offsets of the receivers owned by this rank, sorted so the gathers walk the fields
+// forward, and bucketed by plane for the kernels. The receivers are sorted by position once, and
+// a rank only looks at those in the planes of its part. Called again when the cuts move, after
+// the staged steps are written out.
+void locate_receivers(std::shared_ptr<receiver3d_t> rec, std::shared_ptr<fdm3d_t> waves,
+                      std::shared_ptr<decomp_t> decomp, const int nthreads);
+// Gathers the fields at the receivers of step _it into the staging buffer, after the source of
+// the step is put in. With fused receivers only the fields the kernels do not sample, and the
+// receivers next to the source, are gathered.
+void save_receivers(std::shared_ptr<receiver3d_t> rec, std::shared_ptr<fdm3d_t> waves,
+                    std::shared_ptr<decomp_t> decomp, const int _it, const int nthreads);
+// Streams the recording to filename instead of keeping it in the traces: at every flush the ranks
+// send the staged steps of their own receivers to rank 0, which puts them into a block of all
+// receivers that a writer thread appends to the file while the run goes on. Only rank 0 holds
+// blocks of all receivers. Called on all ranks once the receiver positions are set.
+void stream_receivers(std::shared_ptr<receiver3d_t> rec, std::shared_ptr<decomp_t> decomp,
+                      std::shared_ptr<dims_t> dims, const std::string& filename);
+// Transposes the staged steps into the traces of the receivers on nthreads threads, or streams them
+void flush_receivers(std::shared_ptr<receiver3d_t> rec, std::shared_ptr<decomp_t> decomp, const int nthreads);
+// Collects the traces on rank 0, or writes the last block and closes the trace file
+void gather_receivers(std::shared_ptr<receiver3d_t> rec, std::shared_ptr<decomp_t> decomp, const int nthreads);
+// Formats the receivers in batches of at most kFileBatch receivers and kFileBatchBytes of text,
+// each batch on nthreads threads, so the text never takes more memory than one batch
+void write_receiver_file(std::shared_ptr<receiver3d_t> rec, std::shared_ptr<dims_t> dims, const int nthreads,
+                         const std::string& filename = "receivers.csv");
 void free_receiver_arrays(std::shared_ptr<receiver3d_t> rec);
 
 #endif //FD3D_RECEIVER3D_H
@@ -0,0 +1,44 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 19, 2026
+ * Comment: Receiver positions read from a geometry file instead of the layouts around the source.
+ * The positions are points of the global grid, ghost borders included, as in the receiver
+ * file (whose positions are these times the sampling). A file is either
+ *
+ *   a binary list, little-endian as written by the machine:
+ *     char[8]   "OPTEWERC"
+ *     int32     number of receivers n
+ *     int32     x, y and z of each receiver, n * 3 values
+ *
+ *   or a text grid descriptor, '#' starting a comment:
+ *     grid x0 nx sx y0 ny sy z0 nz sz
+ *   for the nx x ny x nz receivers at (x0 + i sx, y0 + j sy, z0 + k sz), x fastest.
+ *
+ * Receivers outside the computed points of the grid are dropped with a warning. The x-z build
+ * puts all receivers in its single y-plane.
+ */
+
+#ifndef RECEIVER_GEOMETRY_H
+#define RECEIVER_GEOMETRY_H
+
+#include <memory>
+#include <string>
+
+#include "dims.h"
+
+struct receiver_geometry_s {
+  int n;    // Number of receivers
+  int* x;    // Global grid points of the receivers
+  int* y;
+  int* z;
+};
+
+typedef struct receiver_geometry_s receiver_geometry_t;
+
+// Geometry of filename for the global grid dims, NULL if the file cannot be read. A grid
+// descriptor is expanded on nthreads threads.
+std::shared_ptr<receiver_geometry_t> read_receiver_geometry(const std::string& filename, std::shared_ptr<dims_t> dims,
+                                                             const int nthreads);
+
+void free_receiver_geometry_arrays(std::shared_ptr<receiver_geometry_t> geometry);
+
+#endif // RECEIVER_GEOMETRY_H
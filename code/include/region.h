@@ -0,0 +1,44 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Boxes of grid points the kernels are applied to.
+ */
+
+#ifndef REGION_H
+#define REGION_H
+
+#include "common.h"
+
+struct region_s {
+  int i0, i1;    // x-range [i0, i1)
+  int j0, j1;    // y-range [j0, j1)
+  int k0, k1;    // z-range [k0, k1)
+};
+
+typedef struct region_s region_t;
+
+inline region_t make_region(const int i0, const int i1, const int j0, const int j1, const int k0, const int k1) {
+  region_t r = {i0, i1, j0, j1, k0, k1};
+  return r;
+}
+
+// All points at least width points away from the faces of an nx x ny x nz grid
+inline region_t inner_region(const int nx, const int ny, const int nz, const int width) {
+  return make_region(width, nx - width, width, ny - width, width, nz - width);
+}
+
+inline bool is_empty(const region_t& r) {
+  return r.i0 >= r.i1 || r.j0 >= r.j1 || r.k0 >= r.k1;
+}
+
+// Points that lie in both a and b (empty if they do not overlap)
+inline region_t intersect_regions(const region_t& a, const region_t& b) {
+  return make_region(a.i0 > b.i0 ? a.i0 : b.i0, a.i1 < b.i1 ? a.i1 : b.i1,
+                     a.j0 > b.j0 ? a.j0 : b.j0, a.j1 < b.j1 ? a.j1 : b.j1,
+                     a.k0 > b.k0 ? a.k0 : b.k0, a.k1 < b.k1 ? a.k1 : b.k1);
+}
+
+inline long region_points(const region_t& r) {
+  return is_empty(r) ? 0 : (long) (r.i1 - r.i0) * (r.j1 - r.j0) * (r.k1 - r.k0);
+}
+
+#endif // REGION_H
@@ -0,0 +1,50 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Socket-split mode. Several independent simulations (shots) run side by side in one
+ * process, each with its own team of threads bound to one NUMA domain. Every shot allocates
+ * and first touches its wave fields from its own team, so they live in node-local memory.
+ * The model is either replicated per shot the same way or shared read-only by all shots.
+ */
+
+#ifndef SHOTS_H
+#define SHOTS_H
+
+#include <memory>
+
+#include "dims.h"
+#include "model3d.h"
+#include "step_engine.h"
+
+struct shots_s {
+  int nshots;    // Number of simulations running side by side
+  int first_shot;    // Number of the first shot of this process (shots are numbered over all ranks)
+  int nthreads;    // Threads of every simulation
+  int spacing;    // Offset in x of the source of shot s + 1 from that of shot s
+  bool shared_model;    // One model for all shots instead of one per shot
+  int source_type;    // Source type, as on the command line
+  int x_source;    // Source position of the first shot
+  int y_source;
+  int z_source;
+  int source_dir;    // Direction of force sources
+  real a_max;    // PML parameters (see pml3d.h)
+  real k_max;
+  int time_order;    // Order of the time stepping (see lax_wendroff.h)
+  int rectype;    // Receiver type (see receiver3d.h)
+  int activity_tile;    // Tiles and margin of the activity mask (see activity.h), 0: no mask
+  int activity_margin;
+  double* elapsed;    // Seconds taken by every shot
+};
+
+typedef struct shots_s shots_t;
+
+std::shared_ptr<shots_t> shots_setup(const int nshots, const int nthreads);
+
+// Runs the shots of this process over the full grid given by dims and the model given by layers.
+// The receivers of shot s go to receivers_shot<s>.csv.
+// Returns the seconds until the last shot finished.
+double run_shots(std::shared_ptr<shots_t> shots, std::shared_ptr<dims_t> dims, std::shared_ptr<layers_t> layers,
+                 real* source, step_context_t* ctx);
+
+void free_shots_arrays(std::shared_ptr<shots_t> shots);
+
+#endif // SHOTS_H
@@ -0,0 +1,106 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Helper-thread prefetching on SMT siblings. Every compute thread is paired with
+ * its hyperthread sibling, which walks the same rows a few rows ahead and only issues
+ * prefetches. The pairing assumes that OpenMP threads 2p and 2p+1 share a core, e.g.
+ * KMP_AFFINITY=granularity=fine,compact.
+ */
+
+#ifndef SMT_PREFETCH_H
+#define SMT_PREFETCH_H
+
+#include <atomic>
+#include <omp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SMT_PAUSE() _mm_pause()
+#else
+#define SMT_PAUSE()
+#endif
+
+#include "common.h"
+
+// Number of floats per cache line
+constexpr int kFloatsPerLine = 64 / sizeof(real);
+
+// Prefetch one row of n values into L2 (read or write)
+inline void prefetch_row(const real* row, const int n) {
+  for (int i = 0; i < n; i += kFloatsPerLine) {
+    __builtin_prefetch(row + i, 0, 2);
+  }
+}
+
+inline void prefetch_row_for_write(real* row, const int n) {
+  for (int i = 0; i < n; i += kFloatsPerLine) {
+    __builtin_prefetch(row + i, 1, 2);
+  }
+}
+
+struct smt_progress_s {
+  std::atomic<int> row;    // Number of rows the compute thread has finished
+  char pad[64 - sizeof(std::atomic<int>)];    // Keep every pair on its own cache line
+};
+
+// Sweeps the rows (j, k) in [j0, j1) x [k0, k1). The rows are split in z among nthreads
+// compute threads; the sibling of each compute thread calls prefetch(j, k) for rows at most
+// distance rows ahead of its compute thread and skips rows the compute thread already passed.
+template <typename Body, typename Prefetch>
+void smt_row_sweep(const int j0, const int j1, const int k0, const int k1,
+                   const int nthreads, const int distance, Body body, Prefetch prefetch) {
+
+  const int nrows_j = j1 - j0;
+  smt_progress_s* progress = new smt_progress_s[nthreads];
+
+  for (int p = 0; p < nthreads; p++) {
+    progress[p].row.store(0);
+  }
+
+  #pragma omp parallel num_threads(2 * nthreads)
+  {
+    const int tid = omp_get_thread_num();
+    const int pair = tid / 2;
+    const int team = omp_get_num_threads() / 2;
+
+    if (team == 0) {
+      // Only one thread was granted: compute everything without a helper
+      for (int k = k0; k < k1; k++) {
+        for (int j = j0; j < j1; j++) {
+          body(j, k);
+        }
+      }
+    } else if (pair < team) {
+      const int kb = k0 + ((k1 - k0) * pair) / team;
+      const int ke = k0 + ((k1 - k0) * (pair + 1)) / team;
+      const int nrows = (ke - kb) * nrows_j;
+
+      if (tid % 2 == 0) {
+        // Compute thread
+        for (int r = 0; r < nrows; r++) {
+          body(j0 + r % nrows_j, kb + r / nrows_j);
+          progress[pair].row.store(r + 1, std::memory_order_release);
+        }
+      } else {
+        // Prefetch thread
+        int r = 0;
+        while (r < nrows) {
+          const int done = progress[pair].row.load(std::memory_order_acquire);
+          if (r < done) {
+            r = done;
+            continue;
+          }
+          if (r >= done + distance) {
+            SMT_PAUSE();
+            continue;
+          }
+          prefetch(j0 + r % nrows_j, kb + r / nrows_j);
+          r++;
+        }
+      }
+    }
+  }
+
+  delete[] progress;
+}
+
+#endif // SMT_PREFETCH_H
@@ -6,6 +6,8 @@
 #ifndef SOURCE_H
 #define SOURCE_H
 
+#include <string>
+
 #include "fd3d.h"
 #include "model3d.h"
 
@@ -26,4 +28,57 @@ void insert_force_source(std::shared_ptr<fdm3d_t> waves,
                          const int direction,
                          const int type);
 
+// Source of the given type (1: stress monopole, 2: force monopole, otherwise force dipole)
+void insert_source(std::shared_ptr<fdm3d_t> waves,
+                   std::shared_ptr<model3d_t> model,
+                   real* source,
+                   const int source_type,
+                   const int _x,
+                   const int _y,
+                   const int _z,
+                   const int direction,
+                   const int it);
+
+// Point sources of one signature at any number of global points, each with the type and
+// direction of the command line and a weight. Every rank turns the points it stores into
+// entries (local offset, field, coefficient), so a step adds source[it] * dt times the
+// coefficient of each entry to its field, with one scatter per field and nothing to decide.
+// Entries of the same field and offset are merged, so the scatters hit distinct points.
+const int kSourceFields = 6;    // sxx, syy, szz, vx, vy, vz
+
+struct sources_s {
+  int npoints;    // Points of the sources
+  int* x;    // Global positions of the points
+  int* y;
+  int* z;
+  real* weight;    // Strength of each point, 1 for a point source of the command line
+  int type;    // 1: stress monopole, 2: force monopole, otherwise force dipole
+  int direction;    // Direction of force monopoles (1: x, 2: y, otherwise z)
+  int n;    // Entries on this rank
+  int first[kSourceFields + 1];    // Entries of field f are first[f] <= e < first[f + 1]
+  int* offset;    // Local linear offsets of the entries, ascending within a field
+  double* coefficient;    // Scale of source[it] * dt: weight, 1 / rho and the dipole spacing
+};
+
+typedef struct sources_s sources_t;
+
+// Sources at the points of a descriptor "x0 nx sx y0 ny sy z0 nz sz [weight]" of global grid
+// points, the nx x ny x nz points at (x0 + i sx, y0 + j sy, z0 + k sz) with the given weight
+// (default 1; 1 / (nx ny nz) spreads one source over a line or an area). Points outside the
+// computed grid of dims are dropped with a warning. Without a descriptor, or with no points left,
+// a single source at (x, y, z).
+std::shared_ptr<sources_t> sources_setup(const std::string& descriptor, std::shared_ptr<dims_t> dims,
+                                         const int type, const int direction, const int x, const int y,
+                                         const int z);
+
+// Entries of the points stored in the local grid of waves. Called again when the cuts move.
+void locate_sources(std::shared_ptr<sources_t> sources, std::shared_ptr<fdm3d_t> waves,
+                    std::shared_ptr<model3d_t> model);
+
+// Adds the sources of time step it
+void inject_sources(std::shared_ptr<sources_t> sources, std::shared_ptr<fdm3d_t> waves, const real* source,
+                    const int it);
+
+void free_sources_arrays(std::shared_ptr<sources_t> sources);
+
 #endif // SOURCE_H
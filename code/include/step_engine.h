@@ -0,0 +1,94 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: The kernels of one time step, applied to a region of the grid. On a decomposed grid
+ * the halo exchange of each half step is overlapped with the update of the interior, the part
+ * of the grid whose stencils do not reach into the halos. The slabs next to the halos are
+ * updated once the messages have arrived. With a deep halo (decomp->depth > 0) the halos are
+ * exchanged every depth steps and the part of the halo that is still valid is updated along
+ * with the owned points in between.
+ */
+
+#ifndef STEP_ENGINE_H
+#define STEP_ENGINE_H
+
+#include <memory>
+#include <vector>
+
+#include <x86_dvfs.h>
+
+#ifdef HDEEM
+#include "nemi.h"
+#endif
+
+#include "decomp.h"
+#include "fd3d.h"
+#include "model3d.h"
+#include "region.h"
+#include "thread_table.h"
+
+// State of the per-kernel frequency scaling and energy measurements
+struct step_context_s {
+  x86_adapt_device_type core_type;
+  x86_adapt_device_type uncore_type;
+  int fd;
+  int numa_nodes;
+  int pstate_idx;
+  int uncore_min_idx;
+  int uncore_max_idx;
+#ifdef HDEEM
+  std::vector<kernel>* kernels;    // Kernel timings, processed by nemi after the run
+#endif
+  int it;    // Current time step
+};
+
+typedef struct step_context_s step_context_t;
+
+struct step_regions_s {
+  region_t interior;    // Points whose stencils stay clear of the halos
+  region_t boundary[6];    // Slabs next to the halos, disjoint from each other and the interior
+  int nboundary;
+};
+
+typedef struct step_regions_s step_regions_t;
+
+struct step_timing_s {
+  double compute;    // Seconds spent in the kernels
+  double exposed;    // Seconds spent in the halo exchange that were not hidden by the kernels
+  bool print_steps;    // Print the timing of every step
+};
+
+typedef struct step_timing_s step_timing_t;
+
+std::shared_ptr<step_regions_t> step_regions_setup(std::shared_ptr<decomp_t> decomp, std::shared_ptr<fdm3d_t> waves);
+std::shared_ptr<step_timing_t> step_timing_setup(const bool print_steps);
+
+// Kernels of the velocity and the stress half step for the points in region r, or those of them
+// in the active tiles with an activity mask (see activity.h)
+void update_velocities(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                       std::shared_ptr<thread_table_t> threads, const region_t& r, step_context_t* ctx);
+void update_stresses(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                     std::shared_ptr<thread_table_t> threads, const region_t& r, step_context_t* ctx);
+
+// Skip the shear stresses and their derivatives in the fluid planes of the model (mu = 0, see
+// classify_fluid_planes). On by default; the results are the same either way.
+void set_fluid_path(const bool enabled);
+
+// Kernel passes over the points of the local grid in one step (passes[0]) and without the fluid
+// path (passes[1])
+void kernel_passes(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model, real* passes);
+
+// Stress images above the free surface for the columns of r, after all stresses of the step.
+// Does nothing unless the free surface lies in the local grid.
+void image_free_surface(std::shared_ptr<fdm3d_t> waves, const region_t& r, const int nthreads);
+
+// One full time step, with the halo exchanges overlapped with the interior unless a deep halo is used
+void time_step(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+               std::shared_ptr<thread_table_t> threads, std::shared_ptr<decomp_t> decomp,
+               std::shared_ptr<step_regions_t> regions, step_context_t* ctx,
+               std::shared_ptr<step_timing_t> timing);
+
+// Halo depth with the lowest modelled cost per step from the measured message latency and
+// bandwidth and the time per grid point of the kernels. Returns 0 for the per-half-step exchange.
+int select_halo_depth(std::shared_ptr<decomp_t> decomp, const int nthreads, step_context_t* ctx);
+
+#endif // STEP_ENGINE_H
@@ -8,34 +8,80 @@
 
 #include "fd3d.h"
 #include "model3d.h"
+#include "region.h"
+
+// Receivers sampled by the velocity and normal stress updates as each plane is finished, while it
+// is still in cache (see receiver3d.h). The receivers of local plane k are first[k] <= s <
+// first[k + 1]; an update writes those in the columns of its region to to[c][s], from the field
+// it updates at offset[s]. The normal stress update also writes the dilatation rate
+// dvx/dx + dvy/dy + dvz/dz from the derivatives it was given.
+struct plane_samples_s {
+  const int* first;
+  const int* offset;
+  const int* x;    // Local x and y of the receivers
+  const int* y;
+  real* to[5];    // Samples for pressure, vx, vy, vz and the dilatation rate, NULL for fields not
+                  // sampled here
+};
+
+typedef struct plane_samples_s plane_samples_t;
+
+// The updates are applied to the points in region r, and sample the receivers in it unless
+// samples is NULL
 
 void compute_vx(real* vx, const real* __restrict__ rho, const real* __restrict__ del1,
                 const real* __restrict__ del2, const real* __restrict__ del3, const real dt,
-                const int nx_ghost, const int ny_ghost, const int nz_ghost, const int nthreads);
+                const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads,
+                const plane_samples_t* samples = NULL);
 
 
 void compute_vy(real* vy, const real* __restrict__ rho, const real* __restrict__ del1,
                 const real* __restrict__ del2, const real* __restrict__ del3, const real dt,
-                const int nx_ghost, const int ny_ghost, const int nz_ghost, const int nthreads);
+                const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads,
+                const plane_samples_t* samples = NULL);
 
 void compute_vz(real* vz, const real* __restrict__ rho, const real* __restrict__ del1,
                 const real* __restrict__ del2, const real* __restrict__ del3, const real dt,
-                const int nx_ghost, const int ny_ghost, const int nz_ghost, const int nthreads);
+                const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads,
+                const plane_samples_t* samples = NULL);
+
+// Velocity update from the normal stress alone, for points where the shear stresses and their
+// derivatives are zero (fluid). del holds the derivative of sxx, syy or szz along axis d of the
+// velocity component v (0: vx, 1: vy, 2: vz).
+void compute_v_normal(real* v, const real* __restrict__ rho, const real* __restrict__ del, const real dt,
+                      const int d, const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads,
+                      const plane_samples_t* samples = NULL);
 
 void compute_sxy(real* sxy, const real* __restrict__ mu, const real* __restrict__ del1,
                  const real* __restrict__ del2, const real dt,
-                 const int nx_ghost, const int ny_ghost, const int nz_ghost, const int nthreads);
+                 const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads);
 
 void compute_syz(real* syz, const real* __restrict__ mu, const real* __restrict__ del1,
                  const real* __restrict__ del2, const real dt,
-                 const int nx_ghost, const int ny_ghost, const int nz_ghost, const int nthreads);
+                 const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads);
 
 void compute_sxz(real* sxz, const real* __restrict__ mu, const real* __restrict__ del1,
                  const real* __restrict__ del2, const real dt,
-                 const int nx_ghost, const int ny_ghost, const int nz_ghost, const int nthreads);
+                 const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads);
 
 void compute_sxx_syy_szz(real* sxx, real* syy, real* szz, const real* __restrict__ del1,
                          const real* __restrict__ del2, const real* __restrict__ del3,
                          const real* __restrict__ lambda, const real* __restrict__ mu,  const real dt,
-                         const int nx_ghost, const int ny_ghost, const int nz_ghost, const int nthreads);
+                         const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads,
+                         const plane_samples_t* samples = NULL);
+
+// Free surface in the plane k = surface. Called after compute_sxx_syy_szz with its derivatives
+// still in del1 (dvz/dz), del2 (dvx/dx) and del3 (dvy/dy): sets szz to zero in the points of r in
+// that plane and replaces dvz/dz in sxx and syy by the value that keeps szz zero. The dilatation
+// rate of the receivers in the plane is sampled again with that dvz/dz.
+void free_surface_normal(real* sxx, real* syy, real* szz, const real* __restrict__ del1,
+                         const real* __restrict__ del2, const real* __restrict__ del3,
+                         const real* __restrict__ lambda, const real* __restrict__ mu, const real dt,
+                         const int nx_ghost, const int ny_ghost, const region_t& r, const int surface,
+                         const int nthreads, const plane_samples_t* samples = NULL);
+
+// Mirrors szz, sxz and syz of the columns of r antisymmetrically into the half_length planes
+// above the free surface, once all stresses of the step are updated
+void free_surface_image(real* szz, real* sxz, real* syz, const int nx_ghost, const int ny_ghost,
+                        const region_t& r, const int surface, const int nthreads);
 #endif // STEPFORWARD_H
@@ -0,0 +1,57 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Per-kernel OpenMP thread counts. Memory-bound kernels saturate the
+ * memory bandwidth with fewer threads than the compute-bound ones, so each of
+ * the 25 kernels in a time step gets its own thread count.
+ */
+
+#ifndef THREAD_TABLE_H
+#define THREAD_TABLE_H
+
+#include <memory>
+#include <string>
+
+#include "fd3d.h"
+#include "model3d.h"
+
+// Kernels in the order they are launched in a time step (see batch/kernels.sh)
+enum kernel_id {
+  kDXF, kDZB, kDYB, kCVX,
+  kDYF, kDZB2, kDXB, kCVY,
+  kDZF, kDXB2, kDYB2, kCVZ,
+  kDZB3, kDXB3, kDYB3, kCSXXSYYSZZ,
+  kDYF2, kDXF2, kCSXY,
+  kDZF2, kDYF3, kCSYZ,
+  kDXF3, kDZF3, kCSXZ,
+  kNumKernels
+};
+
+extern const char* const kKernelNames[kNumKernels];
+
+struct thread_table_s {
+  int nthreads[kNumKernels];    // Number of threads used by each kernel
+};
+
+typedef struct thread_table_s thread_table_t;
+
+std::shared_ptr<thread_table_t> thread_table_setup(const int nthreads);
+
+// True if the time step launches the kernel. The x-z build has no y-derivatives and no updates
+// of vy, sxy and syz.
+bool kernel_launched(const int k);
+
+int kernel_index(const std::string& name);
+bool read_thread_table(std::shared_ptr<thread_table_t> table, const std::string& filename, const int max_threads);
+void write_thread_table(std::shared_ptr<thread_table_t> table, const std::string& filename);
+// Lets the threads a kernel leaves idle sleep instead of spinning while the other threads work.
+// With the Intel runtime the block time is set to 0. Other runtimes must be started with
+// OMP_WAIT_POLICY=passive, KMP_BLOCKTIME=0 or GOMP_SPINCOUNT=0; false if none of them is set
+// and some kernel runs on fewer than max_threads threads.
+bool park_idle_threads(std::shared_ptr<thread_table_t> table, const int max_threads);
+void tune_thread_table(std::shared_ptr<thread_table_t> table,
+                       std::shared_ptr<fdm3d_t> waves,
+                       std::shared_ptr<model3d_t> model,
+                       const int max_threads,
+                       const real tolerance);
+
+#endif // THREAD_TABLE_H
@@ -0,0 +1,59 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 19, 2026
+ * Comment: Binary trace file written while the run goes on. The receivers hand over blocks of
+ * up to kStagedSteps steps (see receiver3d.h), and a writer thread appends a block to the file
+ * while the next one is filled, so the traces take O(n * steps per block) memory instead of
+ * O(n * nt), on the root rank only, and the file is complete when the run ends.
+ *
+ * Layout, little-endian as written by the machine:
+ *   char[8]   "OPTEWETR"
+ *   int32     version (1), receivers n, steps nt, fields nfields
+ *   int32[5]  1 for the fields recorded, in the order P, Vx, Vy, Vz, dilatation rate
+ *   float32   dt
+ *   float32   x, y and depth of each receiver, n * 3 values
+ *   float32   the samples, time-major: for each step, for each recorded field, n values
+ */
+
+#ifndef TRACE_WRITER_H
+#define TRACE_WRITER_H
+
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "common.h"
+
+// Fields of the recorded flags in the header
+const int kTraceFields = 5;
+
+struct trace_writer_s {
+  FILE* file;    // Trace file on the root rank, NULL on the others and if it cannot be opened
+  real* block[2];    // Blocks of steps of all receivers on the root rank, NULL on the others; one is
+                     // written while the other fills
+  size_t block_size;    // Values per block
+  int current;    // Block being filled
+  std::thread* thread;    // Writer of the other block, NULL if idle
+};
+
+typedef struct trace_writer_s trace_writer_t;
+
+// Opens filename on the root rank and writes the header. recorded holds the kTraceFields flags,
+// and positions x, y and depth of the n receivers. If the file cannot be opened the blocks are
+// dropped, so the ranks still take part in gathering them.
+trace_writer_t* trace_writer_setup(const std::string& filename, const bool root, const int n, const int nt,
+                                   const bool* recorded, const real dt, const real* positions,
+                                   const size_t block_size);
+
+// Block to fill with the next steps
+real* trace_block(trace_writer_t* writer);
+
+// Appends the first count values of the filled block to the file in the background, and moves
+// on to the other block once its previous write is done
+void write_trace_block(trace_writer_t* writer, const size_t count);
+
+// Waits for the last block and closes the file
+void close_trace_writer(trace_writer_t* writer);
+
+void free_trace_writer_arrays(trace_writer_t* writer);
+
+#endif // TRACE_WRITER_H
@@ -10,7 +10,9 @@
 #include <typeinfo>
 
 #include "fd3d.h"
+#include "decomp.h"
 
-void export_to_vtk(std::shared_ptr<fdm3d_t> waves, const std::string& filename);
+// Writes the part of the wave fields owned by this rank, one file per rank
+void export_to_vtk(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<decomp_t> decomp, const std::string& filename);
 
 #endif // VTK_H
\ No newline at end of file
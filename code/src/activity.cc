@@ -0,0 +1,214 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 19, 2026
+ * Comment: Activity mask of the wave fields, grown with the fastest wave from the source.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "activity.h"
+#include "differentiators.h"
+
+// First and last + 1 global point of tile t along axis d
+static int tile_begin(const activity_t* activity, const int t) {
+  return t * activity->tile;
+}
+
+static int tile_end(const activity_t* activity, const int d, const int t) {
+  return std::min((t + 1) * activity->tile, activity->n[d]);
+}
+
+// Boxes of whole z-slabs of tiles around the active tiles. A box spans the active tiles of all
+// its slabs in x and y, and takes slabs until it is min_planes thick or an empty slab follows.
+static void build_boxes(activity_t* activity) {
+  const int* nt = activity->ntiles;
+
+  activity->nboxes = 0;
+  bool open = false;
+  region_t box = make_region(0, 0, 0, 0, 0, 0);
+
+  for (int tk = 0; tk < nt[2]; tk++) {
+    int lo[2] = {nt[0], nt[1]};
+    int hi[2] = {-1, -1};
+
+    for (int tj = 0; tj < nt[1]; tj++) {
+      for (int ti = 0; ti < nt[0]; ti++) {
+        if (activity->active[ti + nt[0] * (tj + nt[1] * tk)]) {
+          lo[0] = std::min(lo[0], ti);
+          hi[0] = std::max(hi[0], ti);
+          lo[1] = std::min(lo[1], tj);
+          hi[1] = std::max(hi[1], tj);
+        }
+      }
+    }
+
+    if (hi[0] < 0) {
+      if (open) {
+        activity->boxes[activity->nboxes++] = box;
+        open = false;
+      }
+      continue;
+    }
+
+    const region_t slab = make_region(tile_begin(activity, lo[0]), tile_end(activity, 0, hi[0]),
+                                      tile_begin(activity, lo[1]), tile_end(activity, 1, hi[1]),
+                                      tile_begin(activity, tk), tile_end(activity, 2, tk));
+    if (!open) {
+      box = slab;
+      open = true;
+    } else {
+      box.i0 = std::min(box.i0, slab.i0);
+      box.i1 = std::max(box.i1, slab.i1);
+      box.j0 = std::min(box.j0, slab.j0);
+      box.j1 = std::max(box.j1, slab.j1);
+      box.k1 = slab.k1;
+    }
+
+    if (box.k1 - box.k0 >= activity->min_planes) {
+      activity->boxes[activity->nboxes++] = box;
+      open = false;
+    }
+  }
+
+  if (open) {
+    activity->boxes[activity->nboxes++] = box;
+  }
+}
+
+// Activates the tiles within reach of the sources at time t
+static void grow_mask(activity_t* activity, const real t) {
+  const int* nt = activity->ntiles;
+  const double radius = activity->margin + activity->vp_max * t / activity->spacing;
+  bool grown = false;
+
+  for (int tk = 0; tk < nt[2]; tk++) {
+    for (int tj = 0; tj < nt[1]; tj++) {
+      for (int ti = 0; ti < nt[0]; ti++) {
+        char* active = &activity->active[ti + nt[0] * (tj + nt[1] * tk)];
+        if (*active) {
+          continue;
+        }
+
+        // Distance in points from the sources to the nearest point of the tile
+        const int tiles[3] = {ti, tj, tk};
+        double distance = 0.0;
+        for (int d = 0; d < 3; d++) {
+          const int gap = std::max(std::max(tile_begin(activity, tiles[d]) - activity->source[1][d],
+                                            activity->source[0][d] - (tile_end(activity, d, tiles[d]) - 1)), 0);
+          distance += (double) gap * gap;
+        }
+
+        if (std::sqrt(distance) <= radius) {
+          *active = 1;
+          activity->nactive++;
+          grown = true;
+        }
+      }
+    }
+  }
+
+  if (grown) {
+    activity->complete = activity->nactive == (long) nt[0] * nt[1] * nt[2];
+    build_boxes(activity);
+  }
+}
+
+void activity_setup(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<dims_t> dims, const int x, const int y,
+                    const int z, const real vp_max, const int tile, const int margin, const int min_planes) {
+
+  if (tile <= 0) {
+    return;
+  }
+
+  activity_t* activity = (activity_t*) malloc(sizeof(activity_t));
+
+  activity->tile = tile;
+  activity->n[0] = dims->nx_ghost;
+  activity->n[1] = dims->ny_ghost;
+  activity->n[2] = dims->nz_ghost;
+  for (int d = 0; d < 3; d++) {
+    activity->ntiles[d] = (activity->n[d] + tile - 1) / tile;
+  }
+  const int source[3] = {x, y, z};
+  for (int d = 0; d < 3; d++) {
+    activity->source[0][d] = source[d];
+    activity->source[1][d] = source[d];
+  }
+  activity->vp_max = vp_max;
+  activity->margin = margin;
+  activity->min_planes = std::max(min_planes, 1);
+
+  // The smallest spacing turns the distance a wave travels into the most points it can cover
+  real spacing = (half_length_y > 0) ? std::min(dims->dx, dims->dy) : dims->dx;
+  for (int k = 0; k < activity->n[2]; k++) {
+    spacing = std::min(spacing, plane_spacing(dims, k));
+  }
+  activity->spacing = spacing;
+
+  const long ntiles = (long) activity->ntiles[0] * activity->ntiles[1] * activity->ntiles[2];
+  activity->active = (char*) calloc(ntiles, sizeof(char));
+  activity->nactive = 0;
+  activity->boxes = (region_t*) malloc(sizeof(region_t) * activity->ntiles[2]);
+  activity->nboxes = 0;
+  activity->complete = false;
+  activity->active_points = 0.0;
+  activity->total_points = 0.0;
+
+  waves->activity = activity;
+}
+
+void add_activity_source(std::shared_ptr<fdm3d_t> waves, const int x, const int y, const int z) {
+  activity_t* activity = waves->activity;
+
+  if (activity == NULL) {
+    return;
+  }
+
+  const int source[3] = {x, y, z};
+  for (int d = 0; d < 3; d++) {
+    activity->source[0][d] = std::min(activity->source[0][d], source[d]);
+    activity->source[1][d] = std::max(activity->source[1][d], source[d]);
+  }
+}
+
+void advance_activity(std::shared_ptr<fdm3d_t> waves, const real t) {
+  activity_t* activity = waves->activity;
+
+  if (activity == NULL) {
+    return;
+  }
+
+  if (!activity->complete) {
+    grow_mask(activity, t);
+  }
+
+  const region_t computed = computed_region(waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
+  const double total = region_points(computed);
+  double active = total;
+
+  if (!activity->complete) {
+    active = 0.0;
+    for (int b = 0; b < activity->nboxes; b++) {
+      active += region_points(intersect_regions(local_box(waves, b), computed));
+    }
+  }
+
+  activity->active_points += active;
+  activity->total_points += total;
+}
+
+region_t local_box(std::shared_ptr<fdm3d_t> waves, const int b) {
+  const region_t& box = waves->activity->boxes[b];
+  return make_region(box.i0 - waves->x0, box.i1 - waves->x0, box.j0 - waves->y0, box.j1 - waves->y0,
+                     box.k0 - waves->z0, box.k1 - waves->z0);
+}
+
+double activity_work_ratio(const activity_t* activity) {
+  return (activity->total_points > 0.0) ? activity->active_points / activity->total_points : 1.0;
+}
+
+void free_activity_arrays(activity_t* activity) {
+  free(activity->active);
+  free(activity->boxes);
+  free(activity);
+}
@@ -0,0 +1,235 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Load balancing of the domain decomposition.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "balance.h"
+#include "differentiators.h"
+#include "pml3d.h"
+
+static std::shared_ptr<cost_profile_t> cost_profile_setup(const int* n) {
+
+  std::shared_ptr<cost_profile_t> profile((cost_profile_t*) malloc(sizeof(cost_profile_t)), free_ptr());
+
+  for (int d = 0; d < 3; d++) {
+    profile->n[d] = n[d];
+    profile->weights[d] = (double*) calloc(n[d], sizeof(double));
+  }
+
+  return profile;
+}
+
+std::shared_ptr<cost_profile_t> estimate_cost_profile(std::shared_ptr<dims_t> dims, const double border_cost) {
+
+  const int n[3] = {dims->nx_ghost, dims->ny_ghost, dims->nz_ghost};
+  const int gb = dims->ghost_border;
+
+  std::shared_ptr<cost_profile_t> profile = cost_profile_setup(n);
+
+  // Border at the low and the high side of each axis, a free surface has none at the top and
+  // the x-z plane none along y
+  const int gb_y = (half_length_y > 0) ? gb : 0;
+  const int lo_gb[3] = {gb, gb_y, dims->free_surface ? 0 : gb};
+  const int hi_gb[3] = {gb, gb_y, gb};
+
+  // Computed points along each axis, and those of them outside the border
+  int computed[3], inner[3];
+  for (int d = 0; d < 3; d++) {
+    computed[d] = n[d] - 2 * stencil_border(d);
+    inner[d] = std::max(0, std::min(n[d] - stencil_border(d), n[d] - hi_gb[d]) - std::max(stencil_border(d), lo_gb[d]));
+  }
+
+  for (int d = 0; d < 3; d++) {
+    const double plane = (double) computed[(d + 1) % 3] * computed[(d + 2) % 3];
+    const double inner_plane = (double) inner[(d + 1) % 3] * inner[(d + 2) % 3];
+
+    for (int i = stencil_border(d); i < n[d] - stencil_border(d); i++) {
+      if (i < lo_gb[d] || i >= n[d] - hi_gb[d]) {
+        profile->weights[d][i] = border_cost * plane;
+      } else {
+        profile->weights[d][i] = inner_plane + border_cost * (plane - inner_plane);
+      }
+    }
+  }
+
+  return profile;
+}
+
+std::shared_ptr<cost_profile_t> measured_cost_profile(std::shared_ptr<decomp_t> decomp, const double* seconds) {
+
+  std::shared_ptr<cost_profile_t> profile = cost_profile_setup(decomp->global_n);
+
+  // Every rank owns the box between its cuts on each axis; coordinates are recovered from the
+  // rank order of the Cartesian communicator (z slowest)
+  for (int r = 0; r < decomp->nranks; r++) {
+    const int c[3] = {r % decomp->procs[0], (r / decomp->procs[0]) % decomp->procs[1],
+                      r / (decomp->procs[0] * decomp->procs[1])};
+
+    double width[3];
+    for (int d = 0; d < 3; d++) {
+      width[d] = decomp->cuts[d][c[d] + 1] - decomp->cuts[d][c[d]];
+    }
+
+    const double density = seconds[r] / (width[0] * width[1] * width[2]);
+
+    for (int d = 0; d < 3; d++) {
+      const double plane = density * width[(d + 1) % 3] * width[(d + 2) % 3];
+      for (int i = decomp->cuts[d][c[d]]; i < decomp->cuts[d][c[d] + 1]; i++) {
+        profile->weights[d][i] += plane;
+      }
+    }
+  }
+
+  return profile;
+}
+
+void weighted_cuts(std::shared_ptr<cost_profile_t> profile, const int* procs, int* cuts[3]) {
+
+  for (int d = 0; d < 3; d++) {
+    const int begin = stencil_border(d);
+    const int end = profile->n[d] - stencil_border(d);
+    const int parts = procs[d];
+    const double* w = profile->weights[d];
+
+    double total = 0.0;
+    for (int i = begin; i < end; i++) {
+      total += w[i];
+    }
+
+    cuts[d][0] = begin;
+    cuts[d][parts] = end;
+
+    // Each cut goes where the running cost is closest to its share, keeping every part non-empty
+    int i = begin;
+    double prefix = 0.0;
+    for (int p = 1; p < parts; p++) {
+      const double target = total * p / parts;
+      while (i < end && prefix + w[i] <= target) {
+        prefix += w[i++];
+      }
+      int cut = (i < end && target - prefix > prefix + w[i] - target) ? i + 1 : i;
+      cut = std::max(cut, cuts[d][p - 1] + 1);
+      cut = std::min(cut, end - (parts - p));
+      cuts[d][p] = cut;
+    }
+  }
+}
+
+void apply_cost_profile(std::shared_ptr<decomp_t> decomp, std::shared_ptr<cost_profile_t> profile) {
+  int* cuts[3];
+
+  for (int d = 0; d < 3; d++) {
+    cuts[d] = (int*) malloc(sizeof(int) * (decomp->procs[d] + 1));
+  }
+
+  weighted_cuts(profile, decomp->procs, cuts);
+  set_cuts(decomp, cuts);
+
+  for (int d = 0; d < 3; d++) {
+    free(cuts[d]);
+  }
+}
+
+double load_imbalance(std::shared_ptr<decomp_t> decomp, const double* seconds) {
+  double slowest = 0.0;
+  double mean = 0.0;
+
+  for (int r = 0; r < decomp->nranks; r++) {
+    slowest = std::max(slowest, seconds[r]);
+    mean += seconds[r] / decomp->nranks;
+  }
+
+  return (mean > 0.0) ? slowest / mean : 1.0;
+}
+
+bool rebalance(std::shared_ptr<decomp_t> decomp, std::shared_ptr<dims_t> global_dims,
+               std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+               const double seconds, const double tolerance) {
+
+  if (decomp->nranks == 1) {
+    return false;
+  }
+
+  std::vector<double> times(decomp->nranks);
+  gather_from_ranks(decomp, seconds, times.data());
+
+  if (load_imbalance(decomp, times.data()) <= 1.0 + tolerance) {
+    return false;
+  }
+
+  std::shared_ptr<cost_profile_t> profile = measured_cost_profile(decomp, times.data());
+
+  int* cuts[3];
+  int* old_cuts[3];
+  bool changed = false;
+
+  for (int d = 0; d < 3; d++) {
+    cuts[d] = (int*) malloc(sizeof(int) * (decomp->procs[d] + 1));
+    old_cuts[d] = (int*) malloc(sizeof(int) * (decomp->procs[d] + 1));
+    memcpy(old_cuts[d], decomp->cuts[d], sizeof(int) * (decomp->procs[d] + 1));
+  }
+
+  weighted_cuts(profile, decomp->procs, cuts);
+
+  for (int d = 0; d < 3; d++) {
+    changed = changed || memcmp(cuts[d], old_cuts[d], sizeof(int) * (decomp->procs[d] + 1)) != 0;
+  }
+
+  if (changed) {
+    const int old_offset[3] = {decomp->offset[0], decomp->offset[1], decomp->offset[2]};
+    const int old_n[3] = {decomp->local_n[0], decomp->local_n[1], decomp->local_n[2]};
+
+    set_cuts(decomp, cuts);
+
+    std::shared_ptr<dims_t> dims = local_dims(decomp, global_dims);
+    std::shared_ptr<fdm3d_t> new_waves = fdm3d_setup(dims);
+    std::shared_ptr<model3d_t> new_model = model_setup(dims);
+
+    const std::vector<real*> fields = {new_waves->vx, new_waves->vy, new_waves->vz,
+                                       new_waves->sxx, new_waves->syy, new_waves->szz,
+                                       new_waves->sxy, new_waves->syz, new_waves->sxz};
+    const std::vector<real*> parameters = {new_model->rho, new_model->lambda, new_model->mu};
+
+    move_owned_points(decomp, old_cuts, old_offset, old_n,
+                      {waves->vx, waves->vy, waves->vz, waves->sxx, waves->syy, waves->szz,
+                       waves->sxy, waves->syz, waves->sxz}, fields);
+    move_owned_points(decomp, old_cuts, old_offset, old_n, {model->rho, model->lambda, model->mu}, parameters);
+
+    if (waves->pml != NULL) {
+      pml_setup(new_waves, decomp, waves->pml->vp_max, waves->pml->a_max, waves->pml->k_max);
+      move_pml_points(decomp, old_cuts, old_offset, waves->pml, new_waves->pml);
+    }
+
+    // The activity mask lies on the global grid and stays as it is
+    new_waves->activity = waves->activity;
+    waves->activity = NULL;
+
+    exchange_halos(decomp, fields);
+    exchange_halos(decomp, parameters);
+    classify_fluid_planes(new_model, dims);
+
+    // The structures keep their identity, only their arrays and sizes change
+    free_wave_arrays(waves);
+    free_model_arrays(model);
+    *waves = *new_waves;
+    *model = *new_model;
+  }
+
+  for (int d = 0; d < 3; d++) {
+    free(cuts[d]);
+    free(old_cuts[d]);
+  }
+  free_cost_profile_arrays(profile);
+
+  return changed;
+}
+
+void free_cost_profile_arrays(std::shared_ptr<cost_profile_t> profile) {
+  for (int d = 0; d < 3; d++) {
+    free(profile->weights[d]);
+  }
+}
@@ -0,0 +1,581 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Cartesian domain decomposition of the grid over MPI ranks.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "decomp.h"
+#include "differentiators.h"
+#include "env.h"
+
+#ifdef HAVE_MPI
+static const MPI_Datatype kMpiReal = (sizeof(real) == sizeof(float)) ? MPI_FLOAT : MPI_DOUBLE;
+#endif
+
+// Splits the computed range [halo, n - halo) of one axis into nparts contiguous parts
+static void split_axis(const int n, const int halo, const int nparts, const int part, int* begin, int* end) {
+  const int len = n - 2 * halo;
+  *begin = halo + (int) (((long) len * part) / nparts);
+  *end = halo + (int) (((long) len * (part + 1)) / nparts);
+}
+
+// Splits the grid for the current halo depth and allocates the halo buffers
+static void partition(std::shared_ptr<decomp_t> decomp) {
+
+  // Every step consumes half_length points of the halo for the velocities and half_length for
+  // the stresses, so exchanging every depth steps needs 2 * depth * half_length points
+  decomp->halo = (decomp->depth > 0) ? 2 * decomp->depth * half_length : half_length;
+
+  for (int d = 0; d < 3; d++) {
+    const int begin = decomp->cuts[d][decomp->coords[d]];
+    const int end = decomp->cuts[d][decomp->coords[d] + 1];
+
+    if (decomp->procs[d] > 1 && end - begin < decomp->halo) {
+      std::cerr << "#Grid is too small for " << decomp->procs[d] << " ranks along axis " << d << std::endl;
+    }
+
+    // Sides at the edge of the grid keep the stencil border that is never computed
+    const int lo_width = (decomp->neighbours[2 * d] >= 0) ? decomp->halo : stencil_border(d);
+    const int hi_width = (decomp->neighbours[2 * d + 1] >= 0) ? decomp->halo : stencil_border(d);
+
+    decomp->offset[d] = begin - lo_width;
+    decomp->local_n[d] = end - begin + lo_width + hi_width;
+
+    // Ranks at the edge of the grid also own that border
+    decomp->own_begin[d] = (decomp->neighbours[2 * d] >= 0) ? decomp->halo : 0;
+    decomp->own_end[d] = (decomp->neighbours[2 * d + 1] >= 0) ? decomp->local_n[d] - decomp->halo
+                                                               : decomp->local_n[d];
+  }
+
+  // Buffers are only needed at the faces with a neighbour
+  for (int f = 0; f < 6; f++) {
+    const int d = f / 2;
+    const size_t face = (size_t) decomp->local_n[(d + 1) % 3] * decomp->local_n[(d + 2) % 3];
+
+    decomp->buffer_size[f] = (decomp->neighbours[f] >= 0) ? face * decomp->halo * kMaxHaloFields : 0;
+    decomp->send[f] = (real*) malloc(sizeof(real) * decomp->buffer_size[f]);
+    decomp->recv[f] = (real*) malloc(sizeof(real) * decomp->buffer_size[f]);
+  }
+  decomp->npending = 0;
+#ifdef HAVE_MPI
+  decomp->nrequests = 0;
+#endif
+}
+
+std::shared_ptr<decomp_t> decomp_setup(std::shared_ptr<dims_t> dims, const int nthreads, const bool distributed) {
+
+  std::shared_ptr<decomp_t> decomp((decomp_t*) malloc(sizeof(decomp_t)), free_ptr());
+
+  decomp->global_n[0] = dims->nx_ghost;
+  decomp->global_n[1] = dims->ny_ghost;
+  decomp->global_n[2] = dims->nz_ghost;
+
+  for (int d = 0; d < 3; d++) {
+    decomp->procs[d] = 1;
+    decomp->coords[d] = 0;
+    decomp->neighbours[2 * d] = -1;
+    decomp->neighbours[2 * d + 1] = -1;
+  }
+
+  decomp->rank = 0;
+  decomp->nranks = 1;
+  decomp->nthreads = nthreads;
+
+#ifdef HAVE_MPI
+  if (!distributed) {
+    // A part of its own on every rank, the neighbours stay empty
+    MPI_Comm_dup(MPI_COMM_SELF, &decomp->comm);
+  } else {
+    MPI_Comm_rank(MPI_COMM_WORLD, &decomp->rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &decomp->nranks);
+
+    // The process grid can be given as "px py pz", zeros are filled in by MPI. By default
+    // most cuts go along z, where the halo planes are contiguous in memory.
+    int procs[3] = {0, 0, 0};
+    std::stringstream process_grid(env_string("OPTEWE_PROCESS_GRID", "0 0 0"));
+    process_grid >> procs[2] >> procs[1] >> procs[0];
+#ifdef ELASTIC_2D
+    procs[1] = 1;    // A single y-plane
+#endif
+    MPI_Dims_create(decomp->nranks, 3, procs);
+
+    int dims_zyx[3] = {procs[0], procs[1], procs[2]};
+    int periods[3] = {0, 0, 0};
+    MPI_Comm comm_zyx;
+    MPI_Cart_create(MPI_COMM_WORLD, 3, dims_zyx, periods, 1, &comm_zyx);
+    decomp->comm = comm_zyx;
+    MPI_Comm_rank(decomp->comm, &decomp->rank);
+
+    int coords_zyx[3];
+    MPI_Cart_coords(decomp->comm, decomp->rank, 3, coords_zyx);
+
+    for (int d = 0; d < 3; d++) {
+      // Dimension 0 of the communicator is z, the slowest axis
+      decomp->procs[d] = dims_zyx[2 - d];
+      decomp->coords[d] = coords_zyx[2 - d];
+
+      int lo, hi;
+      MPI_Cart_shift(decomp->comm, 2 - d, 1, &lo, &hi);
+      decomp->neighbours[2 * d] = (lo == MPI_PROC_NULL) ? -1 : lo;
+      decomp->neighbours[2 * d + 1] = (hi == MPI_PROC_NULL) ? -1 : hi;
+    }
+  }
+#endif
+
+  // Equal parts until weighted cuts are set
+  for (int d = 0; d < 3; d++) {
+    decomp->cuts[d] = (int*) malloc(sizeof(int) * (decomp->procs[d] + 1));
+    for (int p = 0; p < decomp->procs[d]; p++) {
+      split_axis(decomp->global_n[d], stencil_border(d), decomp->procs[d], p, &decomp->cuts[d][p], &decomp->cuts[d][p + 1]);
+    }
+  }
+
+  decomp->depth = 0;
+  partition(decomp);
+
+  return decomp;
+}
+
+static void free_buffers(std::shared_ptr<decomp_t> decomp) {
+  for (int f = 0; f < 6; f++) {
+    free(decomp->send[f]);
+    free(decomp->recv[f]);
+  }
+}
+
+void set_halo_depth(std::shared_ptr<decomp_t> decomp, const int depth) {
+  free_buffers(decomp);
+  decomp->depth = std::max(depth, 0);
+  partition(decomp);
+}
+
+int max_halo_depth(std::shared_ptr<decomp_t> decomp) {
+  int depth = INT_MAX;
+
+  for (int d = 0; d < 3; d++) {
+    for (int p = 0; p < decomp->procs[d] && decomp->procs[d] > 1; p++) {
+      depth = std::min(depth, (decomp->cuts[d][p + 1] - decomp->cuts[d][p]) / (2 * half_length));
+    }
+  }
+
+  return depth;
+}
+
+void set_cuts(std::shared_ptr<decomp_t> decomp, int* const cuts[3]) {
+  free_buffers(decomp);
+  for (int d = 0; d < 3; d++) {
+    memcpy(decomp->cuts[d], cuts[d], sizeof(int) * (decomp->procs[d] + 1));
+  }
+  partition(decomp);
+}
+
+// Dimensions of the part of the grid stored by this rank
+std::shared_ptr<dims_t> local_dims(std::shared_ptr<decomp_t> decomp, std::shared_ptr<dims_t> dims) {
+
+  std::shared_ptr<dims_t> local = size_setup(decomp->local_n[0] - (dims->nx_ghost - dims->nx),
+                                             decomp->local_n[1] - (dims->ny_ghost - dims->ny),
+                                             decomp->local_n[2] - (dims->nz_ghost - dims->nz),
+                                             dims->nt, dims->ghost_border,
+                                             dims->dz, dims->dx, dims->dy, dims->dt, dims->free_surface);
+
+  local->dz_growth = dims->dz_growth;
+  local->x0 = decomp->offset[0];
+  local->y0 = decomp->offset[1];
+  local->z0 = decomp->offset[2];
+
+  return local;
+}
+
+bool owns_point(std::shared_ptr<decomp_t> decomp, const int x, const int y, const int z) {
+  const int p[3] = {x - decomp->offset[0], y - decomp->offset[1], z - decomp->offset[2]};
+
+  for (int d = 0; d < 3; d++) {
+    if (p[d] < decomp->own_begin[d] || p[d] >= decomp->own_end[d]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#ifdef HAVE_MPI
+// Copies the slab [begin, begin + width) along axis d of a field to or from a buffer
+static size_t copy_slab(real* field, const int* n, const int d, const int begin, const int width,
+                        real* buffer, const bool to_buffer, const int nthreads) {
+
+  int lo[3] = {0, 0, 0};
+  int hi[3] = {n[0], n[1], n[2]};
+  lo[d] = begin;
+  hi[d] = begin + width;
+
+  const int row = hi[0] - lo[0];
+  const int rows_j = hi[1] - lo[1];
+
+  #pragma omp parallel for num_threads(nthreads)
+  for (int k = lo[2]; k < hi[2]; k++) {
+    for (int j = lo[1]; j < hi[1]; j++) {
+      real* f = &field[idx(n[0], n[1], lo[0], j, k)];
+      real* b = &buffer[((size_t) (k - lo[2]) * rows_j + (j - lo[1])) * row];
+      for (int i = 0; i < row; i++) {
+        if (to_buffer) {
+          b[i] = f[i];
+        } else {
+          f[i] = b[i];
+        }
+      }
+    }
+  }
+
+  return (size_t) row * rows_j * (hi[2] - lo[2]);
+}
+#endif
+
+void exchange_halos(std::shared_ptr<decomp_t> decomp, const std::vector<real*>& fields) {
+
+#ifdef HAVE_MPI
+  const int h = decomp->halo;
+  const int* n = decomp->local_n;
+
+  // One axis at a time, so the edges of the halo are filled as well
+  for (int d = 0; d < 3; d++) {
+    const int lo = decomp->neighbours[2 * d];
+    const int hi = decomp->neighbours[2 * d + 1];
+
+    if (lo < 0 && hi < 0) {
+      continue;
+    }
+
+    // Both neighbours send the same number of values
+    const size_t count = (size_t) h * n[(d + 1) % 3] * n[(d + 2) % 3] * fields.size();
+    size_t offset = 0;
+
+    for (real* field : fields) {
+      if (lo >= 0) {
+        offset += copy_slab(field, n, d, h, h, decomp->send[2 * d] + offset, true, decomp->nthreads);
+      }
+    }
+    offset = 0;
+    for (real* field : fields) {
+      if (hi >= 0) {
+        offset += copy_slab(field, n, d, n[d] - 2 * h, h, decomp->send[2 * d + 1] + offset, true, decomp->nthreads);
+      }
+    }
+
+    MPI_Sendrecv(decomp->send[2 * d + 1], (int) count, kMpiReal, hi < 0 ? MPI_PROC_NULL : hi, 2 * d,
+                 decomp->recv[2 * d], (int) count, kMpiReal, lo < 0 ? MPI_PROC_NULL : lo, 2 * d,
+                 decomp->comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(decomp->send[2 * d], (int) count, kMpiReal, lo < 0 ? MPI_PROC_NULL : lo, 2 * d + 1,
+                 decomp->recv[2 * d + 1], (int) count, kMpiReal, hi < 0 ? MPI_PROC_NULL : hi, 2 * d + 1,
+                 decomp->comm, MPI_STATUS_IGNORE);
+
+    offset = 0;
+    for (real* field : fields) {
+      if (lo >= 0) {
+        offset += copy_slab(field, n, d, 0, h, decomp->recv[2 * d] + offset, false, decomp->nthreads);
+      }
+    }
+    offset = 0;
+    for (real* field : fields) {
+      if (hi >= 0) {
+        offset += copy_slab(field, n, d, n[d] - h, h, decomp->recv[2 * d + 1] + offset, false, decomp->nthreads);
+      }
+    }
+  }
+#endif
+}
+
+void begin_halo_exchange(std::shared_ptr<decomp_t> decomp, const std::vector<real*>& fields) {
+
+  decomp->npending = 0;
+  for (real* field : fields) {
+    decomp->pending[decomp->npending++] = field;
+  }
+
+#ifdef HAVE_MPI
+  const int h = decomp->halo;
+  const int* n = decomp->local_n;
+
+  decomp->nrequests = 0;
+
+  for (int f = 0; f < 6; f++) {
+    const int neighbour = decomp->neighbours[f];
+    if (neighbour < 0) {
+      continue;
+    }
+
+    const int d = f / 2;
+    const bool upper = f % 2;
+    size_t offset = 0;
+
+    for (real* field : fields) {
+      offset += copy_slab(field, n, d, upper ? n[d] - 2 * h : h, h, decomp->send[f] + offset, true,
+                          decomp->nthreads);
+    }
+
+    // Messages are tagged with the face they fill on the receiving rank
+    MPI_Irecv(decomp->recv[f], (int) offset, kMpiReal, neighbour, f, decomp->comm,
+              &decomp->requests[decomp->nrequests++]);
+    MPI_Isend(decomp->send[f], (int) offset, kMpiReal, neighbour, f ^ 1, decomp->comm,
+              &decomp->requests[decomp->nrequests++]);
+  }
+#endif
+}
+
+void finish_halo_exchange(std::shared_ptr<decomp_t> decomp) {
+
+#ifdef HAVE_MPI
+  const int h = decomp->halo;
+  const int* n = decomp->local_n;
+
+  if (decomp->nrequests > 0) {
+    MPI_Waitall(decomp->nrequests, decomp->requests, MPI_STATUSES_IGNORE);
+    decomp->nrequests = 0;
+  }
+
+  for (int f = 0; f < 6; f++) {
+    if (decomp->neighbours[f] < 0) {
+      continue;
+    }
+
+    const int d = f / 2;
+    const bool upper = f % 2;
+    size_t offset = 0;
+
+    for (int p = 0; p < decomp->npending; p++) {
+      offset += copy_slab(decomp->pending[p], n, d, upper ? n[d] - h : 0, h, decomp->recv[f] + offset, false,
+                          decomp->nthreads);
+    }
+  }
+#endif
+
+  decomp->npending = 0;
+}
+
+// Global box [lo, hi) owned by a rank for the given cuts
+static void owned_box(std::shared_ptr<decomp_t> decomp, int* const cuts[3], const int rank, int* lo, int* hi) {
+  int coords[3] = {0, 0, 0};
+#ifdef HAVE_MPI
+  int coords_zyx[3];
+  MPI_Cart_coords(decomp->comm, rank, 3, coords_zyx);
+  for (int d = 0; d < 3; d++) {
+    coords[d] = coords_zyx[2 - d];
+  }
+#endif
+
+  for (int d = 0; d < 3; d++) {
+    const int c = coords[d];
+    lo[d] = (c == 0) ? 0 : cuts[d][c];
+    hi[d] = (c == decomp->procs[d] - 1) ? decomp->global_n[d] : cuts[d][c + 1];
+  }
+}
+
+// Number of points in the intersection of two boxes, which is returned in (lo, hi)
+static size_t intersect(const int* a_lo, const int* a_hi, const int* b_lo, const int* b_hi, int* lo, int* hi) {
+  size_t points = 1;
+  for (int d = 0; d < 3; d++) {
+    lo[d] = std::max(a_lo[d], b_lo[d]);
+    hi[d] = std::min(a_hi[d], b_hi[d]);
+    points *= (hi[d] > lo[d]) ? (size_t) (hi[d] - lo[d]) : 0;
+  }
+  return points;
+}
+
+void move_owned_points(std::shared_ptr<decomp_t> decomp, int* const old_cuts[3], const int* old_offset,
+                       const int* old_n, const std::vector<real*>& from, const std::vector<real*>& to) {
+
+  const int nranks = decomp->nranks;
+  const int* n = decomp->local_n;
+
+  int old_lo[3], old_hi[3], new_lo[3], new_hi[3];
+  owned_box(decomp, old_cuts, decomp->rank, old_lo, old_hi);
+  owned_box(decomp, decomp->cuts, decomp->rank, new_lo, new_hi);
+
+  // Boxes going to and coming from every rank, in rank order
+  std::vector<int> send_box(6 * nranks), recv_box(6 * nranks);
+  std::vector<int> send_counts(nranks), recv_counts(nranks), send_displs(nranks), recv_displs(nranks);
+  size_t send_total = 0;
+  size_t recv_total = 0;
+
+  for (int r = 0; r < nranks; r++) {
+    int r_lo[3], r_hi[3];
+
+    owned_box(decomp, decomp->cuts, r, r_lo, r_hi);
+    send_counts[r] = (int) intersect(old_lo, old_hi, r_lo, r_hi, &send_box[6 * r], &send_box[6 * r + 3]);
+    send_displs[r] = (int) send_total;
+    send_total += send_counts[r];
+
+    owned_box(decomp, old_cuts, r, r_lo, r_hi);
+    recv_counts[r] = (int) intersect(r_lo, r_hi, new_lo, new_hi, &recv_box[6 * r], &recv_box[6 * r + 3]);
+    recv_displs[r] = (int) recv_total;
+    recv_total += recv_counts[r];
+  }
+
+  std::vector<real> send_buffer(send_total), recv_buffer(recv_total);
+
+  // One field at a time keeps the buffers small
+  for (size_t f = 0; f < from.size(); f++) {
+    size_t m = 0;
+    for (int r = 0; r < nranks; r++) {
+      const int* lo = &send_box[6 * r];
+      const int* hi = &send_box[6 * r + 3];
+      for (int k = lo[2]; k < hi[2] && send_counts[r] > 0; k++) {
+        for (int j = lo[1]; j < hi[1]; j++) {
+          for (int i = lo[0]; i < hi[0]; i++) {
+            send_buffer[m++] = from[f][idx(old_n[0], old_n[1], i - old_offset[0], j - old_offset[1], k - old_offset[2])];
+          }
+        }
+      }
+    }
+
+#ifdef HAVE_MPI
+    MPI_Alltoallv(send_buffer.data(), send_counts.data(), send_displs.data(), kMpiReal,
+                  recv_buffer.data(), recv_counts.data(), recv_displs.data(), kMpiReal, decomp->comm);
+#else
+    recv_buffer = send_buffer;
+#endif
+
+    m = 0;
+    for (int r = 0; r < nranks; r++) {
+      const int* lo = &recv_box[6 * r];
+      const int* hi = &recv_box[6 * r + 3];
+      for (int k = lo[2]; k < hi[2] && recv_counts[r] > 0; k++) {
+        for (int j = lo[1]; j < hi[1]; j++) {
+          for (int i = lo[0]; i < hi[0]; i++) {
+            to[f][idx(n[0], n[1], i - decomp->offset[0], j - decomp->offset[1], k - decomp->offset[2])] = recv_buffer[m++];
+          }
+        }
+      }
+    }
+  }
+}
+
+void measure_links(std::shared_ptr<decomp_t> decomp, double* latency, double* bandwidth) {
+
+  *latency = 0.0;
+  *bandwidth = 0.0;
+
+#ifdef HAVE_MPI
+  const int kRepetitions = 20;
+
+  int messages = 0;
+  size_t smallest_buffer = (size_t) 1 << 18;
+  for (int f = 0; f < 6; f++) {
+    if (decomp->neighbours[f] >= 0) {
+      messages++;
+      smallest_buffer = std::min(smallest_buffer, decomp->buffer_size[f]);
+    }
+  }
+
+  // Seconds per message of count values, sent to all neighbours the same way as the halos
+  auto time_messages = [&](const int count) {
+    MPI_Barrier(decomp->comm);
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (int r = 0; r < kRepetitions; r++) {
+      for (int d = 0; d < 3; d++) {
+        const int lo = decomp->neighbours[2 * d];
+        const int hi = decomp->neighbours[2 * d + 1];
+        MPI_Sendrecv(decomp->send[2 * d + 1], count, kMpiReal, hi < 0 ? MPI_PROC_NULL : hi, 2 * d,
+                     decomp->recv[2 * d], count, kMpiReal, lo < 0 ? MPI_PROC_NULL : lo, 2 * d,
+                     decomp->comm, MPI_STATUS_IGNORE);
+        MPI_Sendrecv(decomp->send[2 * d], count, kMpiReal, lo < 0 ? MPI_PROC_NULL : lo, 2 * d + 1,
+                     decomp->recv[2 * d + 1], count, kMpiReal, hi < 0 ? MPI_PROC_NULL : hi, 2 * d + 1,
+                     decomp->comm, MPI_STATUS_IGNORE);
+      }
+    }
+
+    auto stop = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    return max_over_ranks(decomp, messages > 0 ? seconds / (kRepetitions * messages) : 0.0);
+  };
+
+  const int large = (int) smallest_buffer;
+
+  *latency = time_messages(1);
+  double large_time = time_messages(large);
+
+  if (large_time > *latency) {
+    *bandwidth = sizeof(real) * large / (large_time - *latency);
+  }
+#endif
+}
+
+void reduce_to_root(std::shared_ptr<decomp_t> decomp, real* buffer, const size_t count) {
+#ifdef HAVE_MPI
+  if (decomp->rank == 0) {
+    MPI_Reduce(MPI_IN_PLACE, buffer, (int) count, kMpiReal, MPI_SUM, 0, decomp->comm);
+  } else {
+    MPI_Reduce(buffer, nullptr, (int) count, kMpiReal, MPI_SUM, 0, decomp->comm);
+  }
+#endif
+}
+
+double max_over_ranks(std::shared_ptr<decomp_t> decomp, const double value) {
+  double result = value;
+#ifdef HAVE_MPI
+  MPI_Allreduce(&value, &result, 1, MPI_DOUBLE, MPI_MAX, decomp->comm);
+#endif
+  return result;
+}
+
+void gather_to_root(std::shared_ptr<decomp_t> decomp, const int value, int* values) {
+#ifdef HAVE_MPI
+  MPI_Gather(&value, 1, MPI_INT, values, 1, MPI_INT, 0, decomp->comm);
+#else
+  values[0] = value;
+#endif
+}
+
+#ifdef HAVE_MPI
+// Gathers the values of the ranks after each other on rank 0, where counts holds their counts
+static void gather_values(std::shared_ptr<decomp_t> decomp, const void* values, const int count, void* gathered,
+                          const int* counts, MPI_Datatype type) {
+  std::vector<int> displacements(decomp->rank == 0 ? decomp->nranks : 0, 0);
+  for (size_t r = 1; r < displacements.size(); r++) {
+    displacements[r] = displacements[r - 1] + counts[r - 1];
+  }
+
+  MPI_Gatherv(values, count, type, gathered, counts, displacements.data(), type, 0, decomp->comm);
+}
+#endif
+
+void gather_to_root(std::shared_ptr<decomp_t> decomp, const int* values, const int count, int* gathered,
+                    const int* counts) {
+#ifdef HAVE_MPI
+  gather_values(decomp, values, count, gathered, counts, MPI_INT);
+#else
+  std::memcpy(gathered, values, sizeof(int) * count);
+#endif
+}
+
+void gather_to_root(std::shared_ptr<decomp_t> decomp, const real* values, const int count, real* gathered,
+                    const int* counts) {
+#ifdef HAVE_MPI
+  gather_values(decomp, values, count, gathered, counts, kMpiReal);
+#else
+  std::memcpy(gathered, values, sizeof(real) * count);
+#endif
+}
+
+void gather_from_ranks(std::shared_ptr<decomp_t> decomp, const double value, double* values) {
+#ifdef HAVE_MPI
+  MPI_Allgather(&value, 1, MPI_DOUBLE, values, 1, MPI_DOUBLE, decomp->comm);
+#else
+  values[0] = value;
+#endif
+}
+
+void free_decomp_arrays(std::shared_ptr<decomp_t> decomp) {
+  free_buffers(decomp);
+  for (int d = 0; d < 3; d++) {
+    free(decomp->cuts[d]);
+  }
+#ifdef HAVE_MPI
+  MPI_Comm_free(&decomp->comm);
+#endif
+}
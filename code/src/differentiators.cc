@@ -3,120 +3,391 @@
  * Date: December 16, 2016
 */
 
+#include <algorithm>
+#include <iostream>
+
 #include "differentiators.h"
+#include "smt_prefetch.h"
+
+// Rows of look-ahead for the SMT prefetch threads, 0 disables them
+static int smt_prefetch_distance = 0;
 
-void dx_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const int nz, const real scale, const int nthreads) {
+void set_smt_prefetch(const int distance) {
+  smt_prefetch_distance = distance;
+}
 
-  zero_data(to, nx, ny, nz);
+// Half length of the operator outside the full-order box
+static int shell_order = half_length;
 
-  #pragma omp parallel for num_threads(nthreads)
-  for (int k = half_length; k < nz - half_length; k++) {
-    for (int j = half_length; j < ny - half_length; j++) {
-      for (int i = half_length; i < nx - half_length; i++) {
+void set_shell_order(const int order) {
+  const bool valid = (order >= 2 && order <= kMaxShellOrder) || order == half_length;
+  if (!valid) {
+    std::cerr << "#Shell order " << order << " is not 2 to " << kMaxShellOrder << " or " << half_length
+              << ", using the full operator everywhere" << std::endl;
+  }
+  shell_order = valid ? order : half_length;
+}
+
+// Splits r into its part inside full, which is returned, and up to six slabs outside full
+static region_t split_region(const region_t& r, const region_t& full, region_t* shell, int* nshell) {
+  const region_t inner = make_region(std::max(r.i0, full.i0), std::min(r.i1, full.i1),
+                                     std::max(r.j0, full.j0), std::min(r.j1, full.j1),
+                                     std::max(r.k0, full.k0), std::min(r.k1, full.k1));
+  *nshell = 0;
 
-        for (int l = 0; l < half_length; l++) {
-          to[idx(nx, ny, i, j, k)] += W[l] * (from[idx(nx, ny, i+l+1, j, k)] - from[idx(nx, ny, i-l, j, k)]);
-        }
+  if (is_empty(inner)) {
+    shell[(*nshell)++] = r;
+    return inner;
+  }
 
-        to[idx(nx, ny, i, j, k)] *= scale;
-      }
+  // Slabs along z span r in x and y, slabs along y span the inner range in z, and slabs along x
+  // the inner range in y and z
+  const region_t slabs[6] = {
+    make_region(r.i0, r.i1, r.j0, r.j1, r.k0, inner.k0),
+    make_region(r.i0, r.i1, r.j0, r.j1, inner.k1, r.k1),
+    make_region(r.i0, r.i1, r.j0, inner.j0, inner.k0, inner.k1),
+    make_region(r.i0, r.i1, inner.j1, r.j1, inner.k0, inner.k1),
+    make_region(r.i0, inner.i0, inner.j0, inner.j1, inner.k0, inner.k1),
+    make_region(inner.i1, r.i1, inner.j0, inner.j1, inner.k0, inner.k1)
+  };
+
+  for (int s = 0; s < 6; s++) {
+    if (!is_empty(slabs[s])) {
+      shell[(*nshell)++] = slabs[s];
     }
   }
+
+  return inner;
 }
 
-void dx_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const int nz, const real scale, const int nthreads) {
+typedef void (*row_kernel)(real*, const real* __restrict__, const int, const int,
+                           const int, const int, const int, const int, const real);
+
+typedef void (*full_kernel)(real*, const real* __restrict__, const int, const int, const region_t&,
+                            const real, const int);
+
+typedef void (*plane_kernel)(real*, const real* __restrict__, const int, const int, const region_t&,
+                             const real*, const int);
+
+// Applies a row kernel to all rows of r
+static void sweep_rows(row_kernel row, real* to, const real* __restrict__ from, const int nx, const int ny,
+                       const region_t& r, const real scale, const int nthreads) {
+
+  #pragma omp parallel for num_threads(nthreads)
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      row(to, from, nx, ny, r.i0, r.i1, j, k, scale);
+    }
+  }
+}
 
-  zero_data(to, nx, ny, nz);
+// Same, with the scale of the z-plane of every row
+static void sweep_planes(row_kernel row, real* to, const real* __restrict__ from, const int nx, const int ny,
+                         const region_t& r, const real* scales, const int nthreads) {
 
   #pragma omp parallel for num_threads(nthreads)
-  for (int k = half_length; k < nz - half_length; k++) {
-    for (int j = half_length; j < ny - half_length; j++) {
-      for (int i = half_length; i < nx - half_length; i++) {
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      row(to, from, nx, ny, r.i0, r.i1, j, k, scales[k]);
+    }
+  }
+}
+
+// Prefetches the 2 * half_length + 1 z-planes of the stencil for row (j, k)
+static inline void prefetch_dz_row(real* to, const real* from, const int nx, const int ny, const int j, const int k) {
+  for (int l = -half_length; l <= half_length; l++) {
+    prefetch_row(&from[idx(nx, ny, 0, j, k + l)], nx);
+  }
+  prefetch_row_for_write(&to[idx(nx, ny, 0, j, k)], nx);
+}
+
+// Prefetches the y-row entering the stencil for row (j, k)
+static inline void prefetch_dy_row(real* to, const real* from, const int nx, const int ny, const int j, const int k) {
+  prefetch_row(&from[idx(nx, ny, 0, j + half_length, k)], nx);
+  prefetch_row_for_write(&to[idx(nx, ny, 0, j, k)], nx);
+}
 
-        for (int l = 0; l < half_length; l++) {
-          to[idx(nx, ny, i, j, k)] += W[l] * (from[idx(nx, ny, i+l, j, k)] - from[idx(nx, ny, i-l-1, j, k)]);
-        }
+template <int L>
+static inline void dx_forward_row(real* to, const real* __restrict__ from, const int nx, const int ny,
+                                  const int i0, const int i1, const int j, const int k, const real scale) {
+  for (int i = i0; i < i1; i++) {
+    real sum = 0.0f;
 
-        to[idx(nx, ny, i, j, k)] *= scale;
-      }
+    for (int l = 0; l < L; l++) {
+      sum += operator_weights<L>()[l] * (from[idx(nx, ny, i+l+1, j, k)] - from[idx(nx, ny, i-l, j, k)]);
     }
+
+    to[idx(nx, ny, i, j, k)] = sum * scale;
   }
 }
 
-void dy_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const int nz, const real scale, const int nthreads) {
+template <int L>
+static inline void dx_backward_row(real* to, const real* __restrict__ from, const int nx, const int ny,
+                                   const int i0, const int i1, const int j, const int k, const real scale) {
+  for (int i = i0; i < i1; i++) {
+    real sum = 0.0f;
+
+    for (int l = 0; l < L; l++) {
+      sum += operator_weights<L>()[l] * (from[idx(nx, ny, i+l, j, k)] - from[idx(nx, ny, i-l-1, j, k)]);
+    }
+
+    to[idx(nx, ny, i, j, k)] = sum * scale;
+  }
+}
+
+template <int L>
+static inline void dy_forward_row(real* to, const real* __restrict__ from, const int nx, const int ny,
+                                  const int i0, const int i1, const int j, const int k, const real scale) {
+  for (int i = i0; i < i1; i++) {
+    real sum = 0.0f;
+
+    for (int l = 0; l < L; l++) {
+      sum += operator_weights<L>()[l] * (from[idx(nx, ny, i, j+l+1, k)] - from[idx(nx, ny, i, j-l, k)]);
+    }
+
+    to[idx(nx, ny, i, j, k)] = sum * scale;
+  }
+}
+
+template <int L>
+static inline void dy_backward_row(real* to, const real* __restrict__ from, const int nx, const int ny,
+                                   const int i0, const int i1, const int j, const int k, const real scale) {
+  for (int i = i0; i < i1; i++) {
+    real sum = 0.0f;
+
+    for (int l = 0; l < L; l++) {
+      sum += operator_weights<L>()[l] * (from[idx(nx, ny, i, j+l, k)] - from[idx(nx, ny, i, j-l-1, k)]);
+    }
+
+    to[idx(nx, ny, i, j, k)] = sum * scale;
+  }
+}
+
+template <int L>
+static inline void dz_forward_row(real* to, const real* __restrict__ from, const int nx, const int ny,
+                                  const int i0, const int i1, const int j, const int k, const real scale) {
+  for (int i = i0; i < i1; i++) {
+    real sum = 0.0f;
+
+    for (int l = 0; l < L; l++) {
+      sum += operator_weights<L>()[l] * (from[idx(nx, ny, i, j, k+l+1)] - from[idx(nx, ny, i, j, k-l)]);
+    }
+
+    to[idx(nx, ny, i, j, k)] = sum * scale;
+  }
+}
+
+template <int L>
+static inline void dz_backward_row(real* to, const real* __restrict__ from, const int nx, const int ny,
+                                   const int i0, const int i1, const int j, const int k, const real scale) {
+  for (int i = i0; i < i1; i++) {
+    real sum = 0.0f;
+
+    for (int l = 0; l < L; l++) {
+      sum += operator_weights<L>()[l] * (from[idx(nx, ny, i, j, k+l)] - from[idx(nx, ny, i, j, k-l-1)]);
+    }
+
+    to[idx(nx, ny, i, j, k)] = sum * scale;
+  }
+}
 
-  zero_data(to, nx, ny, nz);
+void dx_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const real scale, const int nthreads) {
 
   #pragma omp parallel for num_threads(nthreads)
-  for (int k = half_length; k < nz - half_length; k++) {
-    for (int j = half_length; j < ny - half_length; j++) {
-      for (int i = half_length; i < nx - half_length; i++) {
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      dx_forward_row<half_length>(to, from, nx, ny, r.i0, r.i1, j, k, scale);
+    }
+  }
+}
 
-        for (int l = 0; l < half_length; l++) {
-          to[idx(nx, ny, i, j, k)] += W[l] * (from[idx(nx, ny, i, j+l+1, k)] - from[idx(nx, ny, i, j-l, k)]);
-        }
+void dx_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const real scale, const int nthreads) {
 
-        to[idx(nx, ny, i, j, k)] *= scale;
-      }
+  #pragma omp parallel for num_threads(nthreads)
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      dx_backward_row<half_length>(to, from, nx, ny, r.i0, r.i1, j, k, scale);
     }
   }
 }
 
-void dy_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const int nz, const real scale, const int nthreads) {
+void dy_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const real scale, const int nthreads) {
 
-  zero_data(to, nx, ny, nz);
+  if (smt_prefetch_distance > 0) {
+    smt_row_sweep(r.j0, r.j1, r.k0, r.k1, nthreads, smt_prefetch_distance,
+                  [&](int j, int k) { dy_forward_row<half_length>(to, from, nx, ny, r.i0, r.i1, j, k, scale); },
+                  [&](int j, int k) { prefetch_dy_row(to, from, nx, ny, j, k); });
+    return;
+  }
 
   #pragma omp parallel for num_threads(nthreads)
-  for (int k = half_length; k < nz - half_length; k++) {
-    for (int j = half_length; j < ny - half_length; j++) {
-      for (int i = half_length; i < nx - half_length; i++) {
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      dy_forward_row<half_length>(to, from, nx, ny, r.i0, r.i1, j, k, scale);
+    }
+  }
+}
+
+void dy_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const real scale, const int nthreads) {
 
-        for (int l = 0; l < half_length; l++) {
-          to[idx(nx, ny, i, j, k)] += W[l] * (from[idx(nx, ny, i, j+l, k)] - from[idx(nx, ny, i, j-l-1, k)]);
-        }
+  if (smt_prefetch_distance > 0) {
+    smt_row_sweep(r.j0, r.j1, r.k0, r.k1, nthreads, smt_prefetch_distance,
+                  [&](int j, int k) { dy_backward_row<half_length>(to, from, nx, ny, r.i0, r.i1, j, k, scale); },
+                  [&](int j, int k) { prefetch_dy_row(to, from, nx, ny, j, k); });
+    return;
+  }
 
-        to[idx(nx, ny, i, j, k)] *= scale;
-      }
+  #pragma omp parallel for num_threads(nthreads)
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      dy_backward_row<half_length>(to, from, nx, ny, r.i0, r.i1, j, k, scale);
     }
   }
 }
 
-void dz_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const int nz, const real scale, const int nthreads) {
+void dz_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const real scale, const int nthreads) {
 
-  zero_data(to, nx, ny, nz);
+  if (smt_prefetch_distance > 0) {
+    smt_row_sweep(r.j0, r.j1, r.k0, r.k1, nthreads, smt_prefetch_distance,
+                  [&](int j, int k) { dz_forward_row<half_length>(to, from, nx, ny, r.i0, r.i1, j, k, scale); },
+                  [&](int j, int k) { prefetch_dz_row(to, from, nx, ny, j, k); });
+    return;
+  }
 
   #pragma omp parallel for num_threads(nthreads)
-  for (int k = half_length; k < nz - half_length; k++) {
-    for (int j = half_length; j < ny - half_length; j++) {
-      for (int i = half_length; i < nx - half_length; i++) {
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      dz_forward_row<half_length>(to, from, nx, ny, r.i0, r.i1, j, k, scale);
+    }
+  }
+}
+
+void dz_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const real scale, const int nthreads) {
 
-        for (int l = 0; l < half_length; l++) {
-          to[idx(nx, ny, i, j, k)] += W[l] * (from[idx(nx, ny, i, j, k+l+1)] - from[idx(nx, ny, i, j, k-l)]);
-        }
+  if (smt_prefetch_distance > 0) {
+    smt_row_sweep(r.j0, r.j1, r.k0, r.k1, nthreads, smt_prefetch_distance,
+                  [&](int j, int k) { dz_backward_row<half_length>(to, from, nx, ny, r.i0, r.i1, j, k, scale); },
+                  [&](int j, int k) { prefetch_dz_row(to, from, nx, ny, j, k); });
+    return;
+  }
 
-        to[idx(nx, ny, i, j, k)] *= scale;
-      }
+  #pragma omp parallel for num_threads(nthreads)
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      dz_backward_row<half_length>(to, from, nx, ny, r.i0, r.i1, j, k, scale);
     }
   }
 }
 
-void dz_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const int nz, const real scale, const int nthreads) {
 
-  zero_data(to, nx, ny, nz);
+// Row kernel of the shell order among those of half length 2, 3 and 4
+static row_kernel shell_kernel(row_kernel order2, row_kernel order3, row_kernel order4) {
+  switch (shell_order) {
+    case 2: return order2;
+    case 3: return order3;
+    default: return order4;
+  }
+}
+
+// Differentiates the part of r inside full with the full operator and the rest with the shell one
+static void split_derivative(full_kernel full_order, row_kernel shell_row, real* to, const real* __restrict__ from,
+                             const int nx, const int ny, const region_t& r, const region_t& full,
+                             const real scale, const int nthreads) {
+
+  if (shell_order == half_length) {
+    full_order(to, from, nx, ny, r, scale, nthreads);
+    return;
+  }
+
+  region_t shell[6];
+  int nshell;
+  const region_t inner = split_region(r, full, shell, &nshell);
+
+  if (!is_empty(inner)) {
+    full_order(to, from, nx, ny, inner, scale, nthreads);
+  }
+  for (int s = 0; s < nshell; s++) {
+    sweep_rows(shell_row, to, from, nx, ny, shell[s], scale, nthreads);
+  }
+}
+
+void dx_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const region_t& full, const real scale, const int nthreads) {
+  split_derivative(dx_forward, shell_kernel(dx_forward_row<2>, dx_forward_row<3>, dx_forward_row<4>), to, from, nx, ny, r, full, scale, nthreads);
+}
+
+void dx_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const region_t& full, const real scale, const int nthreads) {
+  split_derivative(dx_backward, shell_kernel(dx_backward_row<2>, dx_backward_row<3>, dx_backward_row<4>), to, from, nx, ny, r, full, scale, nthreads);
+}
+
+void dy_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const region_t& full, const real scale, const int nthreads) {
+  split_derivative(dy_forward, shell_kernel(dy_forward_row<2>, dy_forward_row<3>, dy_forward_row<4>), to, from, nx, ny, r, full, scale, nthreads);
+}
+
+void dy_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const region_t& full, const real scale, const int nthreads) {
+  split_derivative(dy_backward, shell_kernel(dy_backward_row<2>, dy_backward_row<3>, dy_backward_row<4>), to, from, nx, ny, r, full, scale, nthreads);
+}
+
+// Full-order z-derivatives with the scale of every z-plane
+static void dz_forward_planes(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const real* scales, const int nthreads) {
+
+  if (smt_prefetch_distance > 0) {
+    smt_row_sweep(r.j0, r.j1, r.k0, r.k1, nthreads, smt_prefetch_distance,
+                  [&](int j, int k) { dz_forward_row<half_length>(to, from, nx, ny, r.i0, r.i1, j, k, scales[k]); },
+                  [&](int j, int k) { prefetch_dz_row(to, from, nx, ny, j, k); });
+    return;
+  }
 
   #pragma omp parallel for num_threads(nthreads)
-  for (int k = half_length; k < nz - half_length; k++) {
-    for (int j = half_length; j < ny - half_length; j++) {
-      for (int i = half_length; i < nx - half_length; i++) {
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      dz_forward_row<half_length>(to, from, nx, ny, r.i0, r.i1, j, k, scales[k]);
+    }
+  }
+}
 
-        for (int l = 0; l < half_length; l++) {
-          to[idx(nx, ny, i, j, k)] += W[l] * (from[idx(nx, ny, i, j, k+l)] - from[idx(nx, ny, i, j, k-l-1)]);
-        }
+static void dz_backward_planes(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const real* scales, const int nthreads) {
 
-        to[idx(nx, ny, i, j, k)] *= scale;
+  if (smt_prefetch_distance > 0) {
+    smt_row_sweep(r.j0, r.j1, r.k0, r.k1, nthreads, smt_prefetch_distance,
+                  [&](int j, int k) { dz_backward_row<half_length>(to, from, nx, ny, r.i0, r.i1, j, k, scales[k]); },
+                  [&](int j, int k) { prefetch_dz_row(to, from, nx, ny, j, k); });
+    return;
+  }
 
-      }
+  #pragma omp parallel for num_threads(nthreads)
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      dz_backward_row<half_length>(to, from, nx, ny, r.i0, r.i1, j, k, scales[k]);
     }
   }
 }
 
+// split_derivative with the scale of every z-plane
+static void split_plane_derivative(plane_kernel full_order, row_kernel shell_row, real* to, const real* __restrict__ from,
+                                   const int nx, const int ny, const region_t& r, const region_t& full,
+                                   const real* scales, const int nthreads) {
+
+  if (shell_order == half_length) {
+    full_order(to, from, nx, ny, r, scales, nthreads);
+    return;
+  }
+
+  region_t shell[6];
+  int nshell;
+  const region_t inner = split_region(r, full, shell, &nshell);
+
+  if (!is_empty(inner)) {
+    full_order(to, from, nx, ny, inner, scales, nthreads);
+  }
+  for (int s = 0; s < nshell; s++) {
+    sweep_planes(shell_row, to, from, nx, ny, shell[s], scales, nthreads);
+  }
+}
+
+void dz_forward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const region_t& full, const real* scales, const int nthreads) {
+  split_plane_derivative(dz_forward_planes, shell_kernel(dz_forward_row<2>, dz_forward_row<3>, dz_forward_row<4>), to, from, nx, ny, r, full, scales, nthreads);
+}
+
+void dz_backward(real* to, const real* __restrict__ from, const int nx, const int ny, const region_t& r, const region_t& full, const real* scales, const int nthreads) {
+  split_plane_derivative(dz_backward_planes, shell_kernel(dz_backward_row<2>, dz_backward_row<3>, dz_backward_row<4>), to, from, nx, ny, r, full, scales, nthreads);
+}
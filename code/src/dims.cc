@@ -3,7 +3,10 @@
  * Date: September 9, 2016
  */
 
+#include <cmath>
+
 #include "dims.h"
+#include "differentiators.h"
 
 std::shared_ptr<dims_t> size_setup(const int nx,
                    const int ny,
@@ -13,7 +16,8 @@ std::shared_ptr<dims_t> size_setup(const int nx,
                    const real dz,
                    const real dx,
                    const real dy,
-                   const real dt) {
+                   const real dt,
+                   const bool free_surface) {
 
   std::shared_ptr<dims_t> dim ((dims_t*)malloc(sizeof(dims_t)), free_ptr());
 
@@ -21,6 +25,7 @@ std::shared_ptr<dims_t> size_setup(const int nx,
   dim->dx = dx;
   dim->dy = dy;
   dim->dz = dz;
+  dim->dz_growth = 1.0;
 
   dim->nt = nt;
 
@@ -29,11 +34,30 @@ std::shared_ptr<dims_t> size_setup(const int nx,
   dim->nz = nz;
 
   dim->ghost_border = ghost_border;
+  dim->free_surface = free_surface;
 
-  // Ghost borders
-  dim->nz_ghost = nz + 2 * ghost_border; // If free surface use nz + ghost_border
+  // Ghost borders. A free surface lies at the first computed plane, the half_length planes above
+  // it hold the stress images.
+  dim->nz_ghost = free_surface ? half_length + nz + ghost_border : nz + 2 * ghost_border;
   dim->nx_ghost = nx + 2 * ghost_border;
-  dim->ny_ghost = ny + 2 * ghost_border;
+  dim->ny_ghost = (half_length_y > 0) ? ny + 2 * ghost_border : ny;    // The x-z plane has no y-borders
+
+  // The whole grid starts at the origin
+  dim->x0 = 0;
+  dim->y0 = 0;
+  dim->z0 = 0;
 
   return dim;
 }
+
+// The sampling grows geometrically with depth, dz * dz_growth^k, so the grid stays smooth
+real plane_spacing(std::shared_ptr<dims_t> dims, const real k) {
+  return dims->dz * std::pow(dims->dz_growth, k);
+}
+
+real plane_depth(std::shared_ptr<dims_t> dims, const real k) {
+  if (dims->dz_growth == 1.0) {
+    return dims->dz * k;
+  }
+  return dims->dz * (std::pow(dims->dz_growth, k) - 1.0) / std::log(dims->dz_growth);
+}
@@ -0,0 +1,309 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 19, 2026
+ * Comment: Second-order displacement engine with the stresses evaluated slab by slab.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "displacement.h"
+#include "differentiators.h"
+#include "source.h"
+
+std::shared_ptr<displacement_t> displacement_setup(std::shared_ptr<fdm3d_t> waves, const int slab) {
+
+  std::shared_ptr<displacement_t> disp((displacement_t*) malloc(sizeof(displacement_t)), free_ptr());
+
+  const int nx = waves->nx_ghost;
+  const int ny = waves->ny_ghost;
+  const int nz = waves->nz_ghost;
+
+  disp->slab = std::max(slab, 1);
+  disp->planes = disp->slab + 2 * half_length;
+
+  for (int f = 0; f < 3; f++) {
+    disp->u[f] = (real*) malloc(sizeof(real) * nx * ny * nz);
+    zero_data(disp->u[f], nx, ny, nz);
+  }
+
+  // Points outside the computed region are never written and keep their zero stresses
+  for (int f = 0; f < 6; f++) {
+    disp->s[f] = (real*) calloc((size_t) nx * ny * disp->planes, sizeof(real));
+  }
+
+  disp->source_stress = 0.0;
+  for (int d = 0; d < 3; d++) {
+    disp->source[d] = -1;
+  }
+
+  return disp;
+}
+
+void insert_displacement_source(std::shared_ptr<displacement_t> disp, std::shared_ptr<fdm3d_t> waves,
+                                std::shared_ptr<model3d_t> model, real* source, const int source_type,
+                                const int x, const int y, const int z, const int direction, const int it) {
+
+  if (source_type != 1) {
+    insert_source(waves, model, source, source_type, x, y, z, direction, it);
+    return;
+  }
+
+  const int i = x - waves->x0;
+  const int j = y - waves->y0;
+  const int k = z - waves->z0;
+
+  if (i < 0 || i >= waves->nx_ghost || j < 0 || j >= waves->ny_ghost || k < 0 || k >= waves->nz_ghost) {
+    return;
+  }
+
+  disp->source[0] = i;
+  disp->source[1] = j;
+  disp->source[2] = k;
+  disp->source_stress += source[it] * waves->dt;
+}
+
+// Derivatives of f at (i, j, k) along axis A (0 for x, 1 for y, 2 for z), as the rows of
+// differentiators without the scale
+template <int A>
+static inline real forward(const real* __restrict__ f, const int nx, const int ny, const int i, const int j,
+                           const int k) {
+  real sum = 0.0f;
+
+  for (int l = 0; l < half_length; l++) {
+    sum += W[l] * (f[idx(nx, ny, i + (A == 0) * (l + 1), j + (A == 1) * (l + 1), k + (A == 2) * (l + 1))]
+                   - f[idx(nx, ny, i - (A == 0) * l, j - (A == 1) * l, k - (A == 2) * l)]);
+  }
+
+  return sum;
+}
+
+template <int A>
+static inline real backward(const real* __restrict__ f, const int nx, const int ny, const int i, const int j,
+                            const int k) {
+  real sum = 0.0f;
+
+  for (int l = 0; l < half_length; l++) {
+    sum += W[l] * (f[idx(nx, ny, i + (A == 0) * l, j + (A == 1) * l, k + (A == 2) * l)]
+                   - f[idx(nx, ny, i - (A == 0) * (l + 1), j - (A == 1) * (l + 1), k - (A == 2) * (l + 1))]);
+  }
+
+  return sum;
+}
+
+// The rows update the points i0 <= i < i1 of row j of plane k. The grid-sized fields are indexed
+// with k and the stress buffers with k - kbase. They share the signature of stress_row: up to
+// three fields written (to), three fields derived (from) and two fields of the model (m), all
+// restrict like the rows of differentiators, so each row vectorizes. scales holds inv_dx, inv_dy,
+// the z-scale of the plane and dt.
+typedef void (*stress_row)(real* __restrict__, real* __restrict__, real* __restrict__, const real* __restrict__,
+                           const real* __restrict__, const real* __restrict__, const real* __restrict__,
+                           const real* __restrict__, const real*, const int, const int, const int, const int,
+                           const int, const int, const int);
+
+// Normal stresses sxx, syy and szz from the displacements ux, uy and uz, with lambda and mu
+static void normal_stress_row(real* __restrict__ sxx, real* __restrict__ syy, real* __restrict__ szz,
+                              const real* __restrict__ ux, const real* __restrict__ uy, const real* __restrict__ uz,
+                              const real* __restrict__ lambda, const real* __restrict__ mu, const real* scales,
+                              const int nx, const int ny, const int i0, const int i1, const int j, const int k,
+                              const int kbase) {
+  for (int i = i0; i < i1; i++) {
+    const int p = idx(nx, ny, i, j, k);
+    const int q = idx(nx, ny, i, j, k - kbase);
+
+    const real exx = backward<0>(ux, nx, ny, i, j, k) * scales[0];
+#ifdef ELASTIC_2D
+    const real eyy = 0.0f;
+#else
+    const real eyy = backward<1>(uy, nx, ny, i, j, k) * scales[1];
+#endif
+    const real ezz = backward<2>(uz, nx, ny, i, j, k) * scales[2];
+
+    sxx[q] = (lambda[p] + 2.0 * mu[p]) * exx + lambda[p] * (ezz + eyy);
+    syy[q] = (lambda[p] + 2.0 * mu[p]) * eyy + lambda[p] * (ezz + exx);
+    szz[q] = (lambda[p] + 2.0 * mu[p]) * ezz + lambda[p] * (exx + eyy);
+  }
+}
+
+// Shear stress from the forward derivatives of the displacements f1 along axis A1 and f2 along
+// A2, as compute_sxy, compute_syz and compute_sxz. mu is averaged over p and the points one step
+// up along A1, along B and along both A1 and A2, the points the velocity-stress kernels use.
+template <int A1, int A2, int B>
+static void shear_stress_row(real* __restrict__ to, real* __restrict__, real* __restrict__,
+                             const real* __restrict__ f1, const real* __restrict__ f2, const real* __restrict__,
+                             const real* __restrict__ mu, const real* __restrict__, const real* scales,
+                             const int nx, const int ny, const int i0, const int i1, const int j, const int k,
+                             const int kbase) {
+  for (int i = i0; i < i1; i++) {
+    const int q = idx(nx, ny, i, j, k - kbase);
+    const real mu4 = mu[idx(nx, ny, i, j, k)] + mu[idx(nx, ny, i + (A1 == 0), j + (A1 == 1), k + (A1 == 2))]
+        + mu[idx(nx, ny, i + (B == 0), j + (B == 1), k + (B == 2))]
+        + mu[idx(nx, ny, i + (A1 == 0 || A2 == 0), j + (A1 == 1 || A2 == 1), k + (A1 == 2 || A2 == 2))];
+
+    to[q] = mu4 * 0.25 * (forward<A1>(f1, nx, ny, i, j, k) * scales[A1]
+                          + forward<A2>(f2, nx, ny, i, j, k) * scales[A2]);
+  }
+}
+
+// Velocity v along axis V from the forward derivative of its normal stress f1 and the backward
+// derivatives of the shear stresses f2 along A2 and, unless third is false, f3 along A3, with
+// rho averaged over p and the next point along V. Then the displacement u from the new velocity.
+template <int V, int A2, int A3, bool third>
+static void velocity_row(real* __restrict__ v, real* __restrict__ u, real* __restrict__,
+                         const real* __restrict__ f1, const real* __restrict__ f2, const real* __restrict__ f3,
+                         const real* __restrict__ rho, const real* __restrict__, const real* scales,
+                         const int nx, const int ny, const int i0, const int i1, const int j, const int k,
+                         const int kbase) {
+  const int kq = k - kbase;
+
+  for (int i = i0; i < i1; i++) {
+    const int p = idx(nx, ny, i, j, k);
+
+    real sum = forward<V>(f1, nx, ny, i, j, kq) * scales[V] + backward<A2>(f2, nx, ny, i, j, kq) * scales[A2];
+    if (third) {
+      sum += backward<A3>(f3, nx, ny, i, j, kq) * scales[A3];
+    }
+
+    v[p] += scales[3] * (2.0 / (rho[p] + rho[idx(nx, ny, i + (V == 0), j + (V == 1), k + (V == 2))])) * sum;
+    u[p] += scales[3] * v[p];
+  }
+}
+
+// Applies row to the rows of the planes [k0, k1) of r, with the z-scales in dz
+static void sweep(stress_row row, real* to0, real* to1, real* to2, const real* from0, const real* from1,
+                  const real* from2, const real* m0, const real* m1, const real inv_dx, const real inv_dy,
+                  const real* dz, const real dt, const int nx, const int ny, const region_t& r, const int k0,
+                  const int k1, const int kbase, const int nthreads) {
+
+  #pragma omp parallel for collapse(2) num_threads(nthreads)
+  for (int k = k0; k < k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      const real scales[4] = {inv_dx, inv_dy, dz[k], dt};
+      row(to0, to1, to2, from0, from1, from2, m0, m1, scales, nx, ny, r.i0, r.i1, j, k, kbase);
+    }
+  }
+}
+
+// Stresses of the planes [k0, k1) from the displacements into the buffers, whose first plane is
+// kbase. Planes outside the computed region are zero.
+static void slab_stresses(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                          std::shared_ptr<displacement_t> disp, const int kbase, const int k0, const int k1,
+                          const int nthreads) {
+
+  const int nx = waves->nx_ghost;
+  const int ny = waves->ny_ghost;
+  const int plane = nx * ny;
+  const region_t r = computed_region(nx, ny, waves->nz_ghost);
+  const real inv_dx = 1.0f / waves->dx;
+  const real inv_dy = 1.0f / waves->dy;
+  real* const* u = disp->u;
+  real* const* s = disp->s;
+
+  for (int k = k0; k < k1; k++) {
+    if (k < r.k0 || k >= r.k1) {
+      for (int f = 0; f < 6; f++) {
+        std::memset(&s[f][(k - kbase) * plane], 0, sizeof(real) * plane);
+      }
+    }
+  }
+
+  const int kc0 = std::max(k0, r.k0);
+  const int kc1 = std::min(k1, r.k1);
+
+  const real* lambda = model->lambda;
+  const real* mu = model->mu;
+  const real* dz = waves->inv_dz[1];
+
+  sweep(normal_stress_row, s[0], s[1], s[2], u[0], u[1], u[2], lambda, mu, inv_dx, inv_dy, waves->inv_dz[0], 0.0,
+        nx, ny, r, kc0, kc1, kbase, nthreads);
+  sweep(shear_stress_row<0, 2, 1>, s[5], NULL, NULL, u[2], u[0], NULL, mu, NULL, inv_dx, inv_dy, dz, 0.0,
+        nx, ny, r, kc0, kc1, kbase, nthreads);
+#ifndef ELASTIC_2D
+  sweep(shear_stress_row<1, 0, 0>, s[3], NULL, NULL, u[0], u[1], NULL, mu, NULL, inv_dx, inv_dy, dz, 0.0,
+        nx, ny, r, kc0, kc1, kbase, nthreads);
+  sweep(shear_stress_row<1, 2, 2>, s[4], NULL, NULL, u[2], u[1], NULL, mu, NULL, inv_dx, inv_dy, dz, 0.0,
+        nx, ny, r, kc0, kc1, kbase, nthreads);
+#endif
+
+  const int* source = disp->source;
+  if (source[2] >= kc0 && source[2] < kc1) {
+    const int q = idx(nx, ny, source[0], source[1], source[2] - kbase);
+    for (int f = 0; f < 3; f++) {
+      s[f][q] += disp->source_stress;
+    }
+  }
+}
+
+// Velocities of the planes [k0, k1) from the stresses in the buffers, whose first plane is kbase,
+// and the displacements from the new velocities. Later slabs only need the displacements from
+// plane k1 on.
+static void slab_velocities(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                            std::shared_ptr<displacement_t> disp, const int kbase, const int k0, const int k1,
+                            const int nthreads) {
+
+  const int nx = waves->nx_ghost;
+  const int ny = waves->ny_ghost;
+  const region_t r = computed_region(nx, ny, waves->nz_ghost);
+  const real dt = waves->dt;
+  const real inv_dx = 1.0f / waves->dx;
+  const real inv_dy = 1.0f / waves->dy;
+  real* const* u = disp->u;
+  real* const* s = disp->s;
+  const real* rho = model->rho;
+  constexpr bool y = half_length_y > 0;
+
+  sweep(velocity_row<0, 2, 1, y>, waves->vx, u[0], NULL, s[0], s[5], s[3], rho, NULL, inv_dx, inv_dy,
+        waves->inv_dz[0], dt, nx, ny, r, k0, k1, kbase, nthreads);
+#ifndef ELASTIC_2D
+  sweep(velocity_row<1, 2, 0, true>, waves->vy, u[1], NULL, s[1], s[4], s[3], rho, NULL, inv_dx, inv_dy,
+        waves->inv_dz[0], dt, nx, ny, r, k0, k1, kbase, nthreads);
+#endif
+  sweep(velocity_row<2, 0, 1, y>, waves->vz, u[2], NULL, s[2], s[5], s[4], rho, NULL, inv_dx, inv_dy,
+        waves->inv_dz[1], dt, nx, ny, r, k0, k1, kbase, nthreads);
+}
+
+void displacement_time_step(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                            std::shared_ptr<displacement_t> disp, const int nthreads,
+                            std::shared_ptr<step_timing_t> timing) {
+
+  const int plane = waves->nx_ghost * waves->ny_ghost;
+  const region_t r = computed_region(waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
+
+  auto t0 = std::chrono::high_resolution_clock::now();
+
+  // The stresses reach half_length planes beyond the velocities of a slab. The planes around the
+  // start of a slab were evaluated for the previous one and move to the front of the buffers.
+  for (int kb = r.k0; kb < r.k1; kb += disp->slab) {
+    const int ke = std::min(kb + disp->slab, r.k1);
+    const int kbase = kb - half_length;
+
+    if (kb == r.k0) {
+      slab_stresses(waves, model, disp, kbase, kbase, ke + half_length, nthreads);
+    } else {
+      for (int f = 0; f < 6; f++) {
+        std::memmove(disp->s[f], &disp->s[f][disp->slab * plane], sizeof(real) * 2 * half_length * plane);
+      }
+      slab_stresses(waves, model, disp, kbase, kb + half_length, ke + half_length, nthreads);
+    }
+
+    slab_velocities(waves, model, disp, kbase, kb, ke, nthreads);
+  }
+
+  auto t1 = std::chrono::high_resolution_clock::now();
+
+  timing->compute += std::chrono::duration<double>(t1 - t0).count();
+}
+
+double displacement_bytes(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<displacement_t> disp) {
+  const double plane = (double) waves->nx_ghost * waves->ny_ghost;
+  return sizeof(real) * (6.0 * plane * waves->nz_ghost + 6.0 * plane * disp->planes);
+}
+
+void free_displacement_arrays(std::shared_ptr<displacement_t> disp) {
+  for (int f = 0; f < 3; f++) {
+    free(disp->u[f]);
+  }
+  for (int f = 0; f < 6; f++) {
+    free(disp->s[f]);
+  }
+}
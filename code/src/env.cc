@@ -0,0 +1,22 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Optional run-time settings read from OPTEWE_* environment variables.
+ */
+
+#include <cstdlib>
+#include "env.h"
+
+int env_int(const char* name, const int fallback) {
+  const char* value = std::getenv(name);
+  return (value && *value) ? std::atoi(value) : fallback;
+}
+
+real env_real(const char* name, const real fallback) {
+  const char* value = std::getenv(name);
+  return (value && *value) ? (real) std::atof(value) : fallback;
+}
+
+std::string env_string(const char* name, const std::string& fallback) {
+  const char* value = std::getenv(name);
+  return (value && *value) ? std::string(value) : fallback;
+}
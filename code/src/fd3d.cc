@@ -4,15 +4,18 @@
  */
 
 #include "fd3d.h"
+#include "pml3d.h"
+#include "activity.h"
 
 // Initialization of the 3D finite difference structure
-std::shared_ptr<fdm3d_t> fdm3d_setup(std::shared_ptr<dims_t> dims) {
+std::shared_ptr<fdm3d_t> fdm3d_setup(std::shared_ptr<dims_t> dims, const bool stresses) {
 
   // Create wave structure
   std::shared_ptr<fdm3d_t> waves((fdm3d_t*) malloc(sizeof(fdm3d_t)), free_ptr());
 
   // Setup struct variables from wave input
   waves->ghost_border = dims->ghost_border;
+  waves->free_surface = dims->free_surface;
   waves->nz = dims->nz;
   waves->nx = dims->nx;
   waves->ny = dims->ny;
@@ -21,30 +24,55 @@ std::shared_ptr<fdm3d_t> fdm3d_setup(std::shared_ptr<dims_t> dims) {
   waves->dy = dims->dy;
   waves->dt = dims->dt;
   waves->nt = dims->nt;
+  waves->x0 = dims->x0;
+  waves->y0 = dims->y0;
+  waves->z0 = dims->z0;
 
-  // Calculate coordinates with grid cells included
-  waves->nx_ghost = waves->nx + 2 * waves->ghost_border;
-  waves->ny_ghost = waves->ny + 2 * waves->ghost_border;
-  waves->nz_ghost = waves->nz + 2 * waves->ghost_border;
+  // Set up separately, they need the position of the local grid in the global one
+  waves->pml = NULL;
+  waves->activity = NULL;
+  waves->samples = NULL;
+
+  // Coordinates with grid cells included
+  waves->nx_ghost = dims->nx_ghost;
+  waves->ny_ghost = dims->ny_ghost;
+  waves->nz_ghost = dims->nz_ghost;
 
   // Allocate arrays
   size_t num_bytes = sizeof(real) * ((waves->nx_ghost) * (waves->ny_ghost) * (waves->nz_ghost));
 
   // Stress fields
-  waves->sxx = (real*) malloc(num_bytes);
-  waves->syy = (real*) malloc(num_bytes);
-  waves->szz = (real*) malloc(num_bytes);
-  waves->sxy = (real*) malloc(num_bytes);
-  waves->syz = (real*) malloc(num_bytes);
-  waves->sxz = (real*) malloc(num_bytes);
+  waves->sxx = stresses ? (real*) malloc(num_bytes) : NULL;
+  waves->syy = stresses ? (real*) malloc(num_bytes) : NULL;
+  waves->szz = stresses ? (real*) malloc(num_bytes) : NULL;
+  waves->sxy = stresses ? (real*) malloc(num_bytes) : NULL;
+  waves->syz = stresses ? (real*) malloc(num_bytes) : NULL;
+  waves->sxz = stresses ? (real*) malloc(num_bytes) : NULL;
+
+  // Inverse z-sampling of the planes and of the half planes between them
+  for (int half = 0; half < 2; half++) {
+    waves->inv_dz[half] = (real*) malloc(sizeof(real) * waves->nz_ghost);
+    for (int k = 0; k < waves->nz_ghost; k++) {
+      waves->inv_dz[half][k] = 1.0f / plane_spacing(dims, waves->z0 + k + 0.5 * half);
+    }
+  }
 
   // Velocity fields
   waves->vz = (real*) malloc(num_bytes);
   waves->vx = (real*) malloc(num_bytes);
   waves->vy = (real*) malloc(num_bytes);
-  waves->del1 = (real*) malloc(num_bytes);
-  waves->del2 = (real*) malloc(num_bytes);
-  waves->del3 = (real*) malloc(num_bytes);
+  waves->del1 = stresses ? (real*) malloc(num_bytes) : NULL;
+  waves->del2 = stresses ? (real*) malloc(num_bytes) : NULL;
+  waves->del3 = stresses ? (real*) malloc(num_bytes) : NULL;
+
+  // Reset velocity fields
+  zero_data(waves->vz, waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
+  zero_data(waves->vx, waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
+  zero_data(waves->vy, waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
+
+  if (!stresses) {
+    return waves;
+  }
 
   // Reset stress fields
   zero_data(waves->sxx, waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
@@ -54,10 +82,6 @@ std::shared_ptr<fdm3d_t> fdm3d_setup(std::shared_ptr<dims_t> dims) {
   zero_data(waves->syz, waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
   zero_data(waves->sxz, waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
 
-  // Reset velocity fields
-  zero_data(waves->vz, waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
-  zero_data(waves->vx, waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
-  zero_data(waves->vz, waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
   zero_data(waves->del1, waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
   zero_data(waves->del2, waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
   zero_data(waves->del3, waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
@@ -82,5 +106,16 @@ void free_wave_arrays(std::shared_ptr<fdm3d_t> waves) {
   free(waves->del1);
   free(waves->del2);
   free(waves->del3);
+
+  free(waves->inv_dz[0]);
+  free(waves->inv_dz[1]);
+
+  if (waves->pml != NULL) {
+    free_pml_arrays(waves->pml);
+  }
+
+  if (waves->activity != NULL) {
+    free_activity_arrays(waves->activity);
+  }
 }
 
@@ -0,0 +1,217 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Fourth-order time stepping built on the kernels of the leapfrog step.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include "lax_wendroff.h"
+#include "differentiators.h"
+#include "pml3d.h"
+
+std::shared_ptr<lax_wendroff_t> lax_wendroff_setup(const int order) {
+
+  std::shared_ptr<lax_wendroff_t> lw((lax_wendroff_t*) malloc(sizeof(lax_wendroff_t)), free_ptr());
+
+  if (order != 2 && order != 4) {
+    std::cerr << "#Time order " << order << " is not 2 or 4, using the leapfrog step (order 2)" << std::endl;
+  }
+  lw->order = (order == 4) ? 4 : 2;
+  lw->size = 0;
+
+  return lw;
+}
+
+real lax_wendroff_gain(const int order) {
+  // For one mode of angular frequency w the leapfrog step is stable up to w dt = 2, the
+  // corrected one up to w dt = sqrt(12)
+  return (order >= 4) ? std::sqrt(3.0) : 1.0;
+}
+
+// (Re)allocates the scratch fields for the current local grid
+static void scratch_setup(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<lax_wendroff_t> lw) {
+  const int size = waves->nx_ghost * waves->ny_ghost * waves->nz_ghost;
+
+  if (size == lw->size) {
+    return;
+  }
+
+  free_lax_wendroff_arrays(lw);
+  lw->size = size;
+
+  for (int f = 0; f < 3; f++) {
+    lw->v[f] = (real*) malloc(sizeof(real) * size);
+    zero_data(lw->v[f], waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
+  }
+  for (int f = 0; f < 6; f++) {
+    lw->s[f] = (real*) malloc(sizeof(real) * size);
+    zero_data(lw->s[f], waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
+  }
+}
+
+// Swap the velocities or the stresses of the wave fields with the scratch ones, so the kernels
+// of step_engine read or write the scratch fields
+static void swap_velocities(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<lax_wendroff_t> lw) {
+  std::swap(waves->vx, lw->v[0]);
+  std::swap(waves->vy, lw->v[1]);
+  std::swap(waves->vz, lw->v[2]);
+}
+
+static void swap_stresses(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<lax_wendroff_t> lw) {
+  std::swap(waves->sxx, lw->s[0]);
+  std::swap(waves->syy, lw->s[1]);
+  std::swap(waves->szz, lw->s[2]);
+  std::swap(waves->sxy, lw->s[3]);
+  std::swap(waves->syz, lw->s[4]);
+  std::swap(waves->sxz, lw->s[5]);
+}
+
+// The velocity or the stress kernels with the time step scale, with or without the PML
+static void scaled_velocities(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                              std::shared_ptr<thread_table_t> threads, const region_t& r, step_context_t* ctx,
+                              const real scale, const bool with_pml) {
+  const real dt = waves->dt;
+  pml3d_t* pml = waves->pml;
+
+  waves->dt = scale;
+  waves->pml = with_pml ? pml : NULL;
+  update_velocities(waves, model, threads, r, ctx);
+  waves->dt = dt;
+  waves->pml = pml;
+}
+
+static void scaled_stresses(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                            std::shared_ptr<thread_table_t> threads, const region_t& r, step_context_t* ctx,
+                            const real scale, const bool with_pml) {
+  const real dt = waves->dt;
+  pml3d_t* pml = waves->pml;
+
+  waves->dt = scale;
+  waves->pml = with_pml ? pml : NULL;
+  update_stresses(waves, model, threads, r, ctx);
+  image_free_surface(waves, r, threads->nthreads[kCSXZ]);
+  waves->dt = dt;
+  waves->pml = pml;
+}
+
+// field += scale * rate over the whole local grid
+static void add_scaled(real* field, const real* rate, const real scale, const int size, const int nthreads) {
+  #pragma omp parallel for num_threads(nthreads)
+  for (int p = 0; p < size; p++) {
+    field[p] += scale * rate[p];
+  }
+}
+
+void lax_wendroff_time_step(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                            std::shared_ptr<thread_table_t> threads, std::shared_ptr<decomp_t> decomp,
+                            std::shared_ptr<lax_wendroff_t> lw, step_context_t* ctx,
+                            std::shared_ptr<step_timing_t> timing) {
+
+  scratch_setup(waves, lw);
+
+  const int nx = waves->nx_ghost;
+  const int ny = waves->ny_ghost;
+  const int nz = waves->nz_ghost;
+  const int nthreads = threads->nthreads[kCVX];
+  const real dt = waves->dt;
+  const real correction = dt * dt * dt / 24.0;
+  const region_t r = computed_region(nx, ny, nz);
+
+  double exposed = 0.0;
+  auto exchange = [&](const std::vector<real*>& fields) {
+    auto start = std::chrono::high_resolution_clock::now();
+    exchange_halos(decomp, fields);
+    exposed += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+  };
+  auto exchange_velocities = [&](real* const* v) { exchange({v[0], v[1], v[2]}); };
+  auto exchange_stresses = [&](real* const* s) { exchange({s[0], s[1], s[2], s[3], s[4], s[5]}); };
+
+  real* const velocity[3] = {waves->vx, waves->vy, waves->vz};
+  real* const stress[6] = {waves->sxx, waves->syy, waves->szz, waves->sxy, waves->syz, waves->sxz};
+
+  auto t0 = std::chrono::high_resolution_clock::now();
+
+  // Velocities: v += dt * v_t + dt^3 / 24 * v_ttt, with v_t from the stresses (the leading term,
+  // which carries the PML), s_tt from v_t and v_ttt from s_tt
+  exchange_stresses(stress);
+  for (int f = 0; f < 3; f++) {
+    zero_data(lw->v[f], nx, ny, nz, nthreads);
+  }
+  swap_velocities(waves, lw);
+  scaled_velocities(waves, model, threads, r, ctx, 1.0, true);
+  swap_velocities(waves, lw);
+
+  exchange_velocities(lw->v);
+  for (int f = 0; f < 6; f++) {
+    zero_data(lw->s[f], nx, ny, nz, nthreads);
+  }
+  swap_velocities(waves, lw);
+  swap_stresses(waves, lw);
+  scaled_stresses(waves, model, threads, r, ctx, 1.0, false);
+  swap_stresses(waves, lw);
+  swap_velocities(waves, lw);
+
+  exchange_stresses(lw->s);
+  for (int f = 0; f < 3; f++) {
+    add_scaled(velocity[f], lw->v[f], dt, lw->size, nthreads);
+  }
+  swap_stresses(waves, lw);
+  scaled_velocities(waves, model, threads, r, ctx, correction, false);
+  swap_stresses(waves, lw);
+
+  // Stresses: the same with the roles of the velocities and the stresses exchanged
+  exchange_velocities(velocity);
+  for (int f = 0; f < 6; f++) {
+    zero_data(lw->s[f], nx, ny, nz, nthreads);
+  }
+  swap_stresses(waves, lw);
+  scaled_stresses(waves, model, threads, r, ctx, 1.0, true);
+  swap_stresses(waves, lw);
+
+  exchange_stresses(lw->s);
+  for (int f = 0; f < 3; f++) {
+    zero_data(lw->v[f], nx, ny, nz, nthreads);
+  }
+  swap_velocities(waves, lw);
+  swap_stresses(waves, lw);
+  scaled_velocities(waves, model, threads, r, ctx, 1.0, false);
+  swap_stresses(waves, lw);
+  swap_velocities(waves, lw);
+
+  exchange_velocities(lw->v);
+  for (int f = 0; f < 6; f++) {
+    add_scaled(stress[f], lw->s[f], dt, lw->size, nthreads);
+  }
+  swap_velocities(waves, lw);
+  scaled_stresses(waves, model, threads, r, ctx, correction, false);
+  swap_velocities(waves, lw);
+
+  auto t1 = std::chrono::high_resolution_clock::now();
+
+  const double compute = std::chrono::duration<double>(t1 - t0).count() - exposed;
+
+  timing->compute += compute;
+  timing->exposed += exposed;
+
+  if (timing->print_steps && decomp->rank == 0) {
+    std::cout << "#Step " << ctx->it << ": compute " << compute << " s, exposed communication "
+              << exposed << " s" << std::endl;
+  }
+}
+
+void free_lax_wendroff_arrays(std::shared_ptr<lax_wendroff_t> lw) {
+  if (lw->size == 0) {
+    return;
+  }
+
+  for (int f = 0; f < 3; f++) {
+    free(lw->v[f]);
+  }
+  for (int f = 0; f < 6; f++) {
+    free(lw->s[f]);
+  }
+  lw->size = 0;
+}
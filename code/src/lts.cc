@@ -0,0 +1,356 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Local time stepping with fine and coarse zones along z.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include "lts.h"
+#include "differentiators.h"
+
+// Planes of the coarse-step material that are added to the fine zone at each interface
+constexpr int kMargin = half_length / 2;
+
+// Stability number vp * sqrt(1/dx^2 + 1/dy^2 + 1/dz^2) of the computed points of plane k, the
+// time step of the plane scales with its inverse
+static real plane_stability(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model, const int k) {
+  const int nx = waves->nx_ghost;
+  const int ny = waves->ny_ghost;
+  const real inv_dz = std::max(waves->inv_dz[0][k], waves->inv_dz[1][k]);
+  const real inv_dy = (half_length_y > 0) ? 1.0 / waves->dy : 0.0;
+  const real inv_h = std::sqrt(1.0 / (waves->dx * waves->dx) + inv_dy * inv_dy + inv_dz * inv_dz);
+
+  real vp_max = 0.0;
+  for (int j = half_length_y; j < ny - half_length_y; j++) {
+    for (int i = half_length; i < nx - half_length; i++) {
+      const int p = idx(nx, ny, i, j, k);
+      vp_max = std::max(vp_max, (real) std::sqrt((model->lambda[p] + 2.0 * model->mu[p]) / model->rho[p]));
+    }
+  }
+
+  return vp_max * inv_h;
+}
+
+std::shared_ptr<lts_t> lts_setup(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                                 std::shared_ptr<decomp_t> decomp, const int rate) {
+
+  std::shared_ptr<lts_t> lts((lts_t*) malloc(sizeof(lts_t)), free_ptr());
+
+  const int nx = waves->nx_ghost;
+  const int ny = waves->ny_ghost;
+  const int nz = waves->nz_ghost;
+  const int plane = nx * ny;
+
+  lts->rate = 1;
+  lts->ncoarse = 0;
+  lts->coarse_pml = NULL;
+  lts->started = false;
+
+  if (rate <= 1) {
+    return lts;
+  }
+
+  // The fine and the coarse zones would have to advance in lock step across the ranks
+  if (decomp->nranks > 1) {
+    if (decomp->rank == 0) {
+      std::cerr << "#OPTEWE_LTS_RATE=" << rate << " needs a single rank, every plane takes the full step" << std::endl;
+    }
+    return lts;
+  }
+
+  // Planes that are not stable with rate times the time step make up the fine zone
+  real* stability = (real*) malloc(sizeof(real) * nz);
+  real stability_max = 0.0;
+  for (int k = half_length; k < nz - half_length; k++) {
+    stability[k] = plane_stability(waves, model, k);
+    stability_max = std::max(stability_max, stability[k]);
+  }
+
+  int k0 = nz - half_length;
+  int k1 = half_length;
+  for (int k = half_length; k < nz - half_length; k++) {
+    if (stability[k] * rate > stability_max) {
+      k0 = std::min(k0, k);
+      k1 = std::max(k1, k + 1);
+    }
+  }
+  free(stability);
+
+  // The interfaces lie a few planes into the material that is stable with the coarse step. With
+  // the material contrast right at an interface, the coarse stencils next to it and the fine
+  // stencils across it feed each other and the coupling goes unstable.
+  k0 = std::max(k0 - kMargin, half_length);
+  k1 = std::min(k1 + kMargin, nz - half_length);
+
+  // The strip and the edge of an interface must not reach across the other zone, so the fine
+  // zone is at least two stencils thick and coarse zones thinner than a stencil join it
+  while (k1 - k0 < 2 * half_length && (k0 > half_length || k1 < nz - half_length)) {
+    k0 = std::max(k0 - 1, half_length);
+    k1 = std::min(k1 + 1, nz - half_length);
+  }
+  if (k0 - half_length < half_length) {
+    k0 = half_length;
+  }
+  if (nz - half_length - k1 < half_length) {
+    k1 = nz - half_length;
+  }
+
+  if (k0 == half_length && k1 == nz - half_length) {
+    std::cerr << "#OPTEWE_LTS_RATE=" << rate << " leaves no coarse zone, too few planes are stable with " << rate
+              << " times the time step, every plane takes the full step" << std::endl;
+    return lts;
+  }
+
+  lts->rate = rate;
+  lts->fine_k0 = k0;
+  lts->fine_k1 = k1;
+  lts->fine = make_region(half_length, nx - half_length, half_length_y, ny - half_length_y, k0, k1);
+
+  if (k0 > half_length) {
+    lts->coarse[lts->ncoarse] = make_region(half_length, nx - half_length, half_length_y, ny - half_length_y, half_length, k0);
+    lts->strip_k0[lts->ncoarse] = k0 - half_length;
+    lts->edge_k0[lts->ncoarse] = k0;
+    lts->ncoarse++;
+  }
+  if (k1 < nz - half_length) {
+    lts->coarse[lts->ncoarse] = make_region(half_length, nx - half_length, half_length_y, ny - half_length_y, k1, nz - half_length);
+    lts->strip_k0[lts->ncoarse] = k1;
+    lts->edge_k0[lts->ncoarse] = k1 - half_length;
+    lts->ncoarse++;
+  }
+
+  // The coarse zones get their own PML coefficients and memory variables for the longer step
+  lts->coarse_dt = waves->dt * rate;
+  if (waves->pml != NULL) {
+    pml3d_t* fine_pml = waves->pml;
+    const real dt = waves->dt;
+
+    waves->dt = lts->coarse_dt;
+    pml_setup(waves, decomp, fine_pml->vp_max, fine_pml->a_max, fine_pml->k_max);
+    lts->coarse_pml = waves->pml;
+
+    waves->dt = dt;
+    waves->pml = fine_pml;
+  }
+
+  const int size = lts->ncoarse * half_length * plane;
+  for (int f = 0; f < 6; f++) {
+    lts->stress_now[f] = (real*) malloc(sizeof(real) * size);
+    lts->stress_prev[f] = (real*) malloc(sizeof(real) * size);
+  }
+  for (int f = 0; f < 3; f++) {
+    lts->v_old[f] = (real*) malloc(sizeof(real) * size);
+    lts->v_new[f] = (real*) malloc(sizeof(real) * size);
+    lts->v_sum[f] = (real*) malloc(sizeof(real) * size);
+    lts->v_last[f] = (real*) malloc(sizeof(real) * size);
+  }
+
+  return lts;
+}
+
+// Calls op(p, q) for every point of the strips (edges = false) or the edges (edges = true), with
+// p its index in the grid and q its index in the packed buffers. Strips and edges span whole
+// planes, so each is a contiguous block of the grid.
+template <typename Op>
+static void for_strips(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<lts_t> lts, const bool edges,
+                       const int nthreads, Op op) {
+  const int block = half_length * waves->nx_ghost * waves->ny_ghost;
+
+  for (int s = 0; s < lts->ncoarse; s++) {
+    const int first = (edges ? lts->edge_k0[s] : lts->strip_k0[s]) * waves->nx_ghost * waves->ny_ghost;
+
+    #pragma omp parallel for num_threads(nthreads)
+    for (int q = s * block; q < (s + 1) * block; q++) {
+      op(first + q - s * block, q);
+    }
+  }
+}
+
+// Swaps the time step and the PML of the fine and the coarse zones
+static void swap_zones(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<lts_t> lts) {
+  std::swap(waves->dt, lts->coarse_dt);
+  std::swap(waves->pml, lts->coarse_pml);
+}
+
+void lts_time_step(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                   std::shared_ptr<thread_table_t> threads, std::shared_ptr<lts_t> lts,
+                   step_context_t* ctx, std::shared_ptr<step_timing_t> timing) {
+
+  const int m = lts->rate;
+  const int j = ctx->it % m;
+  const int nthreads = threads->nthreads[kCVX];
+  real* const stress[6] = {waves->sxx, waves->syy, waves->szz, waves->sxy, waves->syz, waves->sxz};
+  real* const velocity[3] = {waves->vx, waves->vy, waves->vz};
+  const region_t columns = computed_region(waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
+
+  // Weight of v_new against v_old for the strip velocities of fine step j, whose stress update
+  // lies (j + 1/2) fine steps into the coarse step; v_old and v_new lie half a coarse step before
+  // and after its start
+  auto weight = [m](const int step) { return (step + 0.5 + 0.5 * m) / m; };
+
+  auto t0 = std::chrono::high_resolution_clock::now();
+
+  if (j == 0) {
+    // Strip stresses at the start of this coarse step and of the previous one
+    for (int f = 0; f < 6; f++) {
+      real* now = lts->stress_now[f];
+      real* prev = lts->stress_prev[f];
+      const real* field = stress[f];
+      const bool started = lts->started;
+      for_strips(waves, lts, false, nthreads, [=](const int p, const int q) {
+        prev[q] = started ? now[q] : field[p];
+        now[q] = field[p];
+      });
+    }
+    lts->started = true;
+
+    for (int f = 0; f < 3; f++) {
+      real* v_old = lts->v_old[f];
+      const real* field = velocity[f];
+      for_strips(waves, lts, false, nthreads, [=](const int p, const int q) { v_old[q] = field[p]; });
+    }
+
+    swap_zones(waves, lts);
+    for (int c = 0; c < lts->ncoarse; c++) {
+      update_velocities(waves, model, threads, lts->coarse[c], ctx);
+    }
+    swap_zones(waves, lts);
+
+    // Strip velocities of the first fine stress update, and the sums of the edge velocities
+    for (int f = 0; f < 3; f++) {
+      real* v_old = lts->v_old[f];
+      real* v_new = lts->v_new[f];
+      real* field = velocity[f];
+      const real w = weight(0);
+      for_strips(waves, lts, false, nthreads, [=](const int p, const int q) {
+        v_new[q] = field[p];
+        field[p] += (w - 1.0f) * (v_new[q] - v_old[q]);
+      });
+
+      real* v_sum = lts->v_sum[f];
+      for_strips(waves, lts, true, nthreads, [=](const int p, const int q) { v_sum[q] = 0.0f; });
+    }
+  } else {
+    // Strip stresses extrapolated by one more fine step, strip velocities interpolated. The
+    // changes are added to the fields, so a source in a strip is kept.
+    for (int f = 0; f < 6; f++) {
+      const real* now = lts->stress_now[f];
+      const real* prev = lts->stress_prev[f];
+      real* field = stress[f];
+      for_strips(waves, lts, false, nthreads, [=](const int p, const int q) {
+        field[p] += (now[q] - prev[q]) / m;
+      });
+    }
+    for (int f = 0; f < 3; f++) {
+      const real* v_old = lts->v_old[f];
+      const real* v_new = lts->v_new[f];
+      real* field = velocity[f];
+      const real dw = weight(j) - weight(j - 1);
+      for_strips(waves, lts, false, nthreads, [=](const int p, const int q) {
+        field[p] += dw * (v_new[q] - v_old[q]);
+      });
+    }
+  }
+
+  // Stresses are first extrapolated (j > 0) and velocities interpolated afterwards, so the
+  // velocity update sees the stresses of fine step j and the stress update the velocities
+  update_velocities(waves, model, threads, lts->fine, ctx);
+
+  for (int f = 0; f < 3; f++) {
+    real* v_sum = lts->v_sum[f];
+    const real* field = velocity[f];
+    for_strips(waves, lts, true, nthreads, [=](const int p, const int q) { v_sum[q] += field[p]; });
+  }
+
+  update_stresses(waves, model, threads, lts->fine, ctx);
+  image_free_surface(waves, columns, threads->nthreads[kCSXZ]);
+
+  if (j == m - 1) {
+    // Strips back at the coarse values: stresses at the start of the step, velocities at v_new
+    for (int f = 0; f < 6; f++) {
+      const real* now = lts->stress_now[f];
+      const real* prev = lts->stress_prev[f];
+      real* field = stress[f];
+      for_strips(waves, lts, false, nthreads, [=](const int p, const int q) {
+        field[p] -= (m - 1) * (now[q] - prev[q]) / m;
+      });
+    }
+    for (int f = 0; f < 3; f++) {
+      const real* v_old = lts->v_old[f];
+      const real* v_new = lts->v_new[f];
+      real* field = velocity[f];
+      const real dw = 1.0f - weight(m - 1);
+      for_strips(waves, lts, false, nthreads, [=](const int p, const int q) {
+        field[p] += dw * (v_new[q] - v_old[q]);
+      });
+
+      // Edge velocities averaged over the fine steps, centred on the coarse stress update
+      real* v_sum = lts->v_sum[f];
+      real* v_last = lts->v_last[f];
+      for_strips(waves, lts, true, nthreads, [=](const int p, const int q) {
+        v_last[q] = field[p];
+        field[p] = v_sum[q] / m;
+      });
+    }
+
+    swap_zones(waves, lts);
+    for (int c = 0; c < lts->ncoarse; c++) {
+      update_stresses(waves, model, threads, lts->coarse[c], ctx);
+    }
+    swap_zones(waves, lts);
+    image_free_surface(waves, columns, threads->nthreads[kCSXZ]);
+
+    for (int f = 0; f < 3; f++) {
+      const real* v_last = lts->v_last[f];
+      real* field = velocity[f];
+      for_strips(waves, lts, true, nthreads, [=](const int p, const int q) { field[p] = v_last[q]; });
+    }
+  }
+
+  auto t1 = std::chrono::high_resolution_clock::now();
+
+  const double compute = std::chrono::duration<double>(t1 - t0).count();
+  timing->compute += compute;
+
+  if (timing->print_steps) {
+    std::cout << "#Step " << ctx->it << ": compute " << compute << " s, exposed communication 0 s" << std::endl;
+  }
+}
+
+double lts_work_ratio(std::shared_ptr<lts_t> lts) {
+  if (lts->rate == 1) {
+    return 1.0;
+  }
+
+  double coarse = 0.0;
+  for (int c = 0; c < lts->ncoarse; c++) {
+    coarse += region_points(lts->coarse[c]);
+  }
+  const double fine = region_points(lts->fine);
+
+  return (fine + coarse / lts->rate) / (fine + coarse);
+}
+
+void free_lts_arrays(std::shared_ptr<lts_t> lts) {
+  if (lts->rate == 1) {
+    return;
+  }
+
+  for (int f = 0; f < 6; f++) {
+    free(lts->stress_now[f]);
+    free(lts->stress_prev[f]);
+  }
+  for (int f = 0; f < 3; f++) {
+    free(lts->v_old[f]);
+    free(lts->v_new[f]);
+    free(lts->v_sum[f]);
+    free(lts->v_last[f]);
+  }
+
+  if (lts->coarse_pml != NULL) {
+    free_pml_arrays(lts->coarse_pml);
+  }
+}
@@ -4,7 +4,9 @@
  * Updated: January 27, 2017
 */
 
+#include <climits>
 #include <cstdint>
+#include <cstdlib>
 #include <sstream>
 #include <iostream>
 #include <cmath>
@@ -14,15 +16,25 @@
 #include "common.h"
 #include "fd3d.h"
 #include "model3d.h"
+#include "decomp.h"
+#include "balance.h"
 
 #ifdef SAVE_RECEIVERS
 #include "receiver3d.h"
 #endif
 
 #include "differentiators.h"
-#include "step_forward.h"
+#include "step_engine.h"
 #include "source.h"
 #include "print.h"
+#include "env.h"
+#include "thread_table.h"
+#include "shots.h"
+#include "pml3d.h"
+#include "lts.h"
+#include "lax_wendroff.h"
+#include "activity.h"
+#include "displacement.h"
 
 #ifdef HDEEM
 #include <hdeem_cxx.hpp>
@@ -39,6 +51,10 @@
 
 int main(int argc, char** argv) {
 
+#ifdef HAVE_MPI
+  MPI_Init(&argc, &argv);
+#endif
+
 #ifdef HDEEM
   std::unique_ptr <hdeem::connection> hdeem;
   hdeem.reset(new hdeem::connection());
@@ -58,13 +74,12 @@ int main(int argc, char** argv) {
   uint64_t ucoref = 0;
 #endif
 
-  int ghost_cells = 0;
   int source_type = 0;
 
   const real kDz = 10.0;
   const real kDx = 10.0;
   const real kDy = 10.0;
-  const real kDt = 0.001;
+  const real kDt = 0.001;    // Time step unless OPTEWE_DT gives another one or "auto"
 
   std::stringstream string_buffer;
 
@@ -84,57 +99,14 @@ int main(int argc, char** argv) {
 #endif
   string_buffer >> source_type;
 
-  // Allocate source buffer
-  size_t source_num_bytes = sizeof(real) * Nt;
-  real* source = (real*) malloc(source_num_bytes);
-
-  // Setup of the wavefields
-  std::shared_ptr <dims_t> dims = size_setup(Nx, Ny, Nz, Nt, ghost_cells, kDz, kDx, kDy, kDt);
-  std::shared_ptr <fdm3d_t> waves = fdm3d_setup(dims);
-  std::shared_ptr <model3d_t> model = model_setup(dims);
-
-  // Setup for a uniform model (medium: solid)
-  const real kRho = 1000.0;
-  const real kVp = 2200.0;
-  const real kVs = 1000.0;
-
-  set_uniform_model(model, dims, kRho, kVp, kVs);
-
-  // Create source
-  const real kF0 = 5.0;
-  const real kT0 = 0.3;
-  const int x_source = waves->nx_ghost / 2;
-  const int y_source = waves->ny_ghost / 2;
-  const int z_source = waves->nz_ghost / 2;
-  const int source_dir = 1; // Force in x-direction
-
-  omp_set_num_threads(nthreads);
-  omp_set_dynamic(0);
-
-  #pragma omp parallel for num_threads(nthreads)
-  for (int i = 0; i < Nt; i++) {
-    real arg = kPI * kF0 * (kDt * i - kT0);
-    arg = arg * arg;
-    source[i] = 10e3f * (2.0f * arg - 1.0f) * std::exp(-arg);
-  }
-
-  // Receiver setup
-#ifdef SAVE_RECEIVERS
-  const bool vx = true;
-  const bool vy = true;
-  const bool vz = true;
-  const bool P = false;
-  int n = determine_receiver_value(Nz);
-  std::shared_ptr <receiver3d_t> receiver = receiver3d_setup(n, Nt, P, vx, vy, vz);
-  setup_receiver_for_verification(receiver, Nz, x_source, y_source, z_source);
+#ifdef ELASTIC_2D
+  // P-SV in the x-z plane, Ny on the command line is ignored
+  Ny = 1;
+  const std::string app_name = "OptEWE 2D [OpenMP]";
+#else
+  const std::string app_name = "OptEWE [OpenMP]";
 #endif
 
-  // Unpack values
-  const int nz_ghost = waves->nz_ghost;
-  const int nx_ghost = waves->nx_ghost;
-  const int ny_ghost = waves->ny_ghost;
-  const real dt = waves->dt;
-
   dvfs_init();
 
   x86_adapt_device_type core_type = X86_ADAPT_CPU;
@@ -154,487 +126,385 @@ int main(int argc, char** argv) {
   set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, ucoref);
 #endif
 
-  // Timer setup
-  auto timer_start = std::chrono::high_resolution_clock::now();
-
-  // Time stepping
-  for (int it = 0; it < Nt; it++) {
-
-    // Insert source
-    if (source_type == 1) {
-      insert_stress_source(waves, source, x_source, y_source, z_source, it);
-    } else if (source_type == 2) {
-      insert_force_source(waves, source, model, it, x_source, y_source, z_source, source_dir, 1);
-    } else {
-      insert_force_source(waves, source, model, it, x_source, y_source, z_source, source_dir, 2);
-    }
-
-    // Save receivers
-#ifdef SAVE_RECEIVERS
-    save_receivers(receiver, waves, it);
-#endif
-
-    // Compute Vx
-
-// dx_forward
-#ifdef DXF_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DXF_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DXF_UNCORE);
-#endif
-#ifdef DXF_HDEEM
-    auto dxf_time_start = std::chrono::high_resolution_clock::now();
-    auto dxf_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dx_forward(waves->del1, waves->sxx, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dx, nthreads);
-#ifdef DXF_HDEEM
-    auto dxf_time_end = std::chrono::high_resolution_clock::now();
-    double dxf_tstart = (double)dxf_timestamp.count();
-    double dxf_rtime = (dxf_time_end-dxf_time_start).count();
-    kernels.push_back(kernel("dxf", it, dxf_tstart, dxf_rtime));
-#endif
-
-// dz_backward
-#ifdef DZB_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DZB_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DZB_UNCORE);
-#endif
-#ifdef DZB_HDEEM
-    auto dzb_time_start = std::chrono::high_resolution_clock::now();
-    auto dzb_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dz_backward(waves->del2, waves->sxz, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dz, nthreads);
-#ifdef DZB_HDEEM
-    auto dzb_time_end = std::chrono::high_resolution_clock::now();
-    double dzb_tstart = (double)dzb_timestamp.count();
-    double dzb_rtime = (dzb_time_end-dzb_time_start).count();
-    kernels.push_back(kernel("dzb", it, dzb_tstart, dzb_rtime));
-#endif
-
-
-// dy_backward
-#ifdef DYB_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DYB_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DYB_UNCORE);
-#endif
-#ifdef DYB_HDEEM
-    auto dyb_time_start = std::chrono::high_resolution_clock::now();
-    auto dyb_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dy_backward(waves->del3, waves->sxy, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dy, nthreads);
-#ifdef DYB_HDEEM
-    auto dyb_time_end = std::chrono::high_resolution_clock::now();
-    double dyb_tstart = (double)dyb_timestamp.count();
-    double dyb_rtime = (dyb_time_end-dyb_time_start).count();
-    kernels.push_back(kernel("dyb", it, dyb_tstart, dyb_rtime));
-#endif
-
+  step_context_t ctx;
+  ctx.core_type = core_type;
+  ctx.uncore_type = uncore_type;
+  ctx.fd = fd;
+  ctx.numa_nodes = numa_nodes;
+  ctx.pstate_idx = pstate_idx;
+  ctx.uncore_min_idx = uncore_min_idx;
+  ctx.uncore_max_idx = uncore_max_idx;
+#ifdef HDEEM
+  ctx.kernels = &kernels;
+#endif
+
+  // Width of the PML layers around the grid, 0 keeps the rigid boundaries. The outermost
+  // half_length points of a layer are the stencil border, which is never computed.
+  int ghost_cells = env_int("OPTEWE_GHOST_BORDER", 0);
+  if (ghost_cells < 0) {
+    std::cerr << "#OPTEWE_GHOST_BORDER=" << ghost_cells << " is negative, keeping the rigid boundaries" << std::endl;
+    ghost_cells = 0;
+  } else if (ghost_cells > 0 && ghost_cells <= half_length) {
+    std::cerr << "#OPTEWE_GHOST_BORDER=" << ghost_cells << " leaves the layers no absorbing points, they take only the "
+              << half_length << "-point stencil border" << std::endl;
+  }
 
-// Compute_vx
-#ifdef CVX_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, CVX_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, CVX_UNCORE);
-#endif
-#ifdef CVX_HDEEM
-    auto cvx_time_start = std::chrono::high_resolution_clock::now();
-    auto cvx_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    compute_vx(waves->vx, model->rho, waves->del1, waves->del2, waves->del3, dt, nx_ghost, ny_ghost, nz_ghost, nthreads);
-#ifdef CVX_HDEEM
-    auto cvx_time_end = std::chrono::high_resolution_clock::now();
-    double cvx_tstart = (double)cvx_timestamp.count();
-    double cvx_rtime = (cvx_time_end-cvx_time_start).count();
-    kernels.push_back(kernel("cvx", it, cvx_tstart, cvx_rtime));
-#endif
+  // Free surface at the top of the grid, replacing the PML layer there
+  const bool free_surface = env_int("OPTEWE_FREE_SURFACE", 0);
 
+  std::shared_ptr <dims_t> global_dims = size_setup(Nx, Ny, Nz, Nt, ghost_cells, kDz, kDx, kDy, kDt, free_surface);
 
-    // Compute Vy
+  // Sampling along z grows geometrically from the top to the bottom of the grid by the ratio
+  // OPTEWE_DZ_STRETCH, so deeper and faster layers are sampled more coarsely
+  real dz_stretch = env_real("OPTEWE_DZ_STRETCH", 1.0);
+  if (!std::isfinite(dz_stretch) || dz_stretch <= 0.0) {
+    std::cerr << "#OPTEWE_DZ_STRETCH=" << env_string("OPTEWE_DZ_STRETCH", "")
+              << " is not a positive ratio, using uniform spacing" << std::endl;
+    dz_stretch = 1.0;
+  }
+  if (dz_stretch != 1.0 && global_dims->nz_ghost > 1) {
+    global_dims->dz_growth = std::pow(dz_stretch, 1.0 / (global_dims->nz_ghost - 1));
+  }
 
-// dy_foward
-#ifdef DYF_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DYF_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DYF_UNCORE);
-#endif
-#ifdef DYF_HDEEM
-    auto dyf_time_start = std::chrono::high_resolution_clock::now();
-    auto dyf_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dy_forward(waves->del1, waves->syy, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dy, nthreads);
-#ifdef DYF_HDEEM
-    auto dyf_time_end = std::chrono::high_resolution_clock::now();
-    double dyf_tstart = (double)dyf_timestamp.count();
-    double dyf_rtime = (dyf_time_end-dyf_time_start).count();
-    kernels.push_back(kernel("dyf", it, dyf_tstart, dyf_rtime));
-#endif
+  // Uniform model (medium: solid), or the layers of OPTEWE_MODEL_LAYERS
+  const real kRho = 1000.0;
+  const real kVp = 2200.0;
+  const real kVs = 1000.0;
+  std::shared_ptr <layers_t> layers = read_layers(env_string("OPTEWE_MODEL_LAYERS", ""), kRho, kVp, kVs);
 
-// dz_backward
-#ifdef DZB2_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DZB2_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DZB2_UNCORE);
-#endif
-#ifdef DZB2_HDEEM
-    auto dzb2_time_start = std::chrono::high_resolution_clock::now();
-    auto dzb2_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dz_backward(waves->del2, waves->syz, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dz, nthreads);
-#ifdef DZB2_HDEEM
-    auto dzb2_time_end = std::chrono::high_resolution_clock::now();
-    double dzb2_tstart = (double)dzb2_timestamp.count();
-    double dzb2_rtime = (dzb2_time_end-dzb2_time_start).count();
-    kernels.push_back(kernel("dzb2", it, dzb2_tstart, dzb2_rtime));
-#endif
+  // Receiver type of the README (OPTEWE_RECEIVER_TYPE, default 4: Vz, Vx and Vy). Pressure and the
+  // dilatation rate come from the stresses and their update, so the displacement engine does not
+  // record them, and the dilatation rate is sampled by the normal stress update of the leapfrog step.
+  bool pressure_receivers = false;
+  bool dilatation_receivers = false;
+#ifdef SAVE_RECEIVERS
+  int rectype = env_int("OPTEWE_RECEIVER_TYPE", 4);
+  bool recorded[kReceiverFields];
+  if (!receiver_type_fields(rectype, recorded)) {
+    std::cerr << "#Unknown receiver type " << rectype << ", recording Vz, Vx and Vy (type 4)" << std::endl;
+    rectype = 4;
+    receiver_type_fields(rectype, recorded);
+  }
+  pressure_receivers = recorded[0];
+  dilatation_receivers = recorded[4];
+#endif
+
+  // Order of the time stepping: 2 (leapfrog) or 4 (Lax-Wendroff corrections, see lax_wendroff.h)
+  std::shared_ptr <lax_wendroff_t> lw = lax_wendroff_setup(dilatation_receivers ? 2 : env_int("OPTEWE_TIME_ORDER", 2));
+
+  // Time step: the stable limit for the model, sampling, operator and time order scaled by
+  // OPTEWE_DT_SAFETY with OPTEWE_DT=auto, or a given one
+  const real dt_stable = stable_time_step(global_dims, layers, operator_weight_sum(), lax_wendroff_gain(lw->order));
+  const std::string dt_setting = env_string("OPTEWE_DT", "");
+  bool auto_dt = dt_setting == "auto";
+  real dt = kDt;
+  if (!auto_dt && !dt_setting.empty()) {
+    char* end = NULL;
+    const double value = std::strtod(dt_setting.c_str(), &end);
+    if (end == dt_setting.c_str() || *end != '\0' || !std::isfinite(value) || value <= 0.0) {
+      std::cerr << "#OPTEWE_DT=" << dt_setting << " is not a positive time step, using the stable one (auto)"
+                << std::endl;
+      auto_dt = true;
+    } else {
+      dt = value;
+    }
+  }
+  if (auto_dt) {
+    dt = dt_stable * env_real("OPTEWE_DT_SAFETY", 0.9);
+  }
+  if (dt > dt_stable) {
+    std::cerr << "#Time step " << dt << " is above the stable limit " << dt_stable
+              << " of the model, the run may blow up (OPTEWE_DT=auto picks a stable one)" << std::endl;
+  }
+  global_dims->dt = dt;
 
+  // With a record length (s) the number of steps follows from the time step
+  const real record_length = env_real("OPTEWE_RECORD_LENGTH", 0.0);
+  if (record_length > 0.0) {
+    Nt = (int) std::ceil(record_length / dt - 1e-6) + 1;
+    global_dims->nt = Nt;
+  }
 
-// dx_backward
-#ifdef DXB_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DXB_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DXB_UNCORE);
-#endif
-#ifdef DXB_HDEEM
-    auto dxb_time_start = std::chrono::high_resolution_clock::now();
-    auto dxb_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dx_backward(waves->del3, waves->sxy, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dx, nthreads);
-#ifdef DXB_HDEEM
-    auto dxb_time_end = std::chrono::high_resolution_clock::now();
-    double dxb_tstart = (double)dxb_timestamp.count();
-    double dxb_rtime = (dxb_time_end-dxb_time_start).count();
-    kernels.push_back(kernel("dxb", it, dxb_tstart, dxb_rtime));
-#endif
+  // Allocate source buffer
+  size_t source_num_bytes = sizeof(real) * Nt;
+  real* source = (real*) malloc(source_num_bytes);
 
+  // Create source, a Ricker wavelet with its peak frequency (Hz) from OPTEWE_SOURCE_FREQUENCY
+  const real f0 = env_real("OPTEWE_SOURCE_FREQUENCY", 5.0);
+  const real kT0 = 0.3;
+  const int x_source = global_dims->nx_ghost / 2;
+  const int y_source = global_dims->ny_ghost / 2;
+  const int z_source = global_dims->nz_ghost / 2;
+  const int source_dir = 1; // Force in x-direction
 
-// compute_vy
-#ifdef CVY_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, CVY_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, CVY_UNCORE);
-#endif
-#ifdef CVY_HDEEM
-    auto cvy_time_start = std::chrono::high_resolution_clock::now();
-    auto cvy_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    compute_vy(waves->vy, model->rho, waves->del1, waves->del2, waves->del3, dt, nx_ghost, ny_ghost, nz_ghost, nthreads);
-#ifdef CVY_HDEEM
-    auto cvy_time_end = std::chrono::high_resolution_clock::now();
-    double cvy_tstart = (double)cvy_timestamp.count();
-    double cvy_rtime = (cvy_time_end-cvy_time_start).count();
-    kernels.push_back(kernel("cvy", it, cvy_tstart, cvy_rtime));
-#endif
+  // PML parameters: frequency shift at the inner edge and stretching at the outer edge
+  const real kAmax = env_real("OPTEWE_PML_AMAX", kPI * f0);
+  const real kKmax = env_real("OPTEWE_PML_KMAX", 1.0);
 
+  // Lower-order operator in the PML layers (half length 2 to 4, 8 keeps the full one)
+  set_shell_order(env_int("OPTEWE_SHELL_ORDER", 4));
 
-    // Compute Vz
+  // Pressure-only updates in the fluid planes of the model (0: full elastic kernels everywhere)
+  set_fluid_path(env_int("OPTEWE_FLUID_PATH", 1));
 
-// dz_forward
-#ifdef DZF_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DZF_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DZF_UNCORE);
-#endif
-#ifdef DZF_HDEEM
-    auto dzf_time_start = std::chrono::high_resolution_clock::now();
-    auto dzf_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dz_forward(waves->del1, waves->szz, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dz, nthreads);
-#ifdef DZF_HDEEM
-    auto dzf_time_end = std::chrono::high_resolution_clock::now();
-    double dzf_tstart = (double)dzf_timestamp.count();
-    double dzf_rtime = (dzf_time_end-dzf_time_start).count();
-    kernels.push_back(kernel("dzf", it, dzf_tstart, dzf_rtime));
-#endif
+  omp_set_num_threads(nthreads);
+  omp_set_dynamic(0);
 
+  #pragma omp parallel for num_threads(nthreads)
+  for (int i = 0; i < Nt; i++) {
+    real arg = kPI * f0 * (dt * i - kT0);
+    arg = arg * arg;
+    source[i] = 10e3f * (2.0f * arg - 1.0f) * std::exp(-arg);
+  }
 
-// dx_backward
-#ifdef DXB2_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DXB2_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DXB2_UNCORE);
-#endif
-#ifdef DXB2_HDEEM
-    auto dxb2_time_start = std::chrono::high_resolution_clock::now();
-    auto dxb2_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dx_backward(waves->del2, waves->sxz, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dx, nthreads);
-#ifdef DXB2_HDEEM
-    auto dxb2_time_end = std::chrono::high_resolution_clock::now();
-    double dxb2_tstart = (double)dxb2_timestamp.count();
-    double dxb2_rtime = (dxb2_time_end-dxb2_time_start).count();
-    kernels.push_back(kernel("dxb2", it, dxb2_tstart, dxb2_rtime));
+  // Socket-split mode: independent simulations side by side, one per NUMA domain
+  const int nshots = env_int("OPTEWE_SHOTS", 1);
+  if (nshots > 1) {
+    int world_rank = 0;
+    int total_shots = nshots;
+#ifdef HAVE_MPI
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+    MPI_Allreduce(&nshots, &total_shots, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+#endif
+
+    std::shared_ptr <shots_t> shots = shots_setup(nshots, nthreads);
+    shots->first_shot = world_rank * nshots;
+    shots->spacing = env_int("OPTEWE_SHOT_SPACING", 0);
+    shots->shared_model = env_int("OPTEWE_SHARED_MODEL", 0);
+    shots->source_type = source_type;
+    shots->x_source = x_source;
+    shots->y_source = y_source;
+    shots->z_source = z_source;
+    shots->source_dir = source_dir;
+    shots->a_max = kAmax;
+    shots->k_max = kKmax;
+    shots->time_order = lw->order;
+#ifdef SAVE_RECEIVERS
+    shots->rectype = rectype;
 #endif
+    shots->activity_tile = env_int("OPTEWE_ACTIVITY_TILE", 0);
+    shots->activity_margin = env_int("OPTEWE_ACTIVITY_MARGIN", 2 * half_length);
 
-
-// dy_backward
-#ifdef DYB2_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DYB2_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DYB2_UNCORE);
+    double elapsed_seconds = run_shots(shots, global_dims, layers, source, &ctx);
+#ifdef HAVE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, &elapsed_seconds, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
 #endif
-#ifdef DYB2_HDEEM
-    auto dyb2_time_start = std::chrono::high_resolution_clock::now();
-    auto dyb2_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dy_backward(waves->del3, waves->syz, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dy, nthreads);
-#ifdef DYB2_HDEEM
-    auto dyb2_time_end = std::chrono::high_resolution_clock::now();
-    double dyb2_tstart = (double)dyb2_timestamp.count();
-    double dyb2_rtime = (dyb2_time_end-dyb2_time_start).count();
-    kernels.push_back(kernel("dyb2", it, dyb2_tstart, dyb2_rtime));
-#endif
-
 
-// compute_vz
-#ifdef CVZ_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, CVZ_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, CVZ_UNCORE);
-#endif
-#ifdef CVZ_HDEEM
-    auto cvz_time_start = std::chrono::high_resolution_clock::now();
-    auto cvz_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    compute_vz(waves->vz, model->rho, waves->del1, waves->del2, waves->del3, dt, nx_ghost, ny_ghost, nz_ghost, nthreads);
-#ifdef CVZ_HDEEM
-    auto cvz_time_end = std::chrono::high_resolution_clock::now();
-    double cvz_tstart = (double)cvz_timestamp.count();
-    double cvz_rtime = (cvz_time_end-cvz_time_start).count();
-    kernels.push_back(kernel("cvz", it, cvz_tstart, cvz_rtime));
+#ifdef HDEEM
+    hdeem->stop();
+    process_kernel_energy(*hdeem, kernels);
 #endif
 
+    dvfs_finalize();
 
-    // Compute Sxx, Syy, Szz
-
-// dz_backward
-#ifdef DZB3_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DZB3_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DZB3_UNCORE);
-#endif
-#ifdef DZB3_HDEEM
-    auto dzb3_time_start = std::chrono::high_resolution_clock::now();
-    auto dzb3_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dz_backward(waves->del1, waves->vz, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dz, nthreads);
-#ifdef DZB3_HDEEM
-    auto dzb3_time_end = std::chrono::high_resolution_clock::now();
-    double dzb3_tstart = (double)dzb3_timestamp.count();
-    double dzb3_rtime = (dzb3_time_end-dzb3_time_start).count();
-    kernels.push_back(kernel("dzb3", it, dzb3_tstart, dzb3_rtime));
-#endif
+    if (world_rank == 0) {
+      double mlups = (double)(total_shots)*(Nt)*((Nx * Ny * Nz) * 1e-6f) / elapsed_seconds;
+      print_application_info(app_name, source_type, Nx, Ny, Nz, Nt);
+      print_time_step_info(dt, dt_stable, lw->order);
+      print_perf_summary(mlups, elapsed_seconds);
+      print_shots_summary(total_shots, shots->nthreads, elapsed_seconds);
+    }
 
+    free(source);
+    free_shots_arrays(shots);
+    free_layers_arrays(layers);
 
-// dx_backward
-#ifdef DXB3_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DXB3_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DXB3_UNCORE);
-#endif
-#ifdef DXB3_HDEEM
-    auto dxb3_time_start = std::chrono::high_resolution_clock::now();
-    auto dxb3_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dx_backward(waves->del2, waves->vx, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dx, nthreads);
-#ifdef DXB3_HDEEM
-    auto dxb3_time_end = std::chrono::high_resolution_clock::now();
-    double dxb3_tstart = (double)dxb3_timestamp.count();
-    double dxb3_rtime = (dxb3_time_end-dxb3_time_start).count();
-    kernels.push_back(kernel("dxb3", it, dxb3_tstart, dxb3_rtime));
+#ifdef HAVE_MPI
+    MPI_Finalize();
 #endif
 
+    return 0;
+  }
 
-// dy_backward
-#ifdef DYB3_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DYB3_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DYB3_UNCORE);
-#endif
-#ifdef DYB3_HDEEM
-    auto dyb3_time_start = std::chrono::high_resolution_clock::now();
-    auto dyb3_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dy_backward(waves->del3, waves->vy, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dy, nthreads);
-#ifdef DYB3_HDEEM
-    auto dyb3_time_end = std::chrono::high_resolution_clock::now();
-    double dyb3_tstart = (double)dyb3_timestamp.count();
-    double dyb3_rtime = (dyb3_time_end-dyb3_time_start).count();
-    kernels.push_back(kernel("dyb3", it, dyb3_tstart, dyb3_rtime));
-#endif
+  // Setup of the wavefields. On a decomposed grid every rank only allocates its own part.
+  std::shared_ptr <decomp_t> decomp = decomp_setup(global_dims, nthreads);
+
+  // Parts of equal estimated cost, with the absorbing border weighted by OPTEWE_BORDER_COST
+  std::shared_ptr <cost_profile_t> cost_profile = estimate_cost_profile(global_dims, env_real("OPTEWE_BORDER_COST", 2.0));
+  apply_cost_profile(decomp, cost_profile);
+  free_cost_profile_arrays(cost_profile);
+
+  // Deep halos exchanged every m steps, either given or chosen from the measured links. The
+  // memory variables of the PML are not exchanged, so with a ghost border the halos stay shallow,
+  // and neither are the scratch fields of the fourth-order step.
+  const std::string halo_depth = (ghost_cells > 0 || lw->order == 4) ? "0" : env_string("OPTEWE_HALO_DEPTH", "0");
+  long depth = -1;    // Chosen from the measured links
+  if (halo_depth != "auto") {
+    char* end = NULL;
+    const long value = std::strtol(halo_depth.c_str(), &end, 10);
+    const int max_depth = max_halo_depth(decomp);
+    if (end == halo_depth.c_str() || *end != '\0' || value < 0 || value > max_depth) {
+      if (decomp->rank == 0) {
+        std::cerr << "#OPTEWE_HALO_DEPTH=" << halo_depth << " is not a halo depth";
+        if (max_depth < INT_MAX) {
+          std::cerr << " from 0 to " << max_depth << ", the deepest the parts of the grid can fill";
+        }
+        std::cerr << ", choosing one from the links (auto)" << std::endl;
+      }
+    } else {
+      depth = value;
+    }
+  }
+  set_halo_depth(decomp, (depth >= 0) ? (int) depth : select_halo_depth(decomp, nthreads, &ctx));
+
+  // Sources at the points of OPTEWE_SOURCE_ARRAY="x0 nx sx y0 ny sy z0 nz sz [weight]" (see
+  // source.h), or the single source at the centre
+  const std::string source_array = env_string("OPTEWE_SOURCE_ARRAY", "");
+
+  // Second-order displacement engine with half the wave field memory (see displacement.h), for
+  // rigid boundaries on a single rank with leapfrog steps, receivers of the velocities and the
+  // single source
+  const std::string engine = env_string("OPTEWE_ENGINE", "velocity-stress");
+  std::string engine_blocker;
+  if (engine != "velocity-stress" && engine != "displacement") {
+    engine_blocker = "is not an engine (velocity-stress or displacement)";
+  } else if (engine == "displacement") {
+    if (ghost_cells > 0) {
+      engine_blocker = "needs rigid boundaries, not OPTEWE_GHOST_BORDER";
+    } else if (free_surface) {
+      engine_blocker = "has no free surface";
+    } else if (lw->order != 2) {
+      engine_blocker = "steps with leapfrog only, not OPTEWE_TIME_ORDER=4";
+    } else if (decomp->nranks > 1) {
+      engine_blocker = "runs on a single rank";
+    } else if (pressure_receivers || dilatation_receivers) {
+      engine_blocker = "records the velocities only, not this OPTEWE_RECEIVER_TYPE";
+    } else if (!source_array.empty()) {
+      engine_blocker = "has the single source only, not OPTEWE_SOURCE_ARRAY";
+    }
+  }
+  if (!engine_blocker.empty() && decomp->rank == 0) {
+    std::cerr << "#OPTEWE_ENGINE=" << engine << " " << engine_blocker << ", using the velocity-stress engine"
+              << std::endl;
+  }
+  const bool displacement_engine = engine == "displacement" && engine_blocker.empty();
 
+  std::shared_ptr <dims_t> dims = local_dims(decomp, global_dims);
+  std::shared_ptr <fdm3d_t> waves = fdm3d_setup(dims, !displacement_engine);
+  std::shared_ptr <model3d_t> model = model_setup(dims);
 
-// compute_sxx_syy_szz
-#ifdef CSXXSYYSZZ_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, CSXXSYYSZZ_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, CSXXSYYSZZ_UNCORE);
-#endif
-#ifdef CSXXSYYSZZ_HDEEM
-    auto csxxsyyszz_time_start = std::chrono::high_resolution_clock::now();
-    auto csxxsyyszz_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    compute_sxx_syy_szz(waves->sxx, waves->syy, waves->szz, waves->del1, waves->del2, waves->del3,
-                        model->lambda, model->mu, dt, nx_ghost, ny_ghost, nz_ghost, nthreads);
-#ifdef CSXXSYYSZZ_HDEEM
-    auto csxxsyyszz_time_end = std::chrono::high_resolution_clock::now();
-    double csxxsyyszz_tstart = (double)csxxsyyszz_timestamp.count();
-    double csxxsyyszz_rtime = (csxxsyyszz_time_end-csxxsyyszz_time_start).count();
-    kernels.push_back(kernel("csxxsyyszz", it, csxxsyyszz_tstart, csxxsyyszz_rtime));
-#endif
+  set_layered_model(model, dims, layers);
+  pml_setup(waves, decomp, layers_vp_max(layers), kAmax, kKmax);
 
+  // Stresses of OPTEWE_DISPLACEMENT_SLAB planes at a time, plus the reach of the stencils
+  std::shared_ptr <displacement_t> disp = displacement_engine ? displacement_setup(waves, env_int("OPTEWE_DISPLACEMENT_SLAB", 16)) : nullptr;
 
-    // Compute Sxy
+  // Entries of the source points this rank stores, injected with one scatter per field
+  std::shared_ptr <sources_t> sources = sources_setup(source_array, global_dims, source_type, source_dir,
+                                                      x_source, y_source, z_source);
+  locate_sources(sources, waves, model);
 
-// dy_forward
-#ifdef DYF2_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DYF2_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DYF2_UNCORE);
-#endif
-#ifdef DYF2_HDEEM
-    auto dyf2_time_start = std::chrono::high_resolution_clock::now();
-    auto dyf2_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dy_forward(waves->del1, waves->vx, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dy, nthreads);
-#ifdef DYF2_HDEEM
-    auto dyf2_time_end = std::chrono::high_resolution_clock::now();
-    double dyf2_tstart = (double)dyf2_timestamp.count();
-    double dyf2_rtime = (dyf2_time_end-dyf2_time_start).count();
-    kernels.push_back(kernel("dyf2", it, dyf2_tstart, dyf2_rtime));
+  // Receiver setup
+#ifdef SAVE_RECEIVERS
+  // Receivers at the positions of OPTEWE_RECEIVER_FILE (see receiver_geometry.h), or around the source
+  const std::string receiver_file = env_string("OPTEWE_RECEIVER_FILE", "");
+  std::shared_ptr <receiver_geometry_t> geometry = receiver_file.empty() ? nullptr : read_receiver_geometry(receiver_file, global_dims, nthreads);
+  int n = geometry ? geometry->n : determine_receiver_value(Nz);
+  // With OPTEWE_TRACE_FILE the traces stream to a binary file as the run goes on, and are not kept
+  const std::string trace_file = env_string("OPTEWE_TRACE_FILE", "");
+  std::shared_ptr <receiver3d_t> receiver = receiver3d_setup(n, Nt, rectype, trace_file.empty());
+  if (geometry) {
+    setup_receiver_geometry(receiver, geometry, x_source, y_source, z_source);
+    free_receiver_geometry_arrays(geometry);
+  } else {
+    setup_receiver_for_verification(receiver, Nz, x_source, y_source, z_source);
+  }
+  set_receiver_sources(receiver, sources->npoints, sources->x, sources->y, sources->z);
+  if (!trace_file.empty()) {
+    stream_receivers(receiver, decomp, dims, trace_file);
+  }
 #endif
 
+  // Per-kernel thread counts, either tuned now or read from a table file
+  std::shared_ptr <thread_table_t> threads = thread_table_setup(nthreads);
+  const std::string thread_table_file = env_string("OPTEWE_THREAD_TABLE", "");
 
-// dx_forward
-#ifdef DXF2_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DXF2_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DXF2_UNCORE);
-#endif
-#ifdef DXF2_HDEEM
-    auto dxf2_time_start = std::chrono::high_resolution_clock::now();
-    auto dxf2_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dx_forward(waves->del2, waves->vy, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dx, nthreads);
-#ifdef DXF2_HDEEM
-    auto dxf2_time_end = std::chrono::high_resolution_clock::now();
-    double dxf2_tstart = (double)dxf2_timestamp.count();
-    double dxf2_rtime = (dxf2_time_end-dxf2_time_start).count();
-    kernels.push_back(kernel("dxf2", it, dxf2_tstart, dxf2_rtime));
-#endif
-
+  // The tuner times the velocity-stress kernels, whose stress fields the displacement engine does not have
+  const bool tune_threads = env_int("OPTEWE_TUNE_THREADS", 0);
+  if (tune_threads && displacement_engine) {
+    std::cerr << "#OPTEWE_TUNE_THREADS needs the stress fields of the velocity-stress engine, the threads are not tuned"
+              << std::endl;
+  }
 
-// compute_sxy
-#ifdef CSXY_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, CSXY_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, CSXY_UNCORE);
-#endif
-#ifdef CSXY_HDEEM
-    auto csxy_time_start = std::chrono::high_resolution_clock::now();
-    auto csxy_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    compute_sxy(waves->sxy, model->mu, waves->del1, waves->del2, dt, nx_ghost, ny_ghost, nz_ghost, nthreads);
-#ifdef CSXY_HDEEM
-    auto csxy_time_end = std::chrono::high_resolution_clock::now();
-    double csxy_tstart = (double)csxy_timestamp.count();
-    double csxy_rtime = (csxy_time_end-csxy_time_start).count();
-    kernels.push_back(kernel("csxy", it, csxy_tstart, csxy_rtime));
-#endif
+  if (tune_threads && !displacement_engine) {
+    tune_thread_table(threads, waves, model, nthreads, env_real("OPTEWE_THREAD_TOLERANCE", 0.05));
+    if (decomp->rank == 0) {
+      write_thread_table(threads, thread_table_file.empty() ? "threads.cfg" : thread_table_file);
+    }
+  } else if (!thread_table_file.empty()) {
+    read_thread_table(threads, thread_table_file, nthreads);
+  }
+  if (!park_idle_threads(threads, nthreads) && decomp->rank == 0) {
+    std::cerr << "#Some kernels run on fewer threads, whose idle threads spin unless OMP_WAIT_POLICY=passive is set"
+              << std::endl;
+  }
 
+  // Optional prefetch threads on the SMT siblings of the derivative kernels
+  set_smt_prefetch(env_int("OPTEWE_SMT_PREFETCH", 0));
 
-    // Compute Syz
+  // Interior and boundary slabs of the local grid, and the split of the step time
+  std::shared_ptr <step_regions_t> regions = step_regions_setup(decomp, waves);
+  std::shared_ptr <step_timing_t> timing = step_timing_setup(env_int("OPTEWE_STEP_TIMING", 0));
 
-// dz_forward
-#ifdef DZF2_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DZF2_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DZF2_UNCORE);
-#endif
-#ifdef DZF2_HDEEM
-    auto dzf2_time_start = std::chrono::high_resolution_clock::now();
-    auto dzf2_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dz_forward(waves->del1, waves->vy, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dz, nthreads);
-#ifdef DZF2_HDEEM
-    auto dzf2_time_end = std::chrono::high_resolution_clock::now();
-    double dzf2_tstart = (double)dzf2_timestamp.count();
-    double dzf2_rtime = (dzf2_time_end-dzf2_time_start).count();
-    kernels.push_back(kernel("dzf2", it, dzf2_tstart, dzf2_rtime));
-#endif
+  // Local time stepping: planes that are stable with OPTEWE_LTS_RATE times the time step are
+  // only updated every that many steps (leapfrog only, and not with dilatation rate receivers)
+  std::shared_ptr <lts_t> lts = lts_setup(waves, model, decomp, (lw->order == 2 && !displacement_engine && !dilatation_receivers)
+                                          ? env_int("OPTEWE_LTS_RATE", 1) : 1);
 
+  // Activity mask: tiles of OPTEWE_ACTIVITY_TILE points are skipped until the fastest wave from
+  // the sources, plus OPTEWE_ACTIVITY_MARGIN points, can reach them (0: no mask)
+  activity_setup(waves, global_dims, x_source, y_source, z_source, layers_vp_max(layers),
+                 displacement_engine ? 0 : env_int("OPTEWE_ACTIVITY_TILE", 0), env_int("OPTEWE_ACTIVITY_MARGIN", 2 * half_length), nthreads);
+  for (int p = 0; p < sources->npoints; p++) {
+    add_activity_source(waves, sources->x[p], sources->y[p], sources->z[p]);
+  }
 
-// dy_forward
-#ifdef DYF3_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DYF3_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DYF3_UNCORE);
-#endif
-#ifdef DYF3_HDEEM
-    auto dyf3_time_start = std::chrono::high_resolution_clock::now();
-    auto dyf3_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dy_forward(waves->del2, waves->vz, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dy, nthreads);
-#ifdef DYF3_HDEEM
-    auto dyf3_time_end = std::chrono::high_resolution_clock::now();
-    double dyf3_tstart = (double)dyf3_timestamp.count();
-    double dyf3_rtime = (dyf3_time_end-dyf3_time_start).count();
-    kernels.push_back(kernel("dyf3", it, dyf3_tstart, dyf3_rtime));
+#ifdef SAVE_RECEIVERS
+  // The velocity and normal stress updates of the leapfrog step sample the receivers as they
+  // finish each plane (OPTEWE_FUSED_RECEIVERS=0: gather them after the step)
+  const bool fused_receivers = env_int("OPTEWE_FUSED_RECEIVERS", 1) && !displacement_engine && lw->order == 2
+                               && lts->rate == 1;
+  fuse_receivers(receiver, fused_receivers, fused_receivers && !free_surface);
 #endif
 
+  // Re-partitioning from the measured kernel times of the ranks, checked every interval steps
+  const int rebalance_interval = env_int("OPTEWE_REBALANCE_INTERVAL", 0);
+  const real rebalance_tolerance = env_real("OPTEWE_REBALANCE_TOLERANCE", 0.1);
+  double interval_start = 0.0;
 
-// compute_syz
-#ifdef CSYZ_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, CSYZ_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, CSYZ_UNCORE);
-#endif
-#ifdef CSYZ_HDEEM
-    auto csyz_time_start = std::chrono::high_resolution_clock::now();
-    auto csyz_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    compute_syz(waves->syz, model->mu, waves->del1, waves->del2, dt, nx_ghost, ny_ghost, nz_ghost, nthreads);
-#ifdef CSYZ_HDEEM
-    auto csyz_time_end = std::chrono::high_resolution_clock::now();
-    double csyz_tstart = (double)csyz_timestamp.count();
-    double csyz_rtime = (csyz_time_end-csyz_time_start).count();
-    kernels.push_back(kernel("csyz", it, csyz_tstart, csyz_rtime));
-#endif
+  // Timer setup
+  auto timer_start = std::chrono::high_resolution_clock::now();
 
+  // Time stepping
+  for (int it = 0; it < Nt; it++) {
 
-    // Compute Sxz
+    // Insert source
+    if (displacement_engine) {
+      insert_displacement_source(disp, waves, model, source, source_type, x_source, y_source, z_source, source_dir, it);
+    } else {
+      inject_sources(sources, waves, source, it);
+    }
 
-// dx_forward
-#ifdef DXF3_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DXF3_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DXF3_UNCORE);
-#endif
-#ifdef DXF3_HDEEM
-    auto dxf3_time_start = std::chrono::high_resolution_clock::now();
-    auto dxf3_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dx_forward(waves->del1, waves->vz, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dx, nthreads);
-#ifdef DXF3_HDEEM
-    auto dxf3_time_end = std::chrono::high_resolution_clock::now();
-    double dxf3_tstart = (double)dxf3_timestamp.count();
-    double dxf3_rtime = (dxf3_time_end-dxf3_time_start).count();
-    kernels.push_back(kernel("dxf3", it, dxf3_tstart, dxf3_rtime));
+    // Save receivers
+#ifdef SAVE_RECEIVERS
+    save_receivers(receiver, waves, decomp, it, nthreads);
 #endif
 
+    ctx.it = it;
 
-// dz_forward
-#ifdef DZF3_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, DZF3_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, DZF3_UNCORE);
-#endif
-#ifdef DZF3_HDEEM
-    auto dzf3_time_start = std::chrono::high_resolution_clock::now();
-    auto dzf3_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    dz_forward(waves->del2, waves->vx, nx_ghost, ny_ghost, nz_ghost, 1.0f / waves->dz, nthreads);
-#ifdef DZF3_HDEEM
-    auto dzf3_time_end = std::chrono::high_resolution_clock::now();
-    double dzf3_tstart = (double)dzf3_timestamp.count();
-    double dzf3_rtime = (dzf3_time_end-dzf3_time_start).count();
-    kernels.push_back(kernel("dzf3", it, dzf3_tstart, dzf3_rtime));
-#endif
-
+    // The coarse zones of local time stepping advance rate steps at once
+    advance_activity(waves, (it + lts->rate) * dt);
 
-// compute_sxz
-#ifdef CSXZ_DVFS
-    set_all_core_freq(core_type, fd, pstate_idx, CSXZ_CORE);
-    set_uncore_freq(uncore_type, numa_nodes, uncore_min_idx, uncore_max_idx, CSXZ_UNCORE);
-#endif
-#ifdef CSXZ_HDEEM
-    auto csxz_time_start = std::chrono::high_resolution_clock::now();
-    auto csxz_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
-#endif
-    compute_sxz(waves->sxz, model->mu, waves->del1, waves->del2, dt, nx_ghost, ny_ghost, nz_ghost, nthreads);
-#ifdef CSXZ_HDEEM
-    auto csxz_time_end = std::chrono::high_resolution_clock::now();
-    double csxz_tstart = (double)csxz_timestamp.count();
-    double csxz_rtime = (csxz_time_end-csxz_time_start).count();
-    kernels.push_back(kernel("csxz", it, csxz_tstart, csxz_rtime));
-#endif
+    // Velocities and stresses, overlapping the halo exchange with the interior
+    if (displacement_engine) {
+      displacement_time_step(waves, model, disp, nthreads, timing);
+    } else if (lts->rate > 1) {
+      lts_time_step(waves, model, threads, lts, &ctx, timing);
+    } else if (lw->order == 4) {
+      lax_wendroff_time_step(waves, model, threads, decomp, lw, &ctx, timing);
+    } else {
+      time_step(waves, model, threads, decomp, regions, &ctx, timing);
+    }
 
     // Write out snapshot of wave fields
 #ifdef VTK
@@ -643,14 +513,36 @@ int main(int argc, char** argv) {
       filename_sstream << "waves_test_" << it;
       std::string filename;
       filename_sstream >> filename;
-      export_to_vtk(waves, filename);
+      export_to_vtk(waves, decomp, filename);
     }
 #endif
 
+    // Move the cuts when the ranks drift apart
+    if (rebalance_interval > 0 && !displacement_engine && (it + 1) % rebalance_interval == 0) {
+      if (rebalance(decomp, global_dims, waves, model, timing->compute - interval_start, rebalance_tolerance)) {
+        regions = step_regions_setup(decomp, waves);
+        locate_sources(sources, waves, model);
+#ifdef SAVE_RECEIVERS
+        locate_receivers(receiver, waves, decomp, nthreads);
+#endif
+      }
+      interval_start = timing->compute;
+    }
+
   }
 
   auto timer_stop = std::chrono::high_resolution_clock::now();
-  double elapsed_seconds = (timer_stop - timer_start).count() * 1e-9f;
+  double elapsed_seconds = max_over_ranks(decomp, (timer_stop - timer_start).count() * 1e-9f);
+  double exposed_seconds = max_over_ranks(decomp, timing->exposed);
+  double activity_ratio = (waves->activity != NULL) ? max_over_ranks(decomp, activity_work_ratio(waves->activity)) : 1.0;
+  real passes[2];
+  kernel_passes(waves, model, passes);
+  reduce_to_root(decomp, passes, 2);
+
+  // Grid-sized wave fields of the engine, without the memory variables of the PML
+  const double plane_points = (double) waves->nx_ghost * waves->ny_ghost;
+  real wave_bytes = displacement_engine ? displacement_bytes(waves, disp) : sizeof(real) * 12.0 * plane_points * waves->nz_ghost;
+  reduce_to_root(decomp, &wave_bytes, 1);
 
 #ifdef HDEEM
   hdeem->stop();
@@ -662,29 +554,61 @@ int main(int argc, char** argv) {
 
   // Write to receiver file
 #ifdef SAVE_RECEIVERS
-  write_receiver_file(receiver, dims);
+  gather_receivers(receiver, decomp, nthreads);
+  if (decomp->rank == 0 && receiver->writer == NULL) {
+    write_receiver_file(receiver, dims, nthreads);
+  }
 #endif
 
   // Print app statistics
-  double mlups = (double)(Nt)*((Nx * Ny * Nz) * 1e-6f) / elapsed_seconds;
-  print_application_info("OptEWE [OpenMP]", source_type, Nx, Ny, Nz, Nt);
-  print_perf_summary(mlups, elapsed_seconds);
+  if (decomp->rank == 0) {
+    double mlups = (double)(Nt)*((Nx * Ny * Nz) * 1e-6f) / elapsed_seconds;
+    print_application_info(app_name, source_type, Nx, Ny, Nz, Nt);
+    print_time_step_info(dt, dt_stable, lw->order);
+    print_perf_summary(mlups, elapsed_seconds);
 
 #pragma omp parallel
-  {
-    unsigned int num_threads = omp_get_num_threads();
+    {
+      unsigned int num_threads = omp_get_num_threads();
 #pragma omp single
-    print_omp_info(num_threads);
+      print_omp_info(num_threads);
+    }
+    print_thread_table(threads);
+    print_decomp_info(decomp->nranks, decomp->procs, decomp->depth);
+    if (lts->rate > 1) {
+      print_lts_info(lts->rate, lts->fine_k0, lts->fine_k1, lts_work_ratio(lts));
+    }
+    if (waves->activity != NULL) {
+      print_activity_info(waves->activity->tile, activity_ratio);
+    }
+    print_engine_info(displacement_engine ? "displacement" : "velocity-stress", wave_bytes);
+    if (passes[0] < passes[1] && !displacement_engine) {
+      print_fluid_info(passes[0] / passes[1]);
+    }
+    print_exposed_communication(exposed_seconds, Nt);
   }
 
   // Clear memory
   free(source);
+  free_sources_arrays(sources);
+  free_lts_arrays(lts);
+  free_lax_wendroff_arrays(lw);
   free_wave_arrays(waves);
+  if (displacement_engine) {
+    free_displacement_arrays(disp);
+  }
   free_model_arrays(model);
+  free_layers_arrays(layers);
 
 #ifdef SAVE_RECEIVERS
   free_receiver_arrays(receiver);
 #endif
 
+  free_decomp_arrays(decomp);
+
+#ifdef HAVE_MPI
+  MPI_Finalize();
+#endif
+
   return 0;
 }
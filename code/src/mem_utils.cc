@@ -17,4 +17,15 @@ void zero_data(real* buffer, const int nx, const int ny, const int nz) {
   }
 }
 
+// Same as above, but only wakes nthreads threads of the pool
+void zero_data(real* buffer, const int nx, const int ny, const int nz, const int nthreads) {
 
+#pragma omp parallel for num_threads(nthreads)
+  for (int k = 0; k < nz; k++) {
+    for (int j = 0; j < ny; j++) {
+      for (int i = 0; i < nx; i++) {
+        buffer[idx(nx, ny, i, j, k)] = 0.f;
+      }
+    }
+  }
+}
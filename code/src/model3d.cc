@@ -3,7 +3,14 @@
  * Date: September 10, 2016
  */
 
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
 #include "model3d.h"
+#include "differentiators.h"
 
 // Initialization of the model structure
 std::shared_ptr<model3d_t> model_setup(std::shared_ptr<dims_t> dims) {
@@ -26,6 +33,10 @@ std::shared_ptr<model3d_t> model_setup(std::shared_ptr<dims_t> dims) {
   zero_data(model->lambda, dims->nx_ghost, dims->ny_ghost, dims->nz_ghost);
   zero_data(model->mu, dims->nx_ghost, dims->ny_ghost, dims->nz_ghost);
 
+  // No plane is fluid until the parameters are set
+  model->shear_free = (char*) calloc(dims->nz_ghost, sizeof(char));
+  model->normal_only = (char*) calloc(dims->nz_ghost, sizeof(char));
+
   // Assign bool values
   model->Vp = 0;
   model->Vs = 0;
@@ -54,6 +65,160 @@ void set_uniform_model(std::shared_ptr<model3d_t> model,
     model->lambda[i] = lambda;
     model->mu[i] = mu;
   }
+
+  classify_fluid_planes(model, dims);
+}
+
+std::shared_ptr<layers_t> read_layers(const std::string& description,
+                                      const real _rho,
+                                      const real _vp,
+                                      const real _vs) {
+
+  std::vector<real> values;
+  std::istringstream stream(description);
+  real value;
+  while (stream >> value) {
+    values.push_back(value);
+  }
+
+  // Whole groups of numbers only, with tops increasing below the first layer, a positive density
+  // and P-velocity and no negative S-velocity
+  std::string problem;
+  if (!stream.eof()) {
+    problem = "has a value that is not a number";
+  } else if (values.size() % 4 != 0) {
+    problem = "does not hold four values per layer";
+  }
+  for (size_t l = 0; l < values.size() / 4 && problem.empty(); l++) {
+    const real previous_top = (l > 1) ? values[4 * (l - 1)] : 0.0;    // The first layer starts at 0
+    if (l > 0 && values[4 * l] <= previous_top) {
+      problem = "has tops that do not increase";
+    } else if (values[4 * l + 1] <= 0.0 || values[4 * l + 2] <= 0.0 || values[4 * l + 3] < 0.0) {
+      problem = "has a layer without a positive density and P-velocity, or with a negative S-velocity";
+    }
+  }
+  if (!problem.empty()) {
+    std::cerr << "#Layer description \"" << description << "\" " << problem << ", using the uniform model"
+              << std::endl;
+    values.clear();
+  }
+
+  // The top layer always starts at the top of the grid
+  if (values.size() < 4) {
+    values = {0.0, _rho, _vp, _vs};
+  }
+  values[0] = 0.0;
+
+  std::shared_ptr<layers_t> layers((layers_t*) malloc(sizeof(layers_t)), free_ptr());
+
+  layers->n = values.size() / 4;
+  layers->top = (real*) malloc(sizeof(real) * layers->n);
+  layers->rho = (real*) malloc(sizeof(real) * layers->n);
+  layers->vp = (real*) malloc(sizeof(real) * layers->n);
+  layers->vs = (real*) malloc(sizeof(real) * layers->n);
+
+  for (int l = 0; l < layers->n; l++) {
+    layers->top[l] = values[4 * l];
+    layers->rho[l] = values[4 * l + 1];
+    layers->vp[l] = values[4 * l + 2];
+    layers->vs[l] = values[4 * l + 3];
+  }
+
+  return layers;
+}
+
+real layers_vp_max(std::shared_ptr<layers_t> layers) {
+  return *std::max_element(layers->vp, layers->vp + layers->n);
+}
+
+// Layer the given depth falls in
+static int layer_at(std::shared_ptr<layers_t> layers, const real depth) {
+  int l = 0;
+  while (l + 1 < layers->n && layers->top[l + 1] <= depth) {
+    l++;
+  }
+  return l;
+}
+
+real stable_time_step(std::shared_ptr<dims_t> dims, std::shared_ptr<layers_t> layers,
+                      const real weight_sum, const real safety) {
+  real stability_max = 0.0;
+  const real inv_dy = (half_length_y > 0) ? 1.0 / dims->dy : 0.0;    // No y-derivatives in the x-z plane
+
+  for (int k = 0; k < dims->nz_ghost; k++) {
+    const real vp = layers->vp[layer_at(layers, plane_depth(dims, dims->z0 + k))];
+    const real h_z = std::min(plane_spacing(dims, dims->z0 + k), plane_spacing(dims, dims->z0 + k + 0.5));
+    const real inv_h = std::sqrt(1.0 / (dims->dx * dims->dx) + inv_dy * inv_dy + 1.0 / (h_z * h_z));
+
+    stability_max = std::max(stability_max, vp * weight_sum * inv_h);
+  }
+
+  return safety / stability_max;
+}
+
+// Every z-plane takes the parameters of the layer its depth falls in
+void set_layered_model(std::shared_ptr<model3d_t> model,
+                       std::shared_ptr<dims_t> dims,
+                       std::shared_ptr<layers_t> layers) {
+  const int plane = (dims->nx_ghost) * (dims->ny_ghost);
+
+  for (int k = 0; k < dims->nz_ghost; k++) {
+    const int l = layer_at(layers, plane_depth(dims, dims->z0 + k));
+
+    // Compute lambda and mu
+    real mu = layers->rho[l] * layers->vs[l] * layers->vs[l];
+    real lambda = layers->vp[l] * layers->vp[l] * layers->rho[l] - 2 * mu;
+
+    for (int i = k * plane; i < (k + 1) * plane; i++) {
+      model->rho[i] = layers->rho[l];
+      model->lambda[i] = lambda;
+      model->mu[i] = mu;
+    }
+  }
+
+  classify_fluid_planes(model, dims);
+}
+
+void classify_fluid_planes(std::shared_ptr<model3d_t> model, std::shared_ptr<dims_t> dims) {
+  const int nz = dims->nz_ghost;
+  const long plane = (long) dims->nx_ghost * dims->ny_ghost;
+
+  std::vector<char> fluid(nz, 1);
+  for (int k = 0; k < nz; k++) {
+    for (long p = k * plane; p < (k + 1) * plane; p++) {
+      if (model->mu[p] != 0.0) {
+        fluid[k] = 0;
+        break;
+      }
+    }
+  }
+
+  for (int k = 0; k < nz; k++) {
+    model->shear_free[k] = fluid[k] && (k + 1 == nz || fluid[k + 1]);
+  }
+
+  // The planes above a free surface hold the mirrored shear stresses of the planes below it
+  if (dims->free_surface && dims->z0 == 0) {
+    for (int m = 1; m <= half_length && half_length + m - 1 < nz; m++) {
+      model->shear_free[half_length - m] = model->shear_free[half_length + m - 1];
+    }
+  }
+
+  // The z-derivatives of the shear stresses reach half_length planes up and down
+  for (int k = 0; k < nz; k++) {
+    bool normal_only = true;
+    for (int m = std::max(k - half_length, 0); m < std::min(k + half_length, nz); m++) {
+      normal_only = normal_only && model->shear_free[m];
+    }
+    model->normal_only[k] = normal_only;
+  }
+}
+
+void free_layers_arrays(std::shared_ptr<layers_t> layers) {
+  free(layers->top);
+  free(layers->rho);
+  free(layers->vp);
+  free(layers->vs);
 }
 
 void free_model_arrays(std::shared_ptr<model3d_t> model) {
@@ -61,4 +226,6 @@ void free_model_arrays(std::shared_ptr<model3d_t> model) {
   free(model->rho);
   free(model->lambda);
   free(model->mu);
+  free(model->shear_free);
+  free(model->normal_only);
 }
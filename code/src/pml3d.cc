@@ -0,0 +1,246 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: C-PML absorbing boundaries with memory variables in the ghost_border slabs only.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "pml3d.h"
+#include "differentiators.h"
+
+// Theoretical reflection coefficient of the layer at normal incidence
+constexpr real kReflection = 1e-3;
+
+// Axis of every derivative kernel (-1 for the update kernels), and whether its result lies at
+// half grid positions. Forward derivatives are taken of fields at integer positions along
+// their axis and give values at the half positions in between, backward ones the reverse.
+static const int kAxis[kNumKernels] = {
+  0, 2, 1, -1,
+  1, 2, 0, -1,
+  2, 0, 1, -1,
+  2, 0, 1, -1,
+  1, 0, -1,
+  2, 1, -1,
+  0, 2, -1
+};
+
+static const int kHalf[kNumKernels] = {
+  1, 0, 0, 0,
+  1, 0, 0, 0,
+  1, 0, 0, 0,
+  0, 0, 0, 0,
+  1, 1, 0,
+  1, 1, 0,
+  1, 1, 0
+};
+
+// Box of the layer at one side of axis d, and the size of its memory variables
+static region_t layer_box(const pml3d_t* pml, const int d, const int side, int* size) {
+  int lo[3] = {0, 0, 0};
+  int hi[3] = {pml->n[0], pml->n[1], pml->n[2]};
+  lo[d] = side ? pml->hi_begin[d] : 0;
+  hi[d] = side ? pml->n[d] : pml->lo_end[d];
+
+  for (int e = 0; e < 3; e++) {
+    size[e] = hi[e] - lo[e];
+  }
+
+  return make_region(lo[0], hi[0], lo[1], hi[1], lo[2], hi[2]);
+}
+
+void pml_setup(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<decomp_t> decomp,
+               const real vp_max, const real a_max, const real k_max) {
+
+  if (waves->ghost_border == 0) {
+    return;
+  }
+
+  pml3d_t* pml = (pml3d_t*) malloc(sizeof(pml3d_t));
+
+  pml->width = waves->ghost_border;
+  pml->vp_max = vp_max;
+  pml->a_max = a_max;
+  pml->k_max = k_max;
+
+  const int n[3] = {waves->nx_ghost, waves->ny_ghost, waves->nz_ghost};
+  const real h[3] = {waves->dx, waves->dy, 0.0};
+
+  // The outermost half_length points are never computed, the profiles reach their maximum there
+  const real thickness = std::max(pml->width - half_length, 1);
+
+  for (int d = 0; d < 3; d++) {
+    const int offset = decomp->offset[d];
+    const int global_n = decomp->global_n[d];
+
+    // A free surface replaces the layer at the top, and the x-z plane has no layers along y
+    const int width = (stencil_border(d) > 0) ? pml->width : 0;
+    const int lo_width = (d == 2 && waves->free_surface) ? 0 : width;
+
+    pml->n[d] = n[d];
+    pml->lo_end[d] = std::min(std::max(lo_width - offset, 0), n[d]);
+    pml->hi_begin[d] = std::min(std::max(global_n - width - offset, pml->lo_end[d]), n[d]);
+
+    for (int half = 0; half < 2; half++) {
+      pml->a[d][half] = (real*) malloc(sizeof(real) * n[d]);
+      pml->b[d][half] = (real*) malloc(sizeof(real) * n[d]);
+      pml->kappa_inv[d][half] = (real*) malloc(sizeof(real) * n[d]);
+
+      for (int i = 0; i < n[d]; i++) {
+        // Relative depth into the layer, measured from the edges of the inner grid
+        const real x = offset + i + 0.5 * half;
+        const real depth = std::max(lo_width - 0.5 - x, x - (global_n - width - 0.5)) / thickness;
+        const real q = std::min(std::max(depth, (real) 0.0), (real) 1.0);
+
+        // The z-sampling varies from plane to plane on stretched grids
+        const real spacing = (d == 2) ? 1.0f / waves->inv_dz[half][i] : h[d];
+        const real d_max = 3.0 * vp_max * std::log(1.0 / kReflection) / (2.0 * thickness * spacing);
+        const real damping = d_max * q * q;
+        const real kappa = 1.0 + (k_max - 1.0) * q * q;
+        const real alpha = a_max * (1.0 - q);
+        const real b = std::exp(-(damping / kappa + alpha) * waves->dt);
+
+        pml->b[d][half][i] = b;
+        pml->a[d][half][i] = (damping > 0.0) ? damping / (kappa * (damping + kappa * alpha)) * (b - 1.0) : 0.0;
+        pml->kappa_inv[d][half][i] = 1.0 / kappa;
+      }
+    }
+  }
+
+  for (int kernel = 0; kernel < kNumKernels; kernel++) {
+    for (int side = 0; side < 2; side++) {
+      pml->psi[kernel][side] = NULL;
+
+      if (kAxis[kernel] < 0) {
+        continue;
+      }
+
+      int size[3];
+      layer_box(pml, kAxis[kernel], side, size);
+      pml->psi[kernel][side] = (real*) malloc(sizeof(real) * size[0] * size[1] * size[2]);
+      zero_data(pml->psi[kernel][side], size[0], size[1], size[2]);
+    }
+  }
+
+  waves->pml = pml;
+}
+
+void apply_pml(pml3d_t* pml, const kernel_id kernel, real* del, const region_t& r, const int nthreads) {
+
+  if (pml == NULL) {
+    return;
+  }
+
+  const int d = kAxis[kernel];
+  const int half = kHalf[kernel];
+  const int nx = pml->n[0];
+  const int ny = pml->n[1];
+  const real* a = pml->a[d][half];
+  const real* b = pml->b[d][half];
+  const real* kappa_inv = pml->kappa_inv[d][half];
+
+  for (int side = 0; side < 2; side++) {
+    int size[3];
+    const region_t layer = layer_box(pml, d, side, size);
+    const region_t box = make_region(std::max(r.i0, layer.i0), std::min(r.i1, layer.i1),
+                                     std::max(r.j0, layer.j0), std::min(r.j1, layer.j1),
+                                     std::max(r.k0, layer.k0), std::min(r.k1, layer.k1));
+    if (is_empty(box)) {
+      continue;
+    }
+
+    real* psi = pml->psi[kernel][side];
+
+    #pragma omp parallel for num_threads(nthreads)
+    for (int k = box.k0; k < box.k1; k++) {
+      for (int j = box.j0; j < box.j1; j++) {
+        for (int i = box.i0; i < box.i1; i++) {
+          const int c[3] = {i, j, k};
+          const int p = c[d];
+          const int q = idx(nx, ny, i, j, k);
+          const int m = idx(size[0], size[1], i - layer.i0, j - layer.j0, k - layer.k0);
+
+          psi[m] = b[p] * psi[m] + a[p] * del[q];
+          del[q] = del[q] * kappa_inv[p] + psi[m];
+        }
+      }
+    }
+  }
+}
+
+// Copies the memory variables of one kernel between the layer and a field of the local grid size
+static void copy_layer(pml3d_t* pml, const int kernel, real* field, const bool to_field) {
+  for (int side = 0; side < 2; side++) {
+    int size[3];
+    const region_t layer = layer_box(pml, kAxis[kernel], side, size);
+    real* psi = pml->psi[kernel][side];
+
+    for (int k = layer.k0; k < layer.k1; k++) {
+      for (int j = layer.j0; j < layer.j1; j++) {
+        for (int i = layer.i0; i < layer.i1; i++) {
+          real& f = field[idx(pml->n[0], pml->n[1], i, j, k)];
+          real& m = psi[idx(size[0], size[1], i - layer.i0, j - layer.j0, k - layer.k0)];
+          if (to_field) {
+            f = m;
+          } else {
+            m = f;
+          }
+        }
+      }
+    }
+  }
+}
+
+void move_pml_points(std::shared_ptr<decomp_t> decomp, int* const old_cuts[3], const int* old_offset,
+                     pml3d_t* from, pml3d_t* to) {
+
+  // The layers are spread out to the full local grid one kernel at a time. This only happens
+  // when the grid is re-partitioned, so the temporary fields are not worth avoiding.
+  real* old_field = (real*) malloc(sizeof(real) * from->n[0] * from->n[1] * from->n[2]);
+  real* new_field = (real*) malloc(sizeof(real) * to->n[0] * to->n[1] * to->n[2]);
+
+  for (int kernel = 0; kernel < kNumKernels; kernel++) {
+    if (kAxis[kernel] < 0) {
+      continue;
+    }
+
+    zero_data(old_field, from->n[0], from->n[1], from->n[2]);
+    zero_data(new_field, to->n[0], to->n[1], to->n[2]);
+
+    copy_layer(from, kernel, old_field, true);
+    move_owned_points(decomp, old_cuts, old_offset, from->n, {old_field}, {new_field});
+    copy_layer(to, kernel, new_field, false);
+  }
+
+  free(old_field);
+  free(new_field);
+}
+
+region_t full_order_region(std::shared_ptr<fdm3d_t> waves) {
+  const pml3d_t* pml = waves->pml;
+
+  if (pml == NULL) {
+    return make_region(0, waves->nx_ghost, 0, waves->ny_ghost, 0, waves->nz_ghost);
+  }
+
+  return make_region(pml->lo_end[0], pml->hi_begin[0], pml->lo_end[1], pml->hi_begin[1],
+                     pml->lo_end[2], pml->hi_begin[2]);
+}
+
+// Frees the structure itself as well, it is owned by the wave fields
+void free_pml_arrays(pml3d_t* pml) {
+  for (int d = 0; d < 3; d++) {
+    for (int half = 0; half < 2; half++) {
+      free(pml->a[d][half]);
+      free(pml->b[d][half]);
+      free(pml->kappa_inv[d][half]);
+    }
+  }
+
+  for (int kernel = 0; kernel < kNumKernels; kernel++) {
+    free(pml->psi[kernel][0]);
+    free(pml->psi[kernel][1]);
+  }
+
+  free(pml);
+}
@@ -27,6 +27,58 @@ void print_omp_info(const unsigned int num_threads) {
   std::cout << "#Number of threads                            :  " << num_threads << std::endl;
 }
 
+void print_thread_table(std::shared_ptr<thread_table_t> table) {
+  std::cout << "#Threads per kernel                           : ";
+  for (int k = 0; k < kNumKernels; k++) {
+    std::cout << " " << kKernelNames[k] << "=" << table->nthreads[k];
+  }
+  std::cout << std::endl;
+}
+
+void print_decomp_info(const int nranks, const int* procs, const int halo_depth) {
+  std::cout << "#Number of ranks                              :  " << nranks
+            << " (" << procs[0] << " x " << procs[1] << " x " << procs[2] << ")" << std::endl;
+  if (halo_depth > 0) {
+    std::cout << "#Halo exchange every                          :  " << halo_depth << " steps" << std::endl;
+  }
+}
+
+void print_time_step_info(const real dt, const real dt_stable, const int time_order) {
+  std::cout << "#Time step                                    :  " << dt << " (order " << time_order
+            << ", stable up to " << dt_stable << ")" << std::endl;
+}
+
+void print_lts_info(const int rate, const int fine_k0, const int fine_k1, const double work_ratio) {
+  std::cout << "#Local time stepping                          :  rate " << rate << ", fine planes "
+            << fine_k0 << " to " << fine_k1 - 1 << ", " << work_ratio * 100.0 << "% of the updates" << std::endl;
+}
+
+void print_activity_info(const int tile, const double work_ratio) {
+  std::cout << "#Activity tiles                               :  " << tile << " points, "
+            << work_ratio * 100.0 << "% of the updates" << std::endl;
+}
+
+void print_engine_info(const std::string& engine, const double wave_bytes) {
+  std::cout << "#Engine                                       :  " << engine << ", "
+            << wave_bytes / (1024.0 * 1024.0) << " MiB of wave fields" << std::endl;
+}
+
+void print_fluid_info(const double work_ratio) {
+  std::cout << "#Fluid path                                   :  " << work_ratio * 100.0
+            << "% of the kernel passes" << std::endl;
+}
+
+void print_exposed_communication(const double exposed_seconds, const int Nt) {
+  std::cout << "#Exposed communication time                   :  " << exposed_seconds
+            << " (" << exposed_seconds / Nt << " per step)" << std::endl;
+}
+
+void print_shots_summary(const int nshots, const int threads_per_shot, const double elapsed_seconds) {
+  std::cout << "#Independent shots                            :  " << nshots
+            << " (" << threads_per_shot << " threads each)" << std::endl;
+  std::cout << "#Shots per hour                               :  " << nshots * 3600.0 / elapsed_seconds << std::endl;
+}
+
 void print_perf_summary(const double mlups, const double compute_timer) {
   std::cout << "#Compute time                                 :  " << compute_timer << std::endl;
   std::cout << "#Total effective MLUPS                        :  " << mlups << std::endl;
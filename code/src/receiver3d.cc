@@ -3,45 +3,84 @@
  * Date: September 19, 2016
  */
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
 #include "receiver3d.h"
 
+bool receiver_type_fields(const int rectype, bool* fields) {
+  // P, Vx, Vy, Vz and D of the types 1 to 8
+  static const bool kTypes[8][kReceiverFields] = {
+    {true, false, false, false, false},
+    {true, false, false, true, false},
+    {true, true, true, true, false},
+    {false, true, true, true, false},
+    {false, false, false, true, false},
+    {false, true, false, false, false},
+    {false, false, true, false, false},
+    {false, false, false, false, true},
+  };
+
+  const bool known = rectype >= 1 && rectype <= 8;
+  for (int c = 0; c < kReceiverFields; c++) {
+    fields[c] = known && kTypes[rectype - 1][c];
+  }
+
+  return known;
+}
+
 std::shared_ptr<receiver3d_t> receiver3d_setup(const int _n,
                                                 const int _nt,
-                                                const bool _P,
-                                                const bool _Vx,
-                                                const bool _Vy,
-                                                const bool _Vz) {
+                                                const int _rectype,
+                                                const bool traces) {
   // Create receiver structure
   std::shared_ptr <receiver3d_t> rec((receiver3d_t*) malloc(sizeof(receiver3d_t)), free_ptr());
 
+  bool fields[kReceiverFields];
+  receiver_type_fields(_rectype, fields);
+
   // Setup struct
   rec->n = _n;
   rec->nt = _nt;
-  rec->P = _P;
-  rec->Vx = _Vx;
-  rec->Vy = _Vy;
-  rec->Vz = _Vz;
+  rec->rectype = _rectype;
+  rec->P = fields[0];
+  rec->Vx = fields[1];
+  rec->Vy = fields[2];
+  rec->Vz = fields[3];
+  rec->D = fields[4];
 
   // Allocate arrays
-  size_t num_bytes = sizeof(real) * ((rec->n) * (rec->nt));
+  size_t num_bytes = sizeof(real) * ((size_t) (rec->n) * (rec->nt));
   size_t num_bytes_pos = sizeof(int) * (rec->n);
 
-  if (rec->P) {
+  rec->p = NULL;
+  rec->vx = NULL;
+  rec->vy = NULL;
+  rec->vz = NULL;
+  rec->d = NULL;
+
+  if (rec->P && traces) {
 	  rec->p = (real*) malloc(num_bytes);
 	  std::memset(rec->p, 0, num_bytes);
   }
-  if (rec->Vx) {
+  if (rec->Vx && traces) {
 	  rec->vx = (real*) malloc(num_bytes);
 	  std::memset(rec->vx, 0, num_bytes);
   }
-  if (rec->Vy) {
+  if (rec->Vy && traces) {
 	  rec->vy = (real*) malloc(num_bytes);
 	  std::memset(rec->vy, 0, num_bytes);
   }
-  if (rec->Vz) {
+  if (rec->Vz && traces) {
 	  rec->vz = (real*) malloc(num_bytes);
 	  std::memset(rec->vz, 0, num_bytes);
   }
+  if (rec->D && traces) {
+	  rec->d = (real*) malloc(num_bytes);
+	  std::memset(rec->d, 0, num_bytes);
+  }
 
   rec->x = (int*) malloc(num_bytes_pos);
   rec->y = (int*) malloc(num_bytes_pos);
@@ -52,75 +91,500 @@ std::shared_ptr<receiver3d_t> receiver3d_setup(const int _n,
   std::memset(rec->y, 0, num_bytes_pos);
   std::memset(rec->z, 0, num_bytes_pos);
 
+  // The receivers are located at the first step, when their positions are set
+  rec->order = NULL;
+  rec->nlocal = -1;
+  rec->local = NULL;
+  rec->offset = NULL;
+  rec->nfields = rec->P + rec->Vx + rec->Vy + rec->Vz + rec->D;
+  rec->nstaged = 0;
+  rec->first = 0;
+  rec->staging = NULL;
+  rec->plane_first = NULL;
+  rec->column[0] = NULL;
+  rec->column[1] = NULL;
+  rec->near = NULL;
+  rec->nnear = 0;
+  rec->pending = -1;
+  rec->writer = NULL;
+  rec->owned = NULL;
+  rec->owned_count = NULL;
+  rec->gathered = NULL;
+  for (int c = 0; c < kReceiverFields; c++) {
+    rec->fused[c] = false;
+  }
+  rec->nsources = 0;
+  rec->sources = NULL;
+
   return rec;
 }
 
-void save_receivers(std::shared_ptr <receiver3d_t> rec, std::shared_ptr <fdm3d_t> waves, const int _it) {
+void fuse_receivers(std::shared_ptr <receiver3d_t> rec, const bool velocities, const bool pressure) {
+  rec->fused[0] = rec->P && pressure;
+  rec->fused[1] = rec->Vx && velocities;
+  rec->fused[2] = rec->Vy && velocities;
+  rec->fused[3] = rec->Vz && velocities;
+  rec->fused[4] = rec->D;
+}
 
-  for (int i = 0; i < rec->n; i++) {
-    if (rec->P) {
-      rec->p[i * (rec->nt) + _it] = kOneThird
-          * (waves->sxx[idx(waves->nx_ghost, waves->ny_ghost, rec->x[i], rec->y[i], rec->z[i])]
-              + waves->syy[idx(waves->nx_ghost, waves->ny_ghost, rec->x[i], rec->y[i], rec->z[i])]
-              + waves->szz[idx(waves->nx_ghost, waves->ny_ghost, rec->x[i], rec->y[i], rec->z[i])]);
+// True if the kernels sample the fields of the next step into a pending step
+static bool pending_fused(std::shared_ptr <receiver3d_t> rec) {
+  return rec->fused[0] || rec->fused[1] || rec->fused[2] || rec->fused[3];
+}
+
+// Global grid point as one number ordered by z, y and x, for points up to a neighbour outside the grid
+static long long source_key(const int x, const int y, const int z) {
+  return (((long long) (z + 1) << 21 | (y + 1)) << 21) | (x + 1);
+}
+
+// Whether a source point lies within one point of (x, y, z) along every axis
+static bool next_to_source(std::shared_ptr <receiver3d_t> rec, const int x, const int y, const int z) {
+  for (int dz = -1; dz <= 1; dz++) {
+    for (int dy = -1; dy <= 1; dy++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        if (std::binary_search(rec->sources, rec->sources + rec->nsources, source_key(x + dx, y + dy, z + dz))) {
+          return true;
+        }
+      }
     }
+  }
+  return false;
+}
 
-    if (rec->Vx) {
-      rec->vx[i * (rec->nt) + _it] =
-          (waves->vx[idx(waves->nx_ghost, waves->ny_ghost, rec->x[i], rec->y[i], rec->z[i])]);
+// Rank 0 of a trace file learns which receivers every rank stages, and in which order
+static void gather_owners(std::shared_ptr <receiver3d_t> rec, std::shared_ptr <decomp_t> decomp) {
+  const bool root = decomp->rank == 0;
+
+  free(rec->owned);
+  free(rec->owned_count);
+  rec->owned = root ? (int*) malloc(sizeof(int) * std::max(rec->n, 1)) : NULL;
+  rec->owned_count = root ? (int*) malloc(sizeof(int) * decomp->nranks) : NULL;
+
+  gather_to_root(decomp, rec->nlocal, rec->owned_count);
+  gather_to_root(decomp, rec->local, rec->nlocal, rec->owned, rec->owned_count);
+}
+
+// Receiver positions are global; each rank only records the receivers in the part it owns.
+void locate_receivers(std::shared_ptr <receiver3d_t> rec, std::shared_ptr <fdm3d_t> waves,
+                      std::shared_ptr <decomp_t> decomp, const int nthreads) {
+
+  flush_receivers(rec, decomp, nthreads);
+  free(rec->local);
+  free(rec->offset);
+  free(rec->staging);
+  free(rec->plane_first);
+  free(rec->column[0]);
+  free(rec->column[1]);
+  free(rec->near);
+
+  // The linear offsets of every part grow with z, then y, then x
+  if (rec->order == NULL) {
+    rec->order = (int*) malloc(sizeof(int) * std::max(rec->n, 1));
+    for (int i = 0; i < rec->n; i++) {
+      rec->order[i] = i;
     }
+    std::sort(rec->order, rec->order + rec->n, [&](const int a, const int b) {
+      if (rec->z[a] != rec->z[b]) return rec->z[a] < rec->z[b];
+      if (rec->y[a] != rec->y[b]) return rec->y[a] < rec->y[b];
+      if (rec->x[a] != rec->x[b]) return rec->x[a] < rec->x[b];
+      return a < b;
+    });
+  }
 
-    if (rec->Vy) {
-      rec->vy[i * (rec->nt) + _it] =
-          (waves->vy[idx(waves->nx_ghost, waves->ny_ghost, rec->x[i], rec->y[i], rec->z[i])]);
+  rec->local = (int*) malloc(sizeof(int) * std::max(rec->n, 1));
+  rec->offset = (int*) malloc(sizeof(int) * std::max(rec->n, 1));
+  rec->nlocal = 0;
+
+  // Only the receivers in the planes of the part can be owned
+  const int* begin = std::lower_bound(rec->order, rec->order + rec->n, waves->z0, [&](const int i, const int z) {
+    return rec->z[i] < z;
+  });
+  const int* end = std::lower_bound(begin, (const int*) rec->order + rec->n, waves->z0 + waves->nz_ghost,
+                                    [&](const int i, const int z) {
+    return rec->z[i] < z;
+  });
+
+  for (const int* i = begin; i < end; i++) {
+    if (owns_point(decomp, rec->x[*i], rec->y[*i], rec->z[*i])) {
+      rec->local[rec->nlocal++] = *i;
     }
+  }
 
-    if (rec->Vz) {
-      rec->vz[i * (rec->nt) + _it] =
-          (waves->vz[idx(waves->nx_ghost, waves->ny_ghost, rec->x[i], rec->y[i], rec->z[i])]);
+  const int nx = waves->nx_ghost;
+  const int ny = waves->ny_ghost;
+  auto offset = [&](const int i) {
+    return idx(nx, ny, rec->x[i] - waves->x0, rec->y[i] - waves->y0, rec->z[i] - waves->z0);
+  };
+
+  // The offsets grow with z, so the receivers of a plane follow each other
+  rec->plane_first = (int*) calloc(waves->nz_ghost + 1, sizeof(int));
+  rec->column[0] = (int*) malloc(sizeof(int) * std::max(rec->nlocal, 1));
+  rec->column[1] = (int*) malloc(sizeof(int) * std::max(rec->nlocal, 1));
+  rec->near = (int*) malloc(sizeof(int) * std::max(rec->nlocal, 1));
+  rec->nnear = 0;
+
+  for (int r = 0; r < rec->nlocal; r++) {
+    const int i = rec->local[r];
+    rec->offset[r] = offset(i);
+    rec->column[0][r] = rec->x[i] - waves->x0;
+    rec->column[1][r] = rec->y[i] - waves->y0;
+    rec->plane_first[rec->z[i] - waves->z0 + 1]++;
+
+    if (next_to_source(rec, rec->x[i], rec->y[i], rec->z[i])) {
+      rec->near[rec->nnear++] = r;
     }
   }
+  for (int k = 0; k < waves->nz_ghost; k++) {
+    rec->plane_first[k + 1] += rec->plane_first[k];
+  }
+
+  rec->staging = (real*) malloc(sizeof(real) * (kStagedSteps + 1) * rec->nfields * std::max(rec->nlocal, 1));
+
+  if (rec->writer != NULL) {
+    gather_owners(rec, decomp);
+  }
+
+  // The kernels sample into the staging buffer once save_receivers has set up a pending step
+  rec->pending = -1;
+  rec->samples.first = rec->plane_first;
+  rec->samples.offset = rec->offset;
+  rec->samples.x = rec->column[0];
+  rec->samples.y = rec->column[1];
+  for (int c = 0; c < kReceiverFields; c++) {
+    rec->samples.to[c] = NULL;
+  }
+  waves->samples = (pending_fused(rec) || rec->fused[4]) ? &rec->samples : NULL;
 }
 
-void write_receiver_file(std::shared_ptr <receiver3d_t> rec,
-                         std::shared_ptr <dims_t> dims) {
+// Values of a field at the local receivers
+static void gather(real* __restrict__ to, const real* __restrict__ from, const int* __restrict__ offset,
+                   const int n, const int nthreads) {
 
-  std::ofstream rec_file("receivers.csv", std::ofstream::out);
+  #pragma omp parallel for num_threads(nthreads)
+  for (int r = 0; r < n; r++) {
+    to[r] = from[offset[r]];
+  }
+}
 
-  rec_file << rec->n << "\n";
-  rec_file << rec->nt << "\n";
+static void gather_pressure(real* __restrict__ to, const real* __restrict__ sxx, const real* __restrict__ syy,
+                            const real* __restrict__ szz, const int* __restrict__ offset, const int n,
+                            const int nthreads) {
+
+  #pragma omp parallel for num_threads(nthreads)
+  for (int r = 0; r < n; r++) {
+    to[r] = kOneThird * (sxx[offset[r]] + syy[offset[r]] + szz[offset[r]]);
+  }
+}
+
+// Rows of the recorded fields in a step of the staging buffer, -1 for fields not recorded
+static void field_rows(std::shared_ptr <receiver3d_t> rec, int* rows) {
+  const bool recorded[kReceiverFields] = {rec->P, rec->Vx, rec->Vy, rec->Vz, rec->D};
+  int row = 0;
+
+  for (int c = 0; c < kReceiverFields; c++) {
+    rows[c] = recorded[c] ? row++ : -1;
+  }
+}
+
+void save_receivers(std::shared_ptr <receiver3d_t> rec, std::shared_ptr <fdm3d_t> waves,
+                    std::shared_ptr <decomp_t> decomp, const int _it, const int nthreads) {
 
-  for (int i = 0; i < (rec->n); i++) {
-    rec_file << rec->x[i] * dims->dx << " " << rec->y[i] * dims->dy << " " << rec->z[i] * dims->dz << "\n";
+  if (rec->nlocal < 0) {
+    locate_receivers(rec, waves, decomp, nthreads);
+  }
 
-    if (rec->P) {
-      rec_file << "P\n";
-      for (int it = 0; it < (rec->nt); it++) {
-        rec_file << rec->p[it+(i*rec->nt)] << "\n";
+  const bool pending = rec->pending == _it;
+  const int n = rec->nlocal;
+  const size_t row_size = (size_t) rec->nfields * n;
+
+  // The staged steps are consecutive. A pending step already has its place, after the others,
+  // and moves to the front of the buffer when they are written out.
+  if (rec->nstaged == kStagedSteps || (!pending && rec->nstaged > 0 && _it != rec->first + rec->nstaged)) {
+    const real* row = &rec->staging[rec->nstaged * row_size];
+    flush_receivers(rec, decomp, nthreads);
+    if (pending) {
+      std::memmove(rec->staging, row, sizeof(real) * row_size);
+    }
+  }
+  if (rec->nstaged == 0) {
+    rec->first = _it;
+  }
+
+  const real* fields[4] = {NULL, waves->vx, waves->vy, waves->vz};
+  int rows[kReceiverFields];
+  field_rows(rec, rows);
+  real* step = &rec->staging[rec->nstaged * row_size];
+
+  for (int c = 0; c < 4; c++) {
+    if (rows[c] < 0 || (pending && rec->fused[c])) {
+      continue;
+    }
+    if (c == 0) {
+      gather_pressure(&step[rows[c] * n], waves->sxx, waves->syy, waves->szz, rec->offset, n, nthreads);
+    } else {
+      gather(&step[rows[c] * n], fields[c], rec->offset, n, nthreads);
+    }
+  }
+
+  // The kernels sampled the pending step before the source went in
+  if (pending) {
+    for (int s = 0; s < rec->nnear; s++) {
+      const int r = rec->near[s];
+      const int p = rec->offset[r];
+
+      for (int c = 0; c < 4; c++) {
+        if (rec->fused[c]) {
+          step[rows[c] * n + r] = (c == 0) ? kOneThird * (waves->sxx[p] + waves->syy[p] + waves->szz[p])
+                                           : fields[c][p];
+        }
       }
     }
-    if (rec->Vx) {
-      rec_file << "Vx\n";
-      for (int it = 0; it < (rec->nt); it++) {
-        rec_file << rec->vx[it+(i*rec->nt)] << "\n";
+  }
+
+  // The normal stress update of this step samples its dilatation rate, and leaves zeros for the
+  // receivers in tiles it skips
+  rec->samples.to[4] = NULL;
+  if (rec->fused[4]) {
+    std::memset(&step[rows[4] * n], 0, sizeof(real) * n);
+    rec->samples.to[4] = &step[rows[4] * n];
+  }
+
+  rec->nstaged++;
+
+  // The next step becomes pending, with zeros for the receivers in tiles the kernels skip
+  rec->pending = -1;
+  for (int c = 0; c < 4; c++) {
+    rec->samples.to[c] = NULL;
+  }
+
+  if (pending_fused(rec) && _it + 1 < rec->nt) {
+    real* next = &rec->staging[rec->nstaged * row_size];
+    std::memset(next, 0, sizeof(real) * row_size);
+
+    for (int c = 0; c < 4; c++) {
+      if (rec->fused[c]) {
+        rec->samples.to[c] = &next[rows[c] * n];
       }
     }
-    if (rec->Vy) {
-      rec_file << "Vy\n";
-      for (int it = 0; it < (rec->nt); it++) {
-        rec_file << rec->vy[it+(i*rec->nt)] << "\n";
+    rec->pending = _it + 1;
+  }
+}
+
+// Receivers per block of the transpose, whose staged rows stay in cache while their traces are
+// written
+static const int kTransposeBlock = 16;
+
+static void transpose_staged(std::shared_ptr <receiver3d_t> rec, const int nthreads) {
+
+  if (rec->nstaged == 0) {
+    return;
+  }
+
+  real* traces[kReceiverFields] = {rec->p, rec->vx, rec->vy, rec->vz, rec->d};
+  const bool recorded[kReceiverFields] = {rec->P, rec->Vx, rec->Vy, rec->Vz, rec->D};
+  const int n = rec->nlocal;
+  const size_t step = (size_t) rec->nfields * n;
+  int field = 0;
+
+  for (int f = 0; f < kReceiverFields; f++) {
+    if (!recorded[f]) {
+      continue;
+    }
+
+    real* trace = traces[f];
+    const real* staged = &rec->staging[(size_t) field * n];
+
+    #pragma omp parallel for num_threads(nthreads)
+    for (int r0 = 0; r0 < n; r0 += kTransposeBlock) {
+      const int r1 = std::min(r0 + kTransposeBlock, n);
+
+      for (int r = r0; r < r1; r++) {
+        real* to = &trace[(size_t) rec->local[r] * rec->nt + rec->first];
+        for (int t = 0; t < rec->nstaged; t++) {
+          to[t] = staged[t * step + r];
+        }
       }
     }
-    if (rec->Vz) {
-      rec_file << "Vz\n";
-      for (int it = 0; it < (rec->nt); it++) {
-        rec_file << rec->vz[it+(i*rec->nt)] << "\n";
+
+    field++;
+  }
+
+  rec->nstaged = 0;
+}
+
+void stream_receivers(std::shared_ptr <receiver3d_t> rec, std::shared_ptr <decomp_t> decomp,
+                      std::shared_ptr <dims_t> dims, const std::string& filename) {
+
+  const bool recorded[kReceiverFields] = {rec->P, rec->Vx, rec->Vy, rec->Vz, rec->D};
+  real* positions = (real*) malloc(sizeof(real) * rec->n * 3);
+
+  for (int i = 0; i < rec->n; i++) {
+    positions[3 * i] = rec->x[i] * dims->dx;
+    positions[3 * i + 1] = rec->y[i] * dims->dy;
+    positions[3 * i + 2] = plane_depth(dims, rec->z[i]);
+  }
+
+  const bool root = decomp->rank == 0;
+  const size_t block_size = (size_t) kStagedSteps * rec->nfields * rec->n;
+
+  rec->writer = trace_writer_setup(filename, root, rec->n, rec->nt, recorded, dims->dt, positions, block_size);
+  rec->gathered = root ? (real*) malloc(sizeof(real) * std::max(block_size, (size_t) 1)) : NULL;
+  free(positions);
+}
+
+// The staged rows of every rank arrive on rank 0 one rank after the other, and go to the
+// columns of its receivers in the block. Receivers no rank owns stay at zero.
+static void stream_staged(std::shared_ptr <receiver3d_t> rec, std::shared_ptr <decomp_t> decomp) {
+
+  // The ranks stage the same steps, so they all take part in the gather
+  if (rec->nstaged == 0) {
+    return;
+  }
+
+  const int rows = rec->nstaged * rec->nfields;
+  const bool root = decomp->rank == 0;
+  int* counts = NULL;
+
+  if (root) {
+    counts = (int*) malloc(sizeof(int) * decomp->nranks);
+    for (int r = 0; r < decomp->nranks; r++) {
+      counts[r] = rows * rec->owned_count[r];
+    }
+  }
+
+  // The rows of the staged steps follow each other in the staging buffer
+  gather_to_root(decomp, rec->staging, rows * rec->nlocal, rec->gathered, counts);
+
+  if (root) {
+    real* block = trace_block(rec->writer);
+    const size_t count = (size_t) rows * rec->n;
+    const real* from = rec->gathered;
+    const int* owned = rec->owned;
+
+    std::memset(block, 0, sizeof(real) * count);
+
+    for (int r = 0; r < decomp->nranks; r++) {
+      const int m = rec->owned_count[r];
+      for (int row = 0; row < rows; row++) {
+        real* to = &block[(size_t) row * rec->n];
+        for (int j = 0; j < m; j++) {
+          to[owned[j]] = from[(size_t) row * m + j];
+        }
       }
+      from += (size_t) rows * m;
+      owned += m;
+    }
+
+    write_trace_block(rec->writer, count);
+  }
+
+  free(counts);
+  rec->nstaged = 0;
+}
+
+void flush_receivers(std::shared_ptr <receiver3d_t> rec, std::shared_ptr <decomp_t> decomp, const int nthreads) {
+  if (rec->writer != NULL) {
+    stream_staged(rec, decomp);
+  } else {
+    transpose_staged(rec, nthreads);
+  }
+}
+
+// Collects the recordings of all ranks on rank 0. Every receiver is owned by exactly one
+// rank and left at zero on all others, so a sum reproduces the recording.
+void gather_receivers(std::shared_ptr <receiver3d_t> rec, std::shared_ptr <decomp_t> decomp, const int nthreads) {
+
+  flush_receivers(rec, decomp, nthreads);
+
+  if (rec->writer != NULL) {
+    close_trace_writer(rec->writer);
+    return;
+  }
+
+  size_t count = (size_t) (rec->n) * (rec->nt);
+
+  if (rec->P) reduce_to_root(decomp, rec->p, count);
+  if (rec->Vx) reduce_to_root(decomp, rec->vx, count);
+  if (rec->Vy) reduce_to_root(decomp, rec->vy, count);
+  if (rec->Vz) reduce_to_root(decomp, rec->vz, count);
+  if (rec->D) reduce_to_root(decomp, rec->d, count);
+}
+
+// Bytes of a value as "%g\n" at most, e.g. "-1.17549e-38\n"
+static const int kValueChars = 16;
+
+// Receivers and bytes of text formatted at a time by write_receiver_file
+static const int kFileBatch = 4096;
+static const size_t kFileBatchBytes = (size_t) 64 << 20;
+
+// Formats like std::ostream << value << "\n" with the default precision of 6
+static int format_value(char* to, const real value) {
+  return std::snprintf(to, kValueChars + 1, "%g\n", (double) value);
+}
+
+void write_receiver_file(std::shared_ptr <receiver3d_t> rec,
+                         std::shared_ptr <dims_t> dims,
+                         const int nthreads,
+                         const std::string& filename) {
+
+  transpose_staged(rec, nthreads);
+
+  const real* traces[kReceiverFields] = {rec->p, rec->vx, rec->vy, rec->vz, rec->d};
+  const bool recorded[kReceiverFields] = {rec->P, rec->Vx, rec->Vy, rec->Vz, rec->D};
+  const char* names[kReceiverFields] = {"P\n", "Vx\n", "Vy\n", "Vz\n", "D\n"};
+
+  // The text of each receiver of a batch is formatted into its own part of one buffer, in
+  // parallel, and the parts are written one after the other before the next batch reuses it
+  const size_t stride = (size_t) (3 + rec->nfields * (rec->nt + 1)) * kValueChars + 1;
+  const int batch = (int) std::max((size_t) 1, std::min((size_t) std::min(kFileBatch, std::max(rec->n, 1)),
+                                                        kFileBatchBytes / stride));
+  char* text = (char*) malloc(stride * batch);
+  size_t* length = (size_t*) malloc(sizeof(size_t) * batch);
+
+  std::ofstream rec_file(filename, std::ofstream::out | std::ofstream::binary);
+
+  rec_file << rec->n << "\n";
+  rec_file << rec->nt << "\n";
+
+  for (int b0 = 0; b0 < rec->n; b0 += batch) {
+    const int b1 = std::min(b0 + batch, rec->n);
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+    for (int i = b0; i < b1; i++) {
+      char* to = &text[stride * (i - b0)];
+      char* start = to;
+
+      to += std::snprintf(to, 3 * kValueChars + 1, "%g %g %g\n", (double) (rec->x[i] * dims->dx),
+                          (double) (rec->y[i] * dims->dy), (double) plane_depth(dims, rec->z[i]));
+
+      for (int f = 0; f < kReceiverFields; f++) {
+        if (!recorded[f]) {
+          continue;
+        }
+
+        const size_t name_length = std::strlen(names[f]);
+        std::memcpy(to, names[f], name_length);
+        to += name_length;
+
+        const real* trace = &traces[f][(size_t) i * rec->nt];
+        for (int it = 0; it < (rec->nt); it++) {
+          to += format_value(to, trace[it]);
+        }
+      }
+      *to++ = '\n';
+
+      length[i - b0] = to - start;
+    }
+
+    for (int i = b0; i < b1; i++) {
+      rec_file.write(&text[stride * (i - b0)], length[i - b0]);
     }
-    rec_file << "\n";
   }
 
   rec_file.close();
+
+  free(text);
+  free(length);
 }
 
 int determine_receiver_value(const int Nz) {
@@ -141,11 +605,25 @@ int determine_receiver_value(const int Nz) {
 
 }
 
+void set_receiver_sources(std::shared_ptr <receiver3d_t> receiver, const int n, const int* x, const int* y,
+                          const int* z) {
+  free(receiver->sources);
+  receiver->nsources = n;
+  receiver->sources = (long long*) malloc(sizeof(long long) * std::max(n, 1));
+
+  for (int s = 0; s < n; s++) {
+    receiver->sources[s] = source_key(x[s], y[s], z[s]);
+  }
+  std::sort(receiver->sources, receiver->sources + n);
+}
+
 void setup_receiver_for_verification(std::shared_ptr <receiver3d_t> receiver,
                                      const int Nz,
                                      const int x_source,
                                      const int y_source,
                                      const int z_source) {
+  set_receiver_sources(receiver, 1, &x_source, &y_source, &z_source);
+
   if (Nz == 32) {
     setup32(receiver, x_source, y_source, z_source);
   }
@@ -160,6 +638,26 @@ void setup_receiver_for_verification(std::shared_ptr <receiver3d_t> receiver,
   } else if (Nz == 1024) {
     setup1024(receiver, x_source, y_source, z_source);
   }
+
+#ifdef ELASTIC_2D
+  // The receivers of the layout are projected onto the x-z plane of the source
+  for (int i = 0; i < receiver->n; i++) {
+    receiver->y[i] = y_source;
+  }
+#endif
+}
+
+void setup_receiver_geometry(std::shared_ptr <receiver3d_t> receiver,
+                             std::shared_ptr <receiver_geometry_t> geometry,
+                             const int x_source,
+                             const int y_source,
+                             const int z_source) {
+  set_receiver_sources(receiver, 1, &x_source, &y_source, &z_source);
+
+  const size_t num_bytes_pos = sizeof(int) * std::min(receiver->n, geometry->n);
+  std::memcpy(receiver->x, geometry->x, num_bytes_pos);
+  std::memcpy(receiver->y, geometry->y, num_bytes_pos);
+  std::memcpy(receiver->z, geometry->z, num_bytes_pos);
 }
 
 void setup32(std::shared_ptr <receiver3d_t> receiver, const int x_source, const int y_source, const int z_source) {
@@ -348,11 +846,27 @@ void setup1024(std::shared_ptr <receiver3d_t> receiver, const int x_source, cons
 }
 
 void free_receiver_arrays(std::shared_ptr <receiver3d_t> rec) {
-  if (rec->P) free(rec->p);
-  if (rec->Vx) free(rec->vx);
-  if (rec->Vy) free(rec->vy);
-  if (rec->Vz) free(rec->vz);
+  free(rec->p);
+  free(rec->vx);
+  free(rec->vy);
+  free(rec->vz);
+  free(rec->d);
   free(rec->x);
   free(rec->y);
   free(rec->z);
+  free(rec->order);
+  free(rec->local);
+  free(rec->offset);
+  free(rec->staging);
+  free(rec->plane_first);
+  free(rec->column[0]);
+  free(rec->column[1]);
+  free(rec->near);
+  free(rec->sources);
+  free(rec->owned);
+  free(rec->owned_count);
+  free(rec->gathered);
+  if (rec->writer != NULL) {
+    free_trace_writer_arrays(rec->writer);
+  }
 }
@@ -0,0 +1,165 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 19, 2026
+ * Comment: Receiver positions read from a binary list or a grid descriptor.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "receiver_geometry.h"
+#include "differentiators.h"
+
+static std::shared_ptr<receiver_geometry_t> geometry_setup(const int n) {
+
+  std::shared_ptr<receiver_geometry_t> geometry((receiver_geometry_t*) malloc(sizeof(receiver_geometry_t)), free_ptr());
+
+  geometry->n = n;
+  geometry->x = (int*) malloc(sizeof(int) * std::max(n, 1));
+  geometry->y = (int*) malloc(sizeof(int) * std::max(n, 1));
+  geometry->z = (int*) malloc(sizeof(int) * std::max(n, 1));
+
+  return geometry;
+}
+
+// The count and the positions after the tag of a binary list
+static std::shared_ptr<receiver_geometry_t> read_list(FILE* file, const std::string& filename) {
+
+  int32_t n = 0;
+  if (std::fread(&n, sizeof(int32_t), 1, file) != 1 || n < 0) {
+    std::cerr << "#Receiver list " << filename << " has no count of receivers" << std::endl;
+    return nullptr;
+  }
+
+  int32_t* positions = (int32_t*) malloc(sizeof(int32_t) * 3 * std::max(n, 1));
+  const size_t count = std::fread(positions, sizeof(int32_t), (size_t) n * 3, file);
+
+  if (count != (size_t) n * 3) {
+    std::cerr << "#Receiver list " << filename << " holds " << count / 3 << " of its " << n << " receivers" << std::endl;
+    free(positions);
+    return nullptr;
+  }
+
+  std::shared_ptr<receiver_geometry_t> geometry = geometry_setup(n);
+  for (int i = 0; i < n; i++) {
+    geometry->x[i] = positions[3 * i];
+    geometry->y[i] = positions[3 * i + 1];
+    geometry->z[i] = positions[3 * i + 2];
+  }
+
+  free(positions);
+  return geometry;
+}
+
+// The receivers of the first line of a grid descriptor
+static std::shared_ptr<receiver_geometry_t> read_grid(const std::string& filename, const int nthreads) {
+
+  std::ifstream grid_file(filename);
+  std::string line;
+
+  while (std::getline(grid_file, line)) {
+    line = line.substr(0, line.find('#'));
+
+    std::stringstream line_stream(line);
+    std::string keyword;
+
+    if (!(line_stream >> keyword)) {
+      continue;
+    }
+
+    // First point, count and spacing along x, y and z
+    int first[3], count[3], step[3];
+    bool valid = keyword == "grid";
+    for (int d = 0; d < 3 && valid; d++) {
+      valid = (line_stream >> first[d] >> count[d] >> step[d]) && count[d] > 0;
+    }
+
+    const long long n = valid ? (long long) count[0] * count[1] * count[2] : 0;
+    if (!valid || n > INT_MAX) {
+      std::cerr << "#Receiver grid " << filename << " is not \"grid x0 nx sx y0 ny sy z0 nz sz\": " << line << std::endl;
+      return nullptr;
+    }
+
+    std::shared_ptr<receiver_geometry_t> geometry = geometry_setup((int) n);
+
+    #pragma omp parallel for num_threads(nthreads)
+    for (int k = 0; k < count[2]; k++) {
+      for (int j = 0; j < count[1]; j++) {
+        for (int i = 0; i < count[0]; i++) {
+          const size_t r = ((size_t) k * count[1] + j) * count[0] + i;
+          geometry->x[r] = first[0] + i * step[0];
+          geometry->y[r] = first[1] + j * step[1];
+          geometry->z[r] = first[2] + k * step[2];
+        }
+      }
+    }
+
+    return geometry;
+  }
+
+  std::cerr << "#Receiver grid " << filename << " has no grid line" << std::endl;
+  return nullptr;
+}
+
+std::shared_ptr<receiver_geometry_t> read_receiver_geometry(const std::string& filename, std::shared_ptr<dims_t> dims,
+                                                             const int nthreads) {
+
+  FILE* file = std::fopen(filename.c_str(), "rb");
+
+  if (file == NULL) {
+    std::cerr << "#Could not open receiver geometry " << filename << std::endl;
+    return nullptr;
+  }
+
+  char tag[8] = {0};
+  const bool list = std::fread(tag, 1, 8, file) == 8 && std::equal(tag, tag + 8, "OPTEWERC");
+  std::shared_ptr<receiver_geometry_t> geometry = list ? read_list(file, filename) : nullptr;
+  std::fclose(file);
+
+  if (!list) {
+    geometry = read_grid(filename, nthreads);
+  }
+  if (geometry == nullptr) {
+    return nullptr;
+  }
+
+  // Keep the receivers at computed points, in the order of the file
+  const region_t computed = computed_region(dims->nx_ghost, dims->ny_ghost, dims->nz_ghost);
+  int kept = 0;
+
+  for (int i = 0; i < geometry->n; i++) {
+    const int x = geometry->x[i];
+#ifdef ELASTIC_2D
+    const int y = dims->ny_ghost / 2;
+#else
+    const int y = geometry->y[i];
+#endif
+    const int z = geometry->z[i];
+
+    if (x >= computed.i0 && x < computed.i1 && y >= computed.j0 && y < computed.j1
+        && z >= computed.k0 && z < computed.k1) {
+      geometry->x[kept] = x;
+      geometry->y[kept] = y;
+      geometry->z[kept] = z;
+      kept++;
+    }
+  }
+
+  if (kept < geometry->n) {
+    std::cerr << "#Dropped " << geometry->n - kept << " of the " << geometry->n << " receivers of " << filename
+              << ", outside the computed grid" << std::endl;
+  }
+  geometry->n = kept;
+
+  return geometry;
+}
+
+void free_receiver_geometry_arrays(std::shared_ptr<receiver_geometry_t> geometry) {
+  free(geometry->x);
+  free(geometry->y);
+  free(geometry->z);
+}
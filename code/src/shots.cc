@@ -0,0 +1,166 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Socket-split mode, several independent simulations in one process.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <vector>
+
+#include <omp.h>
+
+#include "shots.h"
+#include "decomp.h"
+#include "differentiators.h"
+#include "lax_wendroff.h"
+#include "activity.h"
+#include "pml3d.h"
+#include "source.h"
+
+#ifdef SAVE_RECEIVERS
+#include "receiver3d.h"
+#endif
+
+std::shared_ptr<shots_t> shots_setup(const int nshots, const int nthreads) {
+
+  std::shared_ptr<shots_t> shots((shots_t*) malloc(sizeof(shots_t)), free_ptr());
+
+  shots->nshots = nshots;
+  shots->nthreads = std::max(1, nthreads / nshots);
+  shots->spacing = 0;
+  shots->shared_model = false;
+  shots->time_order = 2;
+  shots->rectype = 4;
+  shots->activity_tile = 0;
+  shots->activity_margin = 0;
+  shots->first_shot = 0;
+  shots->elapsed = (double*) calloc(nshots, sizeof(double));
+
+  return shots;
+}
+
+// One complete simulation, run by the calling thread's team
+static void run_shot(std::shared_ptr<shots_t> shots, const int s, std::shared_ptr<dims_t> dims,
+                     std::shared_ptr<layers_t> layers, std::shared_ptr<decomp_t> decomp, std::shared_ptr<model3d_t> shared_model,
+                     real* source, step_context_t* ctx) {
+
+  const int shot = shots->first_shot + s;
+  const int x_source = std::min(std::max(shots->x_source + shot * shots->spacing, half_length),
+                                dims->nx_ghost - half_length - 1);
+
+  omp_set_num_threads(shots->nthreads);
+
+  // Allocated and zeroed by this shot's threads, so the pages are local to its NUMA domain
+  std::shared_ptr<fdm3d_t> waves = fdm3d_setup(dims);
+  std::shared_ptr<model3d_t> model = shared_model;
+  if (!shots->shared_model) {
+    model = model_setup(dims);
+    set_layered_model(model, dims, layers);
+  }
+
+  pml_setup(waves, decomp, layers_vp_max(layers), shots->a_max, shots->k_max);
+  activity_setup(waves, dims, x_source, shots->y_source, shots->z_source, layers_vp_max(layers),
+                 shots->activity_tile, shots->activity_margin, shots->nthreads);
+
+  std::shared_ptr<thread_table_t> threads = thread_table_setup(shots->nthreads);
+  std::shared_ptr<step_regions_t> regions = step_regions_setup(decomp, waves);
+  std::shared_ptr<step_timing_t> timing = step_timing_setup(false);
+  std::shared_ptr<lax_wendroff_t> lw = lax_wendroff_setup(shots->time_order);
+
+#ifdef SAVE_RECEIVERS
+  std::shared_ptr<receiver3d_t> receiver = receiver3d_setup(determine_receiver_value(dims->nz), dims->nt, shots->rectype);
+  setup_receiver_for_verification(receiver, dims->nz, x_source, shots->y_source, shots->z_source);
+  // Gathered after the step, only the dilatation rate is sampled by the normal stress update
+  fuse_receivers(receiver, false, false);
+#endif
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  for (int it = 0; it < dims->nt; it++) {
+    insert_source(waves, model, source, shots->source_type, x_source, shots->y_source, shots->z_source,
+                  shots->source_dir, it);
+
+#ifdef SAVE_RECEIVERS
+    save_receivers(receiver, waves, decomp, it, shots->nthreads);
+#endif
+
+    ctx->it = it;
+    advance_activity(waves, (it + 1) * dims->dt);
+    if (lw->order == 4) {
+      lax_wendroff_time_step(waves, model, threads, decomp, lw, ctx, timing);
+    } else {
+      time_step(waves, model, threads, decomp, regions, ctx, timing);
+    }
+  }
+
+  auto stop = std::chrono::high_resolution_clock::now();
+  shots->elapsed[s] = std::chrono::duration<double>(stop - start).count();
+
+#ifdef SAVE_RECEIVERS
+  std::stringstream filename;
+  filename << "receivers_shot" << shot << ".csv";
+  write_receiver_file(receiver, dims, shots->nthreads, filename.str());
+  free_receiver_arrays(receiver);
+#endif
+
+  free_lax_wendroff_arrays(lw);
+  free_wave_arrays(waves);
+  if (!shots->shared_model) {
+    free_model_arrays(model);
+  }
+}
+
+double run_shots(std::shared_ptr<shots_t> shots, std::shared_ptr<dims_t> dims, std::shared_ptr<layers_t> layers,
+                 real* source, step_context_t* ctx) {
+
+  // The shots share no halos, so every shot sees the grid as a single part
+  std::shared_ptr<decomp_t> decomp = decomp_setup(dims, shots->nthreads, false);
+
+
+  std::shared_ptr<model3d_t> shared_model;
+  if (shots->shared_model) {
+    shared_model = model_setup(dims);
+    set_layered_model(shared_model, dims, layers);
+  }
+
+  // Every shot keeps its own step context so that the time step and the kernel records of the
+  // energy measurements do not mix
+  std::vector<step_context_t> contexts(shots->nshots, *ctx);
+#ifdef HDEEM
+  std::vector<std::vector<kernel>> kernels(shots->nshots);
+  for (int s = 0; s < shots->nshots; s++) {
+    contexts[s].kernels = &kernels[s];
+  }
+#endif
+
+  omp_set_max_active_levels(2);
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  // One outer thread per shot, spread over the places (OMP_PLACES=sockets puts one on each
+  // socket); the kernels of a shot run on the places of its own partition
+  #pragma omp parallel for num_threads(shots->nshots) proc_bind(spread) schedule(static, 1)
+  for (int s = 0; s < shots->nshots; s++) {
+    run_shot(shots, s, dims, layers, decomp, shared_model, source, &contexts[s]);
+  }
+
+  auto stop = std::chrono::high_resolution_clock::now();
+
+#ifdef HDEEM
+  for (int s = 0; s < shots->nshots; s++) {
+    ctx->kernels->insert(ctx->kernels->end(), kernels[s].begin(), kernels[s].end());
+  }
+#endif
+
+  if (shots->shared_model) {
+    free_model_arrays(shared_model);
+  }
+  free_decomp_arrays(decomp);
+
+  return std::chrono::duration<double>(stop - start).count();
+}
+
+void free_shots_arrays(std::shared_ptr<shots_t> shots) {
+  free(shots->elapsed);
+}
@@ -3,9 +3,39 @@
  * Date: September 15, 2016
  */
 
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
 #include "source.h"
+#include "differentiators.h"
+
+// Local index of a global grid point, or -1 if the point is not stored on this rank
+static int local_index(std::shared_ptr<fdm3d_t> waves, const int x, const int y, const int z) {
+  const int i = x - waves->x0;
+  const int j = y - waves->y0;
+  const int k = z - waves->z0;
+
+  if (i < 0 || i >= waves->nx_ghost || j < 0 || j >= waves->ny_ghost || k < 0 || k >= waves->nz_ghost) {
+    return -1;
+  }
+
+  return idx(waves->nx_ghost, waves->ny_ghost, i, j, k);
+}
+
+// Adds a value to a field at a global grid point if the point is stored on this rank
+static void add_at(std::shared_ptr<fdm3d_t> waves, real* field, const int x, const int y, const int z, const double value) {
+  const int _idx = local_index(waves, x, y, z);
+
+  if (_idx >= 0) {
+    field[_idx] += value;
+  }
+}
 
 // Comment: Inserting a source into the model. The source is inserted into the normal stress wave fields.
+// The position is global; on a decomposed grid the source also goes into the halo copies of the point.
 void insert_stress_source(std::shared_ptr<fdm3d_t> waves,
                           real* source,
                           const int _x,
@@ -13,7 +43,11 @@ void insert_stress_source(std::shared_ptr<fdm3d_t> waves,
                           const int _z,
                           const int it) {
 
-  int _idx = idx(waves->nx_ghost, waves->ny_ghost, _x, _y, _z);
+  int _idx = local_index(waves, _x, _y, _z);
+
+  if (_idx < 0) {
+    return;
+  }
 
   waves->szz[_idx] += source[it] * waves->dt;
   waves->sxx[_idx] += source[it] * waves->dt;
@@ -31,7 +65,11 @@ void insert_force_source(std::shared_ptr<fdm3d_t> waves,
                          const int direction,
                          const int type) {
 
-  int _idx = idx(waves->nx_ghost, waves->ny_ghost, _x, _y, _z);
+  int _idx = local_index(waves, _x, _y, _z);
+
+  if (_idx < 0) {
+    return;
+  }
 
   if (type == 1) {
     // MONOPOLE
@@ -44,19 +82,235 @@ void insert_force_source(std::shared_ptr<fdm3d_t> waves,
     }
   } else {
     // DIPOLE
-    waves->vx[idx(waves->nx_ghost, waves->ny_ghost, _x + 1, _y, _z)] +=
-        source[it] * waves->dt * (1.0 / model->rho[_idx]) * (1 / (2.0 * waves->dx));
-    waves->vx[idx(waves->nx_ghost, waves->ny_ghost, _x - 1, _y, _z)] -=
-        source[it] * waves->dt * (1.0 / model->rho[_idx]) * (1 / (2.0 * waves->dx));
+    add_at(waves, waves->vx, _x + 1, _y, _z, source[it] * waves->dt * (1.0 / model->rho[_idx]) * (1 / (2.0 * waves->dx)));
+    add_at(waves, waves->vx, _x - 1, _y, _z, -source[it] * waves->dt * (1.0 / model->rho[_idx]) * (1 / (2.0 * waves->dx)));
+
+    add_at(waves, waves->vy, _x, _y + 1, _z, source[it] * waves->dt * (1.0 / model->rho[_idx]) * (1 / (2.0 * waves->dy)));
+    add_at(waves, waves->vy, _x, _y - 1, _z, -source[it] * waves->dt * (1.0 / model->rho[_idx]) * (1 / (2.0 * waves->dy)));
+
+    add_at(waves, waves->vz, _x, _y, _z + 1, source[it] * waves->dt * (1.0 / model->rho[_idx]) * (1 / (2.0 * waves->dz)));
+    add_at(waves, waves->vz, _x, _y, _z - 1, -source[it] * waves->dt * (1.0 / model->rho[_idx]) * (1 / (2.0 * waves->dz)));
+  }
+}
+
+void insert_source(std::shared_ptr<fdm3d_t> waves,
+                   std::shared_ptr<model3d_t> model,
+                   real* source,
+                   const int source_type,
+                   const int _x,
+                   const int _y,
+                   const int _z,
+                   const int direction,
+                   const int it) {
+
+  if (source_type == 1) {
+    insert_stress_source(waves, source, _x, _y, _z, it);
+  } else if (source_type == 2) {
+    insert_force_source(waves, source, model, it, _x, _y, _z, direction, 1);
+  } else {
+    insert_force_source(waves, source, model, it, _x, _y, _z, direction, 2);
+  }
+}
+
+std::shared_ptr<sources_t> sources_setup(const std::string& descriptor, std::shared_ptr<dims_t> dims,
+                                         const int type, const int direction, const int x, const int y,
+                                         const int z) {
+
+  // First point, count and spacing along x, y and z, and the weight of every point
+  std::stringstream descriptor_stream(descriptor);
+  int first[3] = {x, y, z}, count[3] = {1, 1, 1}, step[3] = {0, 0, 0};
+  double weight = 1.0;
+
+  if (!descriptor.empty()) {
+    bool valid = true;
+    for (int d = 0; d < 3 && valid; d++) {
+      valid = (descriptor_stream >> first[d] >> count[d] >> step[d]) && count[d] > 0;
+    }
+    if (valid && !(descriptor_stream >> weight)) {
+      weight = 1.0;
+    }
+
+    if (!valid || (long long) count[0] * count[1] * count[2] > INT_MAX) {
+      std::cerr << "#Source array is not \"x0 nx sx y0 ny sy z0 nz sz [weight]\": " << descriptor
+                << ", using the single source" << std::endl;
+      first[0] = x, first[1] = y, first[2] = z;
+      count[0] = count[1] = count[2] = 1;
+      weight = 1.0;
+    }
+  }
+
+  const int npoints = count[0] * count[1] * count[2];
+
+  std::shared_ptr<sources_t> sources((sources_t*) malloc(sizeof(sources_t)), free_ptr());
+
+  sources->x = (int*) malloc(sizeof(int) * npoints);
+  sources->y = (int*) malloc(sizeof(int) * npoints);
+  sources->z = (int*) malloc(sizeof(int) * npoints);
+  sources->weight = (real*) malloc(sizeof(real) * npoints);
+  sources->type = type;
+  sources->direction = direction;
+  sources->n = 0;
+  sources->offset = NULL;
+  sources->coefficient = NULL;
+  for (int f = 0; f <= kSourceFields; f++) {
+    sources->first[f] = 0;
+  }
+
+  // Keep the points at computed points of the grid
+  const region_t computed = computed_region(dims->nx_ghost, dims->ny_ghost, dims->nz_ghost);
+  int kept = 0;
 
-    waves->vy[idx(waves->nx_ghost, waves->ny_ghost, _x, _y + 1, _z)] +=
-        source[it] * waves->dt * (1.0 / model->rho[_idx]) * (1 / (2.0 * waves->dy));
-    waves->vy[idx(waves->nx_ghost, waves->ny_ghost, _x, _y - 1, _z)] -=
-        source[it] * waves->dt * (1.0 / model->rho[_idx]) * (1 / (2.0 * waves->dy));
+  for (int k = 0; k < count[2]; k++) {
+    for (int j = 0; j < count[1]; j++) {
+      for (int i = 0; i < count[0]; i++) {
+        const int px = first[0] + i * step[0];
+#ifdef ELASTIC_2D
+        const int py = dims->ny_ghost / 2;
+#else
+        const int py = first[1] + j * step[1];
+#endif
+        const int pz = first[2] + k * step[2];
 
-    waves->vz[idx(waves->nx_ghost, waves->ny_ghost, _x, _y, _z + 1)] +=
-        source[it] * waves->dt * (1.0 / model->rho[_idx]) * (1 / (2.0 * waves->dz));
-    waves->vz[idx(waves->nx_ghost, waves->ny_ghost, _x, _y, _z - 1)] -=
-        source[it] * waves->dt * (1.0 / model->rho[_idx]) * (1 / (2.0 * waves->dz));
+        if (px >= computed.i0 && px < computed.i1 && py >= computed.j0 && py < computed.j1
+            && pz >= computed.k0 && pz < computed.k1) {
+          sources->x[kept] = px;
+          sources->y[kept] = py;
+          sources->z[kept] = pz;
+          sources->weight[kept] = weight;
+          kept++;
+        }
+      }
+    }
+  }
+
+  if (kept < npoints) {
+    std::cerr << "#Dropped " << npoints - kept << " of the " << npoints << " source points, outside the computed grid"
+              << std::endl;
+  }
+  if (kept == 0) {
+    sources->x[0] = x;
+    sources->y[0] = y;
+    sources->z[0] = z;
+    sources->weight[0] = 1.0;
+    kept = 1;
+  }
+  sources->npoints = kept;
+
+  return sources;
+}
+
+// Entry of a source before the entries of the same point are merged
+struct source_entry_s {
+  int field;
+  int offset;
+  double coefficient;
+};
+
+void locate_sources(std::shared_ptr<sources_t> sources, std::shared_ptr<fdm3d_t> waves,
+                    std::shared_ptr<model3d_t> model) {
+
+  // At most six entries per point, for the dipoles
+  source_entry_s* entries = (source_entry_s*) malloc(sizeof(source_entry_s) * 6 * sources->npoints);
+  int n = 0;
+
+  auto add_entry = [&](const int field, const int offset, const double coefficient) {
+    if (offset >= 0) {
+      entries[n].field = field;
+      entries[n].offset = offset;
+      entries[n].coefficient = coefficient;
+      n++;
+    }
+  };
+
+  for (int p = 0; p < sources->npoints; p++) {
+    const int x = sources->x[p];
+    const int y = sources->y[p];
+    const int z = sources->z[p];
+    const int centre = local_index(waves, x, y, z);
+
+    if (centre < 0) {
+      continue;
+    }
+
+    const double weight = sources->weight[p];
+
+    if (sources->type == 1) {
+      // Stress monopole into sxx, syy and szz
+      for (int f = 0; f < 3; f++) {
+        add_entry(f, centre, weight);
+      }
+    } else if (sources->type == 2) {
+      // Force monopole into the velocity of the direction
+      const int field = (sources->direction == 1) ? 3 : (sources->direction == 2) ? 4 : 5;
+      add_entry(field, centre, weight * (1.0 / model->rho[centre]));
+    } else {
+      // Force dipole, a central difference of the force along each axis
+      const double scale = weight * (1.0 / model->rho[centre]);
+      add_entry(3, local_index(waves, x + 1, y, z), scale * (1 / (2.0 * waves->dx)));
+      add_entry(3, local_index(waves, x - 1, y, z), -scale * (1 / (2.0 * waves->dx)));
+      add_entry(4, local_index(waves, x, y + 1, z), scale * (1 / (2.0 * waves->dy)));
+      add_entry(4, local_index(waves, x, y - 1, z), -scale * (1 / (2.0 * waves->dy)));
+      add_entry(5, local_index(waves, x, y, z + 1), scale * (1 / (2.0 * waves->dz)));
+      add_entry(5, local_index(waves, x, y, z - 1), -scale * (1 / (2.0 * waves->dz)));
+    }
+  }
+
+  // By field and offset, so the entries of a point follow each other and merge
+  std::sort(entries, entries + n, [](const source_entry_s& a, const source_entry_s& b) {
+    return (a.field != b.field) ? a.field < b.field : a.offset < b.offset;
+  });
+
+  free(sources->offset);
+  free(sources->coefficient);
+  sources->offset = (int*) malloc(sizeof(int) * std::max(n, 1));
+  sources->coefficient = (double*) malloc(sizeof(double) * std::max(n, 1));
+  sources->n = 0;
+  for (int f = 0; f <= kSourceFields; f++) {
+    sources->first[f] = 0;
+  }
+
+  for (int e = 0; e < n; e++) {
+    const int m = sources->n;
+    if (m > 0 && entries[e - 1].field == entries[e].field && entries[e - 1].offset == entries[e].offset) {
+      sources->coefficient[m - 1] += entries[e].coefficient;
+      continue;
+    }
+    sources->offset[m] = entries[e].offset;
+    sources->coefficient[m] = entries[e].coefficient;
+    sources->first[entries[e].field + 1]++;
+    sources->n++;
+  }
+  for (int f = 0; f < kSourceFields; f++) {
+    sources->first[f + 1] += sources->first[f];
+  }
+
+  free(entries);
+}
+
+void inject_sources(std::shared_ptr<sources_t> sources, std::shared_ptr<fdm3d_t> waves, const real* source,
+                    const int it) {
+
+  real* fields[kSourceFields] = {waves->sxx, waves->syy, waves->szz, waves->vx, waves->vy, waves->vz};
+  const real amplitude = source[it] * waves->dt;
+  const int* offset = sources->offset;
+  const double* coefficient = sources->coefficient;
+
+  for (int f = 0; f < kSourceFields; f++) {
+    real* field = fields[f];
+
+    // The offsets of a field are distinct
+    #pragma omp simd
+    for (int e = sources->first[f]; e < sources->first[f + 1]; e++) {
+      field[offset[e]] += amplitude * coefficient[e];
+    }
   }
 }
+
+void free_sources_arrays(std::shared_ptr<sources_t> sources) {
+  free(sources->x);
+  free(sources->y);
+  free(sources->z);
+  free(sources->weight);
+  free(sources->offset);
+  free(sources->coefficient);
+}
@@ -0,0 +1,1024 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: The kernels of one time step, applied to a region of the grid, and the overlap of
+ * the halo exchange with the computation of the interior. The x-z build (ELASTIC_2D) compiles
+ * out the y-derivatives and the updates of vy, sxy and syz, which stay zero in the plane.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "step_engine.h"
+#include "step_forward.h"
+#include "differentiators.h"
+#include "pml3d.h"
+#include "activity.h"
+
+// True if the free surface lies in the local grid, always at the first computed plane
+static bool has_free_surface(std::shared_ptr<fdm3d_t> waves) {
+  return waves->free_surface && waves->z0 == 0;
+}
+
+void image_free_surface(std::shared_ptr<fdm3d_t> waves, const region_t& r, const int nthreads) {
+  if (has_free_surface(waves)) {
+    free_surface_image(waves->szz, waves->sxz, waves->syz, waves->nx_ghost, waves->ny_ghost, r, half_length, nthreads);
+  }
+}
+
+static void velocity_kernels(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                             std::shared_ptr<thread_table_t> threads, const region_t& r, step_context_t* ctx) {
+
+  const int nx_ghost = waves->nx_ghost;
+  const int ny_ghost = waves->ny_ghost;
+  const real dt = waves->dt;
+  const region_t full = full_order_region(waves);
+
+  // Compute Vx
+
+// dx_forward
+#ifdef DXF_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DXF_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DXF_UNCORE);
+#endif
+#ifdef DXF_HDEEM
+  auto dxf_time_start = std::chrono::high_resolution_clock::now();
+  auto dxf_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dx_forward(waves->del1, waves->sxx, nx_ghost, ny_ghost, r, full, 1.0f / waves->dx, threads->nthreads[kDXF]);
+  apply_pml(waves->pml, kDXF, waves->del1, r, threads->nthreads[kDXF]);
+#ifdef DXF_HDEEM
+  auto dxf_time_end = std::chrono::high_resolution_clock::now();
+  double dxf_tstart = (double)dxf_timestamp.count();
+  double dxf_rtime = (dxf_time_end-dxf_time_start).count();
+  ctx->kernels->push_back(kernel("dxf", ctx->it, dxf_tstart, dxf_rtime));
+#endif
+
+// dz_backward
+#ifdef DZB_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DZB_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DZB_UNCORE);
+#endif
+#ifdef DZB_HDEEM
+  auto dzb_time_start = std::chrono::high_resolution_clock::now();
+  auto dzb_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dz_backward(waves->del2, waves->sxz, nx_ghost, ny_ghost, r, full, waves->inv_dz[0], threads->nthreads[kDZB]);
+  apply_pml(waves->pml, kDZB, waves->del2, r, threads->nthreads[kDZB]);
+#ifdef DZB_HDEEM
+  auto dzb_time_end = std::chrono::high_resolution_clock::now();
+  double dzb_tstart = (double)dzb_timestamp.count();
+  double dzb_rtime = (dzb_time_end-dzb_time_start).count();
+  ctx->kernels->push_back(kernel("dzb", ctx->it, dzb_tstart, dzb_rtime));
+#endif
+
+
+#ifndef ELASTIC_2D
+// dy_backward
+#ifdef DYB_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DYB_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DYB_UNCORE);
+#endif
+#ifdef DYB_HDEEM
+  auto dyb_time_start = std::chrono::high_resolution_clock::now();
+  auto dyb_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dy_backward(waves->del3, waves->sxy, nx_ghost, ny_ghost, r, full, 1.0f / waves->dy, threads->nthreads[kDYB]);
+  apply_pml(waves->pml, kDYB, waves->del3, r, threads->nthreads[kDYB]);
+#ifdef DYB_HDEEM
+  auto dyb_time_end = std::chrono::high_resolution_clock::now();
+  double dyb_tstart = (double)dyb_timestamp.count();
+  double dyb_rtime = (dyb_time_end-dyb_time_start).count();
+  ctx->kernels->push_back(kernel("dyb", ctx->it, dyb_tstart, dyb_rtime));
+#endif
+
+#endif
+
+// Compute_vx
+#ifdef CVX_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, CVX_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, CVX_UNCORE);
+#endif
+#ifdef CVX_HDEEM
+  auto cvx_time_start = std::chrono::high_resolution_clock::now();
+  auto cvx_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  compute_vx(waves->vx, model->rho, waves->del1, waves->del2, waves->del3, dt, nx_ghost, ny_ghost, r, threads->nthreads[kCVX], waves->samples);
+#ifdef CVX_HDEEM
+  auto cvx_time_end = std::chrono::high_resolution_clock::now();
+  double cvx_tstart = (double)cvx_timestamp.count();
+  double cvx_rtime = (cvx_time_end-cvx_time_start).count();
+  ctx->kernels->push_back(kernel("cvx", ctx->it, cvx_tstart, cvx_rtime));
+#endif
+
+
+#ifndef ELASTIC_2D
+  // Compute Vy
+
+// dy_foward
+#ifdef DYF_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DYF_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DYF_UNCORE);
+#endif
+#ifdef DYF_HDEEM
+  auto dyf_time_start = std::chrono::high_resolution_clock::now();
+  auto dyf_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dy_forward(waves->del1, waves->syy, nx_ghost, ny_ghost, r, full, 1.0f / waves->dy, threads->nthreads[kDYF]);
+  apply_pml(waves->pml, kDYF, waves->del1, r, threads->nthreads[kDYF]);
+#ifdef DYF_HDEEM
+  auto dyf_time_end = std::chrono::high_resolution_clock::now();
+  double dyf_tstart = (double)dyf_timestamp.count();
+  double dyf_rtime = (dyf_time_end-dyf_time_start).count();
+  ctx->kernels->push_back(kernel("dyf", ctx->it, dyf_tstart, dyf_rtime));
+#endif
+
+// dz_backward
+#ifdef DZB2_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DZB2_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DZB2_UNCORE);
+#endif
+#ifdef DZB2_HDEEM
+  auto dzb2_time_start = std::chrono::high_resolution_clock::now();
+  auto dzb2_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dz_backward(waves->del2, waves->syz, nx_ghost, ny_ghost, r, full, waves->inv_dz[0], threads->nthreads[kDZB2]);
+  apply_pml(waves->pml, kDZB2, waves->del2, r, threads->nthreads[kDZB2]);
+#ifdef DZB2_HDEEM
+  auto dzb2_time_end = std::chrono::high_resolution_clock::now();
+  double dzb2_tstart = (double)dzb2_timestamp.count();
+  double dzb2_rtime = (dzb2_time_end-dzb2_time_start).count();
+  ctx->kernels->push_back(kernel("dzb2", ctx->it, dzb2_tstart, dzb2_rtime));
+#endif
+
+
+// dx_backward
+#ifdef DXB_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DXB_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DXB_UNCORE);
+#endif
+#ifdef DXB_HDEEM
+  auto dxb_time_start = std::chrono::high_resolution_clock::now();
+  auto dxb_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dx_backward(waves->del3, waves->sxy, nx_ghost, ny_ghost, r, full, 1.0f / waves->dx, threads->nthreads[kDXB]);
+  apply_pml(waves->pml, kDXB, waves->del3, r, threads->nthreads[kDXB]);
+#ifdef DXB_HDEEM
+  auto dxb_time_end = std::chrono::high_resolution_clock::now();
+  double dxb_tstart = (double)dxb_timestamp.count();
+  double dxb_rtime = (dxb_time_end-dxb_time_start).count();
+  ctx->kernels->push_back(kernel("dxb", ctx->it, dxb_tstart, dxb_rtime));
+#endif
+
+
+// compute_vy
+#ifdef CVY_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, CVY_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, CVY_UNCORE);
+#endif
+#ifdef CVY_HDEEM
+  auto cvy_time_start = std::chrono::high_resolution_clock::now();
+  auto cvy_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  compute_vy(waves->vy, model->rho, waves->del1, waves->del2, waves->del3, dt, nx_ghost, ny_ghost, r, threads->nthreads[kCVY], waves->samples);
+#ifdef CVY_HDEEM
+  auto cvy_time_end = std::chrono::high_resolution_clock::now();
+  double cvy_tstart = (double)cvy_timestamp.count();
+  double cvy_rtime = (cvy_time_end-cvy_time_start).count();
+  ctx->kernels->push_back(kernel("cvy", ctx->it, cvy_tstart, cvy_rtime));
+#endif
+
+#endif
+
+  // Compute Vz
+
+// dz_forward
+#ifdef DZF_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DZF_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DZF_UNCORE);
+#endif
+#ifdef DZF_HDEEM
+  auto dzf_time_start = std::chrono::high_resolution_clock::now();
+  auto dzf_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dz_forward(waves->del1, waves->szz, nx_ghost, ny_ghost, r, full, waves->inv_dz[1], threads->nthreads[kDZF]);
+  apply_pml(waves->pml, kDZF, waves->del1, r, threads->nthreads[kDZF]);
+#ifdef DZF_HDEEM
+  auto dzf_time_end = std::chrono::high_resolution_clock::now();
+  double dzf_tstart = (double)dzf_timestamp.count();
+  double dzf_rtime = (dzf_time_end-dzf_time_start).count();
+  ctx->kernels->push_back(kernel("dzf", ctx->it, dzf_tstart, dzf_rtime));
+#endif
+
+
+// dx_backward
+#ifdef DXB2_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DXB2_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DXB2_UNCORE);
+#endif
+#ifdef DXB2_HDEEM
+  auto dxb2_time_start = std::chrono::high_resolution_clock::now();
+  auto dxb2_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dx_backward(waves->del2, waves->sxz, nx_ghost, ny_ghost, r, full, 1.0f / waves->dx, threads->nthreads[kDXB2]);
+  apply_pml(waves->pml, kDXB2, waves->del2, r, threads->nthreads[kDXB2]);
+#ifdef DXB2_HDEEM
+  auto dxb2_time_end = std::chrono::high_resolution_clock::now();
+  double dxb2_tstart = (double)dxb2_timestamp.count();
+  double dxb2_rtime = (dxb2_time_end-dxb2_time_start).count();
+  ctx->kernels->push_back(kernel("dxb2", ctx->it, dxb2_tstart, dxb2_rtime));
+#endif
+
+
+#ifndef ELASTIC_2D
+// dy_backward
+#ifdef DYB2_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DYB2_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DYB2_UNCORE);
+#endif
+#ifdef DYB2_HDEEM
+  auto dyb2_time_start = std::chrono::high_resolution_clock::now();
+  auto dyb2_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dy_backward(waves->del3, waves->syz, nx_ghost, ny_ghost, r, full, 1.0f / waves->dy, threads->nthreads[kDYB2]);
+  apply_pml(waves->pml, kDYB2, waves->del3, r, threads->nthreads[kDYB2]);
+#ifdef DYB2_HDEEM
+  auto dyb2_time_end = std::chrono::high_resolution_clock::now();
+  double dyb2_tstart = (double)dyb2_timestamp.count();
+  double dyb2_rtime = (dyb2_time_end-dyb2_time_start).count();
+  ctx->kernels->push_back(kernel("dyb2", ctx->it, dyb2_tstart, dyb2_rtime));
+#endif
+
+#endif
+
+// compute_vz
+#ifdef CVZ_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, CVZ_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, CVZ_UNCORE);
+#endif
+#ifdef CVZ_HDEEM
+  auto cvz_time_start = std::chrono::high_resolution_clock::now();
+  auto cvz_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  compute_vz(waves->vz, model->rho, waves->del1, waves->del2, waves->del3, dt, nx_ghost, ny_ghost, r, threads->nthreads[kCVZ], waves->samples);
+#ifdef CVZ_HDEEM
+  auto cvz_time_end = std::chrono::high_resolution_clock::now();
+  double cvz_tstart = (double)cvz_timestamp.count();
+  double cvz_rtime = (cvz_time_end-cvz_time_start).count();
+  ctx->kernels->push_back(kernel("cvz", ctx->it, cvz_tstart, cvz_rtime));
+#endif
+}
+
+// Velocity kernels where the shear stresses are zero within the reach of the stencils
+// (model->normal_only): each component only takes the derivative of its normal stress
+static void fluid_velocity_kernels(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                                   std::shared_ptr<thread_table_t> threads, const region_t& r, step_context_t* ctx) {
+
+  const int nx_ghost = waves->nx_ghost;
+  const int ny_ghost = waves->ny_ghost;
+  const real dt = waves->dt;
+  const region_t full = full_order_region(waves);
+
+  // Compute Vx
+
+// dx_forward
+#ifdef DXF_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DXF_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DXF_UNCORE);
+#endif
+#ifdef DXF_HDEEM
+  auto dxf_time_start = std::chrono::high_resolution_clock::now();
+  auto dxf_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dx_forward(waves->del1, waves->sxx, nx_ghost, ny_ghost, r, full, 1.0f / waves->dx, threads->nthreads[kDXF]);
+  apply_pml(waves->pml, kDXF, waves->del1, r, threads->nthreads[kDXF]);
+#ifdef DXF_HDEEM
+  auto dxf_time_end = std::chrono::high_resolution_clock::now();
+  double dxf_tstart = (double)dxf_timestamp.count();
+  double dxf_rtime = (dxf_time_end-dxf_time_start).count();
+  ctx->kernels->push_back(kernel("dxf", ctx->it, dxf_tstart, dxf_rtime));
+#endif
+
+// compute_vx
+#ifdef CVX_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, CVX_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, CVX_UNCORE);
+#endif
+#ifdef CVX_HDEEM
+  auto cvx_time_start = std::chrono::high_resolution_clock::now();
+  auto cvx_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  compute_v_normal(waves->vx, model->rho, waves->del1, dt, 0, nx_ghost, ny_ghost, r, threads->nthreads[kCVX], waves->samples);
+#ifdef CVX_HDEEM
+  auto cvx_time_end = std::chrono::high_resolution_clock::now();
+  double cvx_tstart = (double)cvx_timestamp.count();
+  double cvx_rtime = (cvx_time_end-cvx_time_start).count();
+  ctx->kernels->push_back(kernel("cvx", ctx->it, cvx_tstart, cvx_rtime));
+#endif
+
+
+#ifndef ELASTIC_2D
+  // Compute Vy
+
+// dy_forward
+#ifdef DYF_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DYF_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DYF_UNCORE);
+#endif
+#ifdef DYF_HDEEM
+  auto dyf_time_start = std::chrono::high_resolution_clock::now();
+  auto dyf_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dy_forward(waves->del1, waves->syy, nx_ghost, ny_ghost, r, full, 1.0f / waves->dy, threads->nthreads[kDYF]);
+  apply_pml(waves->pml, kDYF, waves->del1, r, threads->nthreads[kDYF]);
+#ifdef DYF_HDEEM
+  auto dyf_time_end = std::chrono::high_resolution_clock::now();
+  double dyf_tstart = (double)dyf_timestamp.count();
+  double dyf_rtime = (dyf_time_end-dyf_time_start).count();
+  ctx->kernels->push_back(kernel("dyf", ctx->it, dyf_tstart, dyf_rtime));
+#endif
+
+// compute_vy
+#ifdef CVY_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, CVY_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, CVY_UNCORE);
+#endif
+#ifdef CVY_HDEEM
+  auto cvy_time_start = std::chrono::high_resolution_clock::now();
+  auto cvy_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  compute_v_normal(waves->vy, model->rho, waves->del1, dt, 1, nx_ghost, ny_ghost, r, threads->nthreads[kCVY], waves->samples);
+#ifdef CVY_HDEEM
+  auto cvy_time_end = std::chrono::high_resolution_clock::now();
+  double cvy_tstart = (double)cvy_timestamp.count();
+  double cvy_rtime = (cvy_time_end-cvy_time_start).count();
+  ctx->kernels->push_back(kernel("cvy", ctx->it, cvy_tstart, cvy_rtime));
+#endif
+
+#endif
+
+  // Compute Vz
+
+// dz_forward
+#ifdef DZF_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DZF_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DZF_UNCORE);
+#endif
+#ifdef DZF_HDEEM
+  auto dzf_time_start = std::chrono::high_resolution_clock::now();
+  auto dzf_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dz_forward(waves->del1, waves->szz, nx_ghost, ny_ghost, r, full, waves->inv_dz[1], threads->nthreads[kDZF]);
+  apply_pml(waves->pml, kDZF, waves->del1, r, threads->nthreads[kDZF]);
+#ifdef DZF_HDEEM
+  auto dzf_time_end = std::chrono::high_resolution_clock::now();
+  double dzf_tstart = (double)dzf_timestamp.count();
+  double dzf_rtime = (dzf_time_end-dzf_time_start).count();
+  ctx->kernels->push_back(kernel("dzf", ctx->it, dzf_tstart, dzf_rtime));
+#endif
+
+// compute_vz
+#ifdef CVZ_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, CVZ_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, CVZ_UNCORE);
+#endif
+#ifdef CVZ_HDEEM
+  auto cvz_time_start = std::chrono::high_resolution_clock::now();
+  auto cvz_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  compute_v_normal(waves->vz, model->rho, waves->del1, dt, 2, nx_ghost, ny_ghost, r, threads->nthreads[kCVZ], waves->samples);
+#ifdef CVZ_HDEEM
+  auto cvz_time_end = std::chrono::high_resolution_clock::now();
+  double cvz_tstart = (double)cvz_timestamp.count();
+  double cvz_rtime = (cvz_time_end-cvz_time_start).count();
+  ctx->kernels->push_back(kernel("cvz", ctx->it, cvz_tstart, cvz_rtime));
+#endif
+}
+
+static void normal_stress_kernels(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                                  std::shared_ptr<thread_table_t> threads, const region_t& r, step_context_t* ctx) {
+
+  const int nx_ghost = waves->nx_ghost;
+  const int ny_ghost = waves->ny_ghost;
+  const real dt = waves->dt;
+  const region_t full = full_order_region(waves);
+
+  // Compute Sxx, Syy, Szz
+
+// dz_backward
+#ifdef DZB3_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DZB3_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DZB3_UNCORE);
+#endif
+#ifdef DZB3_HDEEM
+  auto dzb3_time_start = std::chrono::high_resolution_clock::now();
+  auto dzb3_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dz_backward(waves->del1, waves->vz, nx_ghost, ny_ghost, r, full, waves->inv_dz[0], threads->nthreads[kDZB3]);
+  apply_pml(waves->pml, kDZB3, waves->del1, r, threads->nthreads[kDZB3]);
+#ifdef DZB3_HDEEM
+  auto dzb3_time_end = std::chrono::high_resolution_clock::now();
+  double dzb3_tstart = (double)dzb3_timestamp.count();
+  double dzb3_rtime = (dzb3_time_end-dzb3_time_start).count();
+  ctx->kernels->push_back(kernel("dzb3", ctx->it, dzb3_tstart, dzb3_rtime));
+#endif
+
+
+// dx_backward
+#ifdef DXB3_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DXB3_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DXB3_UNCORE);
+#endif
+#ifdef DXB3_HDEEM
+  auto dxb3_time_start = std::chrono::high_resolution_clock::now();
+  auto dxb3_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dx_backward(waves->del2, waves->vx, nx_ghost, ny_ghost, r, full, 1.0f / waves->dx, threads->nthreads[kDXB3]);
+  apply_pml(waves->pml, kDXB3, waves->del2, r, threads->nthreads[kDXB3]);
+#ifdef DXB3_HDEEM
+  auto dxb3_time_end = std::chrono::high_resolution_clock::now();
+  double dxb3_tstart = (double)dxb3_timestamp.count();
+  double dxb3_rtime = (dxb3_time_end-dxb3_time_start).count();
+  ctx->kernels->push_back(kernel("dxb3", ctx->it, dxb3_tstart, dxb3_rtime));
+#endif
+
+
+#ifndef ELASTIC_2D
+// dy_backward
+#ifdef DYB3_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DYB3_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DYB3_UNCORE);
+#endif
+#ifdef DYB3_HDEEM
+  auto dyb3_time_start = std::chrono::high_resolution_clock::now();
+  auto dyb3_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dy_backward(waves->del3, waves->vy, nx_ghost, ny_ghost, r, full, 1.0f / waves->dy, threads->nthreads[kDYB3]);
+  apply_pml(waves->pml, kDYB3, waves->del3, r, threads->nthreads[kDYB3]);
+#ifdef DYB3_HDEEM
+  auto dyb3_time_end = std::chrono::high_resolution_clock::now();
+  double dyb3_tstart = (double)dyb3_timestamp.count();
+  double dyb3_rtime = (dyb3_time_end-dyb3_time_start).count();
+  ctx->kernels->push_back(kernel("dyb3", ctx->it, dyb3_tstart, dyb3_rtime));
+#endif
+
+#endif
+
+// compute_sxx_syy_szz
+#ifdef CSXXSYYSZZ_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, CSXXSYYSZZ_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, CSXXSYYSZZ_UNCORE);
+#endif
+#ifdef CSXXSYYSZZ_HDEEM
+  auto csxxsyyszz_time_start = std::chrono::high_resolution_clock::now();
+  auto csxxsyyszz_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  compute_sxx_syy_szz(waves->sxx, waves->syy, waves->szz, waves->del1, waves->del2, waves->del3,
+                      model->lambda, model->mu, dt, nx_ghost, ny_ghost, r, threads->nthreads[kCSXXSYYSZZ], waves->samples);
+  if (has_free_surface(waves)) {
+    free_surface_normal(waves->sxx, waves->syy, waves->szz, waves->del1, waves->del2, waves->del3,
+                        model->lambda, model->mu, dt, nx_ghost, ny_ghost, r, half_length, threads->nthreads[kCSXXSYYSZZ],
+                        waves->samples);
+  }
+#ifdef CSXXSYYSZZ_HDEEM
+  auto csxxsyyszz_time_end = std::chrono::high_resolution_clock::now();
+  double csxxsyyszz_tstart = (double)csxxsyyszz_timestamp.count();
+  double csxxsyyszz_rtime = (csxxsyyszz_time_end-csxxsyyszz_time_start).count();
+  ctx->kernels->push_back(kernel("csxxsyyszz", ctx->it, csxxsyyszz_tstart, csxxsyyszz_rtime));
+#endif
+}
+
+static void shear_stress_kernels(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                                 std::shared_ptr<thread_table_t> threads, const region_t& r, step_context_t* ctx) {
+
+  const int nx_ghost = waves->nx_ghost;
+  const int ny_ghost = waves->ny_ghost;
+  const real dt = waves->dt;
+  const region_t full = full_order_region(waves);
+
+#ifndef ELASTIC_2D
+  // Compute Sxy
+
+// dy_forward
+#ifdef DYF2_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DYF2_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DYF2_UNCORE);
+#endif
+#ifdef DYF2_HDEEM
+  auto dyf2_time_start = std::chrono::high_resolution_clock::now();
+  auto dyf2_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dy_forward(waves->del1, waves->vx, nx_ghost, ny_ghost, r, full, 1.0f / waves->dy, threads->nthreads[kDYF2]);
+  apply_pml(waves->pml, kDYF2, waves->del1, r, threads->nthreads[kDYF2]);
+#ifdef DYF2_HDEEM
+  auto dyf2_time_end = std::chrono::high_resolution_clock::now();
+  double dyf2_tstart = (double)dyf2_timestamp.count();
+  double dyf2_rtime = (dyf2_time_end-dyf2_time_start).count();
+  ctx->kernels->push_back(kernel("dyf2", ctx->it, dyf2_tstart, dyf2_rtime));
+#endif
+
+
+// dx_forward
+#ifdef DXF2_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DXF2_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DXF2_UNCORE);
+#endif
+#ifdef DXF2_HDEEM
+  auto dxf2_time_start = std::chrono::high_resolution_clock::now();
+  auto dxf2_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dx_forward(waves->del2, waves->vy, nx_ghost, ny_ghost, r, full, 1.0f / waves->dx, threads->nthreads[kDXF2]);
+  apply_pml(waves->pml, kDXF2, waves->del2, r, threads->nthreads[kDXF2]);
+#ifdef DXF2_HDEEM
+  auto dxf2_time_end = std::chrono::high_resolution_clock::now();
+  double dxf2_tstart = (double)dxf2_timestamp.count();
+  double dxf2_rtime = (dxf2_time_end-dxf2_time_start).count();
+  ctx->kernels->push_back(kernel("dxf2", ctx->it, dxf2_tstart, dxf2_rtime));
+#endif
+
+
+// compute_sxy
+#ifdef CSXY_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, CSXY_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, CSXY_UNCORE);
+#endif
+#ifdef CSXY_HDEEM
+  auto csxy_time_start = std::chrono::high_resolution_clock::now();
+  auto csxy_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  compute_sxy(waves->sxy, model->mu, waves->del1, waves->del2, dt, nx_ghost, ny_ghost, r, threads->nthreads[kCSXY]);
+#ifdef CSXY_HDEEM
+  auto csxy_time_end = std::chrono::high_resolution_clock::now();
+  double csxy_tstart = (double)csxy_timestamp.count();
+  double csxy_rtime = (csxy_time_end-csxy_time_start).count();
+  ctx->kernels->push_back(kernel("csxy", ctx->it, csxy_tstart, csxy_rtime));
+#endif
+
+
+  // Compute Syz
+
+// dz_forward
+#ifdef DZF2_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DZF2_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DZF2_UNCORE);
+#endif
+#ifdef DZF2_HDEEM
+  auto dzf2_time_start = std::chrono::high_resolution_clock::now();
+  auto dzf2_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dz_forward(waves->del1, waves->vy, nx_ghost, ny_ghost, r, full, waves->inv_dz[1], threads->nthreads[kDZF2]);
+  apply_pml(waves->pml, kDZF2, waves->del1, r, threads->nthreads[kDZF2]);
+#ifdef DZF2_HDEEM
+  auto dzf2_time_end = std::chrono::high_resolution_clock::now();
+  double dzf2_tstart = (double)dzf2_timestamp.count();
+  double dzf2_rtime = (dzf2_time_end-dzf2_time_start).count();
+  ctx->kernels->push_back(kernel("dzf2", ctx->it, dzf2_tstart, dzf2_rtime));
+#endif
+
+
+// dy_forward
+#ifdef DYF3_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DYF3_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DYF3_UNCORE);
+#endif
+#ifdef DYF3_HDEEM
+  auto dyf3_time_start = std::chrono::high_resolution_clock::now();
+  auto dyf3_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dy_forward(waves->del2, waves->vz, nx_ghost, ny_ghost, r, full, 1.0f / waves->dy, threads->nthreads[kDYF3]);
+  apply_pml(waves->pml, kDYF3, waves->del2, r, threads->nthreads[kDYF3]);
+#ifdef DYF3_HDEEM
+  auto dyf3_time_end = std::chrono::high_resolution_clock::now();
+  double dyf3_tstart = (double)dyf3_timestamp.count();
+  double dyf3_rtime = (dyf3_time_end-dyf3_time_start).count();
+  ctx->kernels->push_back(kernel("dyf3", ctx->it, dyf3_tstart, dyf3_rtime));
+#endif
+
+
+// compute_syz
+#ifdef CSYZ_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, CSYZ_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, CSYZ_UNCORE);
+#endif
+#ifdef CSYZ_HDEEM
+  auto csyz_time_start = std::chrono::high_resolution_clock::now();
+  auto csyz_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  compute_syz(waves->syz, model->mu, waves->del1, waves->del2, dt, nx_ghost, ny_ghost, r, threads->nthreads[kCSYZ]);
+#ifdef CSYZ_HDEEM
+  auto csyz_time_end = std::chrono::high_resolution_clock::now();
+  double csyz_tstart = (double)csyz_timestamp.count();
+  double csyz_rtime = (csyz_time_end-csyz_time_start).count();
+  ctx->kernels->push_back(kernel("csyz", ctx->it, csyz_tstart, csyz_rtime));
+#endif
+
+#endif
+
+  // Compute Sxz
+
+// dx_forward
+#ifdef DXF3_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DXF3_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DXF3_UNCORE);
+#endif
+#ifdef DXF3_HDEEM
+  auto dxf3_time_start = std::chrono::high_resolution_clock::now();
+  auto dxf3_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dx_forward(waves->del1, waves->vz, nx_ghost, ny_ghost, r, full, 1.0f / waves->dx, threads->nthreads[kDXF3]);
+  apply_pml(waves->pml, kDXF3, waves->del1, r, threads->nthreads[kDXF3]);
+#ifdef DXF3_HDEEM
+  auto dxf3_time_end = std::chrono::high_resolution_clock::now();
+  double dxf3_tstart = (double)dxf3_timestamp.count();
+  double dxf3_rtime = (dxf3_time_end-dxf3_time_start).count();
+  ctx->kernels->push_back(kernel("dxf3", ctx->it, dxf3_tstart, dxf3_rtime));
+#endif
+
+
+// dz_forward
+#ifdef DZF3_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, DZF3_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, DZF3_UNCORE);
+#endif
+#ifdef DZF3_HDEEM
+  auto dzf3_time_start = std::chrono::high_resolution_clock::now();
+  auto dzf3_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  dz_forward(waves->del2, waves->vx, nx_ghost, ny_ghost, r, full, waves->inv_dz[1], threads->nthreads[kDZF3]);
+  apply_pml(waves->pml, kDZF3, waves->del2, r, threads->nthreads[kDZF3]);
+#ifdef DZF3_HDEEM
+  auto dzf3_time_end = std::chrono::high_resolution_clock::now();
+  double dzf3_tstart = (double)dzf3_timestamp.count();
+  double dzf3_rtime = (dzf3_time_end-dzf3_time_start).count();
+  ctx->kernels->push_back(kernel("dzf3", ctx->it, dzf3_tstart, dzf3_rtime));
+#endif
+
+
+// compute_sxz
+#ifdef CSXZ_DVFS
+  set_all_core_freq(ctx->core_type, ctx->fd, ctx->pstate_idx, CSXZ_CORE);
+  set_uncore_freq(ctx->uncore_type, ctx->numa_nodes, ctx->uncore_min_idx, ctx->uncore_max_idx, CSXZ_UNCORE);
+#endif
+#ifdef CSXZ_HDEEM
+  auto csxz_time_start = std::chrono::high_resolution_clock::now();
+  auto csxz_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+#endif
+  compute_sxz(waves->sxz, model->mu, waves->del1, waves->del2, dt, nx_ghost, ny_ghost, r, threads->nthreads[kCSXZ]);
+#ifdef CSXZ_HDEEM
+  auto csxz_time_end = std::chrono::high_resolution_clock::now();
+  double csxz_tstart = (double)csxz_timestamp.count();
+  double csxz_rtime = (csxz_time_end-csxz_time_start).count();
+  ctx->kernels->push_back(kernel("csxz", ctx->it, csxz_tstart, csxz_rtime));
+#endif
+}
+
+typedef void (*half_step_kernels)(std::shared_ptr<fdm3d_t>, std::shared_ptr<model3d_t>,
+                                  std::shared_ptr<thread_table_t>, const region_t&, step_context_t*);
+
+// Applies the kernels of a half step to the parts of r in the boxes of the active tiles, or to
+// all of r without an activity mask
+static void active_parts(half_step_kernels kernels, std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                         std::shared_ptr<thread_table_t> threads, const region_t& r, step_context_t* ctx) {
+  const activity_t* activity = waves->activity;
+
+  if (activity == NULL || activity->complete) {
+    kernels(waves, model, threads, r, ctx);
+    return;
+  }
+
+  for (int b = 0; b < activity->nboxes; b++) {
+    const region_t part = intersect_regions(r, local_box(waves, b));
+    if (!is_empty(part)) {
+      kernels(waves, model, threads, part, ctx);
+    }
+  }
+}
+
+// Skip the shear work in the fluid planes of the model
+static bool fluid_path = true;
+
+void set_fluid_path(const bool enabled) {
+  fluid_path = enabled;
+}
+
+// Runs kernels on the runs of planes of r where flags[k] is set, and other on the rest. Either
+// may be NULL to leave its planes alone.
+static void plane_runs(const char* flags, half_step_kernels kernels, half_step_kernels other,
+                       std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                       std::shared_ptr<thread_table_t> threads, const region_t& r, step_context_t* ctx) {
+  int k0 = r.k0;
+  while (k0 < r.k1) {
+    const bool set = flags[k0];
+    int k1 = k0 + 1;
+    while (k1 < r.k1 && (bool) flags[k1] == set) {
+      k1++;
+    }
+
+    half_step_kernels run = set ? kernels : other;
+    if (run != NULL) {
+      run(waves, model, threads, make_region(r.i0, r.i1, r.j0, r.j1, k0, k1), ctx);
+    }
+    k0 = k1;
+  }
+}
+
+static void velocity_half_step(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                               std::shared_ptr<thread_table_t> threads, const region_t& r, step_context_t* ctx) {
+  if (fluid_path) {
+    plane_runs(model->normal_only, fluid_velocity_kernels, velocity_kernels, waves, model, threads, r, ctx);
+  } else {
+    velocity_kernels(waves, model, threads, r, ctx);
+  }
+}
+
+static void stress_half_step(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                             std::shared_ptr<thread_table_t> threads, const region_t& r, step_context_t* ctx) {
+  normal_stress_kernels(waves, model, threads, r, ctx);
+  if (fluid_path) {
+    plane_runs(model->shear_free, NULL, shear_stress_kernels, waves, model, threads, r, ctx);
+  } else {
+    shear_stress_kernels(waves, model, threads, r, ctx);
+  }
+}
+
+void update_velocities(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                       std::shared_ptr<thread_table_t> threads, const region_t& r, step_context_t* ctx) {
+  active_parts(velocity_half_step, waves, model, threads, r, ctx);
+}
+
+void update_stresses(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                     std::shared_ptr<thread_table_t> threads, const region_t& r, step_context_t* ctx) {
+  active_parts(stress_half_step, waves, model, threads, r, ctx);
+}
+
+void kernel_passes(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model, real* passes) {
+  // Derivative and update kernels per point of the full and the fluid half steps
+  const real velocity = (half_length_y > 0) ? 12.0 : 6.0;
+  const real fluid_velocity = (half_length_y > 0) ? 6.0 : 4.0;
+  const real normal_stress = (half_length_y > 0) ? 4.0 : 3.0;
+  const real shear_stress = (half_length_y > 0) ? 9.0 : 3.0;
+
+  const region_t computed = computed_region(waves->nx_ghost, waves->ny_ghost, waves->nz_ghost);
+  const real plane = (real) (computed.i1 - computed.i0) * (computed.j1 - computed.j0);
+
+  passes[0] = 0.0;
+  passes[1] = 0.0;
+  for (int k = computed.k0; k < computed.k1; k++) {
+    const bool velocity_fluid = fluid_path && model->normal_only[k];
+    const bool stress_fluid = fluid_path && model->shear_free[k];
+    passes[0] += plane * ((velocity_fluid ? fluid_velocity : velocity) + normal_stress
+                          + (stress_fluid ? 0.0 : shear_stress));
+    passes[1] += plane * (velocity + normal_stress + shear_stress);
+  }
+}
+
+std::shared_ptr<step_regions_t> step_regions_setup(std::shared_ptr<decomp_t> decomp, std::shared_ptr<fdm3d_t> waves) {
+
+  std::shared_ptr<step_regions_t> regions((step_regions_t*) malloc(sizeof(step_regions_t)), free_ptr());
+
+  const int h = decomp->halo;
+  const int n[3] = {waves->nx_ghost, waves->ny_ghost, waves->nz_ghost};
+
+  // Computed box and, inside it, the points at least one stencil away from every halo
+  int lo[3], hi[3], inner_lo[3], inner_hi[3];
+  for (int d = 0; d < 3; d++) {
+    lo[d] = stencil_border(d);
+    hi[d] = n[d] - stencil_border(d);
+    inner_lo[d] = lo[d] + (decomp->neighbours[2 * d] >= 0 ? h : 0);
+    inner_hi[d] = hi[d] - (decomp->neighbours[2 * d + 1] >= 0 ? h : 0);
+    inner_hi[d] = std::max(inner_hi[d], inner_lo[d]);
+  }
+
+  regions->interior = make_region(inner_lo[0], inner_hi[0], inner_lo[1], inner_hi[1], inner_lo[2], inner_hi[2]);
+  regions->nboundary = 0;
+
+  // Slabs along x cover the full box in y and z, slabs along y the interior range in x, and
+  // slabs along z the interior range in x and y
+  for (int d = 0; d < 3; d++) {
+    for (int side = 0; side < 2; side++) {
+      int b[3][2];
+      for (int e = 0; e < 3; e++) {
+        b[e][0] = (e < d) ? inner_lo[e] : lo[e];
+        b[e][1] = (e < d) ? inner_hi[e] : hi[e];
+      }
+      b[d][0] = side ? inner_hi[d] : lo[d];
+      b[d][1] = side ? hi[d] : inner_lo[d];
+
+      region_t slab = make_region(b[0][0], b[0][1], b[1][0], b[1][1], b[2][0], b[2][1]);
+      if (!is_empty(slab)) {
+        regions->boundary[regions->nboundary++] = slab;
+      }
+    }
+  }
+
+  return regions;
+}
+
+std::shared_ptr<step_timing_t> step_timing_setup(const bool print_steps) {
+
+  std::shared_ptr<step_timing_t> timing((step_timing_t*) malloc(sizeof(step_timing_t)), free_ptr());
+
+  timing->compute = 0.0;
+  timing->exposed = 0.0;
+  timing->print_steps = print_steps;
+
+  return timing;
+}
+
+static double seconds_between(std::chrono::high_resolution_clock::time_point start,
+                              std::chrono::high_resolution_clock::time_point stop) {
+  return std::chrono::duration<double>(stop - start).count();
+}
+
+// The computed box with the sides next to a neighbouring rank moved width points into the grid
+static region_t shrunk_region(std::shared_ptr<decomp_t> decomp, std::shared_ptr<fdm3d_t> waves, const int width) {
+  const int n[3] = {waves->nx_ghost, waves->ny_ghost, waves->nz_ghost};
+  int lo[3], hi[3];
+
+  for (int d = 0; d < 3; d++) {
+    lo[d] = (decomp->neighbours[2 * d] >= 0) ? width : stencil_border(d);
+    hi[d] = n[d] - ((decomp->neighbours[2 * d + 1] >= 0) ? width : stencil_border(d));
+  }
+
+  return make_region(lo[0], hi[0], lo[1], hi[1], lo[2], hi[2]);
+}
+
+// Time step with a halo of 2 * depth * half_length points that is refreshed every depth steps.
+// Step s of the cycle updates the velocities up to (2s + 1) * half_length points from the edge
+// of the local grid and the stresses up to 2(s + 1) * half_length points from it, so the
+// owned points are always exact.
+static void deep_halo_time_step(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+                                std::shared_ptr<thread_table_t> threads, std::shared_ptr<decomp_t> decomp,
+                                step_context_t* ctx, std::shared_ptr<step_timing_t> timing) {
+
+  const int s = ctx->it % decomp->depth;
+
+  auto t0 = std::chrono::high_resolution_clock::now();
+
+  if (s == 0) {
+    exchange_halos(decomp, {waves->vx, waves->vy, waves->vz,
+                            waves->sxx, waves->syy, waves->szz, waves->sxy, waves->syz, waves->sxz});
+  }
+  auto t1 = std::chrono::high_resolution_clock::now();
+
+  update_velocities(waves, model, threads, shrunk_region(decomp, waves, (2 * s + 1) * half_length), ctx);
+  const region_t stress_region = shrunk_region(decomp, waves, 2 * (s + 1) * half_length);
+  update_stresses(waves, model, threads, stress_region, ctx);
+  image_free_surface(waves, stress_region, threads->nthreads[kCSXZ]);
+  auto t2 = std::chrono::high_resolution_clock::now();
+
+  const double exposed = seconds_between(t0, t1);
+  const double compute = seconds_between(t1, t2);
+
+  timing->compute += compute;
+  timing->exposed += exposed;
+
+  if (timing->print_steps && decomp->rank == 0) {
+    std::cout << "#Step " << ctx->it << ": compute " << compute << " s, exposed communication "
+              << exposed << " s" << std::endl;
+  }
+}
+
+void time_step(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model,
+               std::shared_ptr<thread_table_t> threads, std::shared_ptr<decomp_t> decomp,
+               std::shared_ptr<step_regions_t> regions, step_context_t* ctx,
+               std::shared_ptr<step_timing_t> timing) {
+
+  if (decomp->depth > 0) {
+    deep_halo_time_step(waves, model, threads, decomp, ctx, timing);
+    return;
+  }
+
+  auto t0 = std::chrono::high_resolution_clock::now();
+
+  // Velocities: the stresses of the previous step travel while the interior is updated
+  begin_halo_exchange(decomp, {waves->sxx, waves->syy, waves->szz, waves->sxy, waves->syz, waves->sxz});
+  auto t1 = std::chrono::high_resolution_clock::now();
+
+  update_velocities(waves, model, threads, regions->interior, ctx);
+  auto t2 = std::chrono::high_resolution_clock::now();
+
+  finish_halo_exchange(decomp);
+  auto t3 = std::chrono::high_resolution_clock::now();
+
+  for (int b = 0; b < regions->nboundary; b++) {
+    update_velocities(waves, model, threads, regions->boundary[b], ctx);
+  }
+  auto t4 = std::chrono::high_resolution_clock::now();
+
+  // Stresses: same pattern with the new velocities
+  begin_halo_exchange(decomp, {waves->vx, waves->vy, waves->vz});
+  auto t5 = std::chrono::high_resolution_clock::now();
+
+  update_stresses(waves, model, threads, regions->interior, ctx);
+  auto t6 = std::chrono::high_resolution_clock::now();
+
+  finish_halo_exchange(decomp);
+  auto t7 = std::chrono::high_resolution_clock::now();
+
+  for (int b = 0; b < regions->nboundary; b++) {
+    update_stresses(waves, model, threads, regions->boundary[b], ctx);
+  }
+  image_free_surface(waves, computed_region(waves->nx_ghost, waves->ny_ghost, waves->nz_ghost),
+                     threads->nthreads[kCSXZ]);
+  auto t8 = std::chrono::high_resolution_clock::now();
+
+  const double exposed = seconds_between(t0, t1) + seconds_between(t2, t3)
+                       + seconds_between(t4, t5) + seconds_between(t6, t7);
+  const double compute = seconds_between(t0, t8) - exposed;
+
+  timing->compute += compute;
+  timing->exposed += exposed;
+
+  if (timing->print_steps && decomp->rank == 0) {
+    std::cout << "#Step " << ctx->it << ": compute " << compute << " s, exposed communication "
+              << exposed << " s" << std::endl;
+  }
+}
+
+// Seconds per grid point for a full time step, measured on a small quiescent grid
+static double time_per_point(const int nthreads, step_context_t* ctx) {
+
+  const int kProbeSize = 48;
+  const int kRepetitions = 3;
+
+  std::shared_ptr<dims_t> dims = size_setup(kProbeSize, kProbeSize, kProbeSize, 1, 0, 10.0, 10.0, 10.0, 0.001);
+  std::shared_ptr<fdm3d_t> waves = fdm3d_setup(dims);
+  std::shared_ptr<model3d_t> model = model_setup(dims);
+  std::shared_ptr<thread_table_t> threads = thread_table_setup(nthreads);
+  set_uniform_model(model, dims, 1000.0, 2200.0, 1000.0);
+
+  const region_t r = computed_region(kProbeSize, kProbeSize, kProbeSize);
+
+  // The first step warms up the caches and the thread pool
+  double seconds = 0.0;
+  for (int rep = 0; rep <= kRepetitions; rep++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    update_velocities(waves, model, threads, r, ctx);
+    update_stresses(waves, model, threads, r, ctx);
+    auto stop = std::chrono::high_resolution_clock::now();
+    if (rep > 0) {
+      seconds += seconds_between(start, stop);
+    }
+  }
+
+  free_wave_arrays(waves);
+  free_model_arrays(model);
+
+  return seconds / (kRepetitions * region_points(r));
+}
+
+int select_halo_depth(std::shared_ptr<decomp_t> decomp, const int nthreads, step_context_t* ctx) {
+
+  const int kMaxDepth = 8;
+  const int kHaloFields = 9;
+
+  double latency, bandwidth;
+  measure_links(decomp, &latency, &bandwidth);
+
+  if (latency == 0.0 || bandwidth == 0.0) {
+    return 0;
+  }
+
+  // The probe must not end up in the energy measurements of the run
+  step_context_t probe_ctx = *ctx;
+#ifdef HDEEM
+  std::vector<kernel> probe_kernels;
+  probe_ctx.kernels = &probe_kernels;
+#endif
+  const double point_time = max_over_ranks(decomp, time_per_point(nthreads, &probe_ctx));
+
+  // Modelled cost per step of the exchanges and the redundant updates at every face. The per
+  // half step exchange sends two messages per step with half_length planes of every field. A
+  // depth m halo sends one message with 2 * m * half_length planes every m steps, and its two
+  // half steps update 2 * (2m - 1) * half_length extra planes per step on average, each at
+  // half the time of a full point.
+  double best_cost = 0.0;
+  int best_depth = 0;
+
+  for (int m = 0; m <= kMaxDepth; m++) {
+    double cost = 0.0;
+
+    for (int f = 0; f < 6; f++) {
+      if (decomp->neighbours[f] < 0) {
+        continue;
+      }
+      const int d = f / 2;
+      const double face = (double) decomp->local_n[(d + 1) % 3] * decomp->local_n[(d + 2) % 3];
+
+      if (m == 0) {
+        cost += 2.0 * latency + kHaloFields * face * half_length * sizeof(real) / bandwidth;
+      } else {
+        cost += latency / m + kHaloFields * face * 2 * half_length * sizeof(real) / bandwidth
+              + face * (2 * m - 1) * half_length * point_time / 2;
+      }
+    }
+
+    if (m == 0 || cost < best_cost) {
+      best_cost = cost;
+      best_depth = m;
+    }
+  }
+
+  return best_depth;
+}
@@ -6,65 +6,156 @@
  */
 
 #include "step_forward.h"
+#include "differentiators.h"
+
+// The y-derivative in the velocity and normal stress updates (their del3). The x-z build takes
+// none, and the compiler drops the load.
+static inline real y_derivative(const real* __restrict__ del, const int p) {
+#ifdef ELASTIC_2D
+  (void) del;
+  (void) p;
+  return 0.0;
+#else
+  return del[p];
+#endif
+}
+
+// True if the updates sample field c (0: pressure, 1, 2, 3: vx, vy, vz, 4: dilatation rate)
+static inline bool sampled(const plane_samples_t* samples, const int c) {
+  return samples != NULL && samples->to[c] != NULL;
+}
+
+static inline bool in_columns(const plane_samples_t* samples, const int s, const region_t& r) {
+  return samples->x[s] >= r.i0 && samples->x[s] < r.i1 && samples->y[s] >= r.j0 && samples->y[s] < r.j1;
+}
+
+// Samples the receivers of plane k in the columns of r from field c, or from the mean of the
+// normal stresses
+static void sample_plane(const plane_samples_t* samples, const int c, const real* field, const int k,
+                         const region_t& r) {
+  if (!sampled(samples, c)) {
+    return;
+  }
+
+  for (int s = samples->first[k]; s < samples->first[k + 1]; s++) {
+    if (in_columns(samples, s, r)) {
+      samples->to[c][s] = field[samples->offset[s]];
+    }
+  }
+}
+
+static void sample_pressure_plane(const plane_samples_t* samples, const real* sxx, const real* syy,
+                                  const real* szz, const int k, const region_t& r) {
+  if (!sampled(samples, 0)) {
+    return;
+  }
+
+  for (int s = samples->first[k]; s < samples->first[k + 1]; s++) {
+    if (in_columns(samples, s, r)) {
+      const int p = samples->offset[s];
+      samples->to[0][s] = kOneThird * (sxx[p] + syy[p] + szz[p]);
+    }
+  }
+}
+
+// Dilatation rate from the derivatives of the normal stress update, dvz/dz in del1, dvx/dx in
+// del2 and dvy/dy in del3
+static void sample_dilatation_plane(const plane_samples_t* samples, const real* del1, const real* del2,
+                                    const real* del3, const int k, const region_t& r) {
+  if (!sampled(samples, 4)) {
+    return;
+  }
+
+  for (int s = samples->first[k]; s < samples->first[k + 1]; s++) {
+    if (in_columns(samples, s, r)) {
+      const int p = samples->offset[s];
+      samples->to[4][s] = del1[p] + del2[p] + y_derivative(del3, p);
+    }
+  }
+}
 
 void compute_vx(real* vx, const real* __restrict__ rho, const real* __restrict__ del1,
                 const real* __restrict__ del2, const real* __restrict__ del3, const real dt,
-                const int nx_ghost, const int ny_ghost, const int nz_ghost, const int nthreads) {
+                const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads,
+                const plane_samples_t* samples) {
 
   #pragma omp parallel for num_threads(nthreads)
-  for (int k = 0; k < nz_ghost; k++) {
-    for (int j = 0; j < ny_ghost; j++) {
-      for (int i = 0; i < nx_ghost-1; i++) {
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      for (int i = r.i0; i < r.i1; i++) {
         vx[idx(nx_ghost, ny_ghost, i, j, k)] += dt * (2.0 / (rho[idx(nx_ghost, ny_ghost, i, j, k)]
             + rho[idx(nx_ghost, ny_ghost, i+1, j, k)])) * (del1[idx(nx_ghost, ny_ghost, i, j, k)]
-            + del2[idx(nx_ghost, ny_ghost, i, j, k)] + del3[idx(nx_ghost, ny_ghost, i, j, k)]);
+            + del2[idx(nx_ghost, ny_ghost, i, j, k)] + y_derivative(del3, idx(nx_ghost, ny_ghost, i, j, k)));
       }
     }
+    sample_plane(samples, 1, vx, k, r);
   }
 }
 
 void compute_vy(real* vy, const real* __restrict__ rho, const real* __restrict__ del1,
                 const real* __restrict__ del2, const real* __restrict__ del3, const real dt,
-                const int nx_ghost, const int ny_ghost, const int nz_ghost, const int nthreads) {
+                const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads,
+                const plane_samples_t* samples) {
 
   #pragma omp parallel for num_threads(nthreads)
-  for (int k = 0; k < nz_ghost; k++) {
-    for (int j = 0; j < ny_ghost - 1; j++) {
-      for (int i = 0; i < nx_ghost; i++) {
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      for (int i = r.i0; i < r.i1; i++) {
         vy[idx(nx_ghost, ny_ghost, i, j, k)] += dt * (2.0 / (rho[idx(nx_ghost, ny_ghost, i, j, k)]
             + rho[idx(nx_ghost, ny_ghost, i, j+1, k)])) * (del1[idx(nx_ghost, ny_ghost, i, j, k)]
             + del2[idx(nx_ghost, ny_ghost, i, j, k)] + del3[idx(nx_ghost, ny_ghost, i, j, k)]);
       }
     }
+    sample_plane(samples, 2, vy, k, r);
   }
 }
 
 
 void compute_vz(real* vz, const real* __restrict__ rho, const real* __restrict__ del1,
                 const real* __restrict__ del2, const real* __restrict__ del3, const real dt,
-                const int nx_ghost, const int ny_ghost, const int nz_ghost, const int nthreads) {
+                const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads,
+                const plane_samples_t* samples) {
 
   #pragma omp parallel for num_threads(nthreads)
-  for (int k = 0; k < nz_ghost - 1; k++) {
-    for (int j = 0; j < ny_ghost; j++) {
-      for (int i = 0; i < nx_ghost; i++) {
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      for (int i = r.i0; i < r.i1; i++) {
         vz[idx(nx_ghost, ny_ghost, i, j, k)] += dt * (2.0 / (rho[idx(nx_ghost, ny_ghost, i, j, k)]
             + rho[idx(nx_ghost, ny_ghost, i, j, k+1)])) * (del1[idx(nx_ghost, ny_ghost, i, j, k)]
-            + del2[idx(nx_ghost, ny_ghost, i, j, k)] + del3[idx(nx_ghost, ny_ghost, i, j, k)]);
+            + del2[idx(nx_ghost, ny_ghost, i, j, k)] + y_derivative(del3, idx(nx_ghost, ny_ghost, i, j, k)));
       }
     }
+    sample_plane(samples, 3, vz, k, r);
   }
 }
 
 
+void compute_v_normal(real* v, const real* __restrict__ rho, const real* __restrict__ del, const real dt,
+                      const int d, const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads,
+                      const plane_samples_t* samples) {
+
+  const int offset = (d == 0) ? 1 : (d == 1) ? nx_ghost : nx_ghost * ny_ghost;
+
+  #pragma omp parallel for num_threads(nthreads)
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      for (int i = r.i0; i < r.i1; i++) {
+        const int p = idx(nx_ghost, ny_ghost, i, j, k);
+        v[p] += dt * (2.0 / (rho[p] + rho[p + offset])) * del[p];
+      }
+    }
+    sample_plane(samples, d + 1, v, k, r);
+  }
+}
+
 void compute_sxy(real* sxy, const real* __restrict__ mu, const real* __restrict__ del1,
                  const real* __restrict__ del2, const real dt,
-                 const int nx_ghost, const int ny_ghost, const int nz_ghost, const int nthreads) {
+                 const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads) {
 
   #pragma omp parallel for num_threads(nthreads)
-  for (int k = 0; k < nz_ghost; k++) {
-    for (int j = 0; j < ny_ghost - 1; j++) {
-      for (int i = 0; i < nx_ghost - 1; i++) {
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      for (int i = r.i0; i < r.i1; i++) {
         sxy[idx(nx_ghost, ny_ghost, i, j, k)] += dt * (mu[idx(nx_ghost, ny_ghost, i, j, k)]
             + mu[idx(nx_ghost, ny_ghost, i + 1, j, k)] + mu[idx(nx_ghost, ny_ghost, i, j + 1, k)]
             + mu[idx(nx_ghost, ny_ghost, i + 1, j + 1, k)]) * 0.25 * (del1[idx(nx_ghost, ny_ghost, i, j, k)]
@@ -76,12 +167,12 @@ void compute_sxy(real* sxy, const real* __restrict__ mu, const real* __restrict_
 
 void compute_syz(real* syz, const real* __restrict__ mu, const real* __restrict__ del1,
                  const real* __restrict__ del2, const real dt,
-                 const int nx_ghost, const int ny_ghost, const int nz_ghost, const int nthreads) {
+                 const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads) {
 
   #pragma omp parallel for num_threads(nthreads)
-  for (int k = 0; k < nz_ghost - 1; k++) {
-    for (int j = 0; j < ny_ghost - 1; j++) {
-      for (int i = 0; i < nx_ghost; i++) {
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      for (int i = r.i0; i < r.i1; i++) {
         syz[idx(nx_ghost, ny_ghost, i, j, k)] += dt * (mu[idx(nx_ghost, ny_ghost, i, j, k)]
             + mu[idx(nx_ghost, ny_ghost, i, j+1, k)] + mu[idx(nx_ghost, ny_ghost, i, j, k+1)]
             + mu[idx(nx_ghost, ny_ghost, i, j+1, k+1)]) * 0.25 * (del1[idx(nx_ghost, ny_ghost, i, j, k)]
@@ -93,12 +184,12 @@ void compute_syz(real* syz, const real* __restrict__ mu, const real* __restrict_
 
 void compute_sxz(real* sxz, const real* __restrict__ mu, const real* __restrict__ del1,
                  const real* __restrict__ del2, const real dt,
-                 const int nx_ghost, const int ny_ghost, const int nz_ghost, const int nthreads) {
+                 const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads) {
 
   #pragma omp parallel for num_threads(nthreads)
-  for (int k = 0; k < nz_ghost - 1; k++) {
-    for (int j = 0; j < ny_ghost; j++) {
-      for (int i = 0; i < nx_ghost - 1; i++) {
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      for (int i = r.i0; i < r.i1; i++) {
         sxz[idx(nx_ghost, ny_ghost, i, j, k)] += dt * (mu[idx(nx_ghost, ny_ghost, i, j, k)]
             + mu[idx(nx_ghost, ny_ghost, i+1, j, k)] + mu[idx(nx_ghost, ny_ghost, i, j+1, k)]
             + mu[idx(nx_ghost, ny_ghost, i+1, j, k+1)]) * 0.25 * (del1[idx(nx_ghost, ny_ghost, i, j, k)]
@@ -111,21 +202,22 @@ void compute_sxz(real* sxz, const real* __restrict__ mu, const real* __restrict_
 void compute_sxx_syy_szz(real* sxx, real* syy, real* szz, const real* __restrict__ del1,
                          const real* __restrict__ del2, const real* __restrict__ del3,
                          const real* __restrict__ lambda, const real* __restrict__ mu,  const real dt,
-                         const int nx_ghost, const int ny_ghost, const int nz_ghost, const int nthreads) {
+                         const int nx_ghost, const int ny_ghost, const region_t& r, const int nthreads,
+                         const plane_samples_t* samples) {
 
   #pragma omp parallel for num_threads(nthreads)
-  for (int k = 0; k < nz_ghost; k++) {
-    for (int j = 0; j < ny_ghost; j++) {
-      for (int i = 0; i < nx_ghost; i++) {
+  for (int k = r.k0; k < r.k1; k++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      for (int i = r.i0; i < r.i1; i++) {
         sxx[idx(nx_ghost, ny_ghost, i, j, k)] += dt * ((lambda[idx(nx_ghost, ny_ghost, i, j, k)]
             + 2.0 * mu[idx(nx_ghost, ny_ghost, i, j, k)])
             * del2[idx(nx_ghost, ny_ghost, i, j, k)]
             + lambda[idx(nx_ghost, ny_ghost, i, j, k)] * (del1[idx(nx_ghost, ny_ghost, i, j, k)]
-                + del3[idx(nx_ghost, ny_ghost, i, j, k)]));
+                + y_derivative(del3, idx(nx_ghost, ny_ghost, i, j, k))));
 
         syy[idx(nx_ghost, ny_ghost, i, j, k)] += dt * ((lambda[idx(nx_ghost, ny_ghost, i, j, k)]
             + 2.0 * mu[idx(nx_ghost, ny_ghost, i, j, k)])
-            * del3[idx(nx_ghost, ny_ghost, i, j, k)]
+            * y_derivative(del3, idx(nx_ghost, ny_ghost, i, j, k))
             + lambda[idx(nx_ghost, ny_ghost, i, j, k)] * (del1[idx(nx_ghost, ny_ghost, i, j, k)]
                 + del2[idx(nx_ghost, ny_ghost, i, j, k)]));
 
@@ -133,7 +225,61 @@ void compute_sxx_syy_szz(real* sxx, real* syy, real* szz, const real* __restrict
             + 2.0 * mu[idx(nx_ghost, ny_ghost, i, j, k)])
             * del1[idx(nx_ghost, ny_ghost, i, j, k)]
             + lambda[idx(nx_ghost, ny_ghost, i, j, k)] * (del2[idx(nx_ghost, ny_ghost, i, j, k)]
-                + del3[idx(nx_ghost, ny_ghost, i, j, k)]));
+                + y_derivative(del3, idx(nx_ghost, ny_ghost, i, j, k))));
+      }
+    }
+    sample_pressure_plane(samples, sxx, syy, szz, k, r);
+    sample_dilatation_plane(samples, del1, del2, del3, k, r);
+  }
+}
+
+void free_surface_normal(real* sxx, real* syy, real* szz, const real* __restrict__ del1,
+                         const real* __restrict__ del2, const real* __restrict__ del3,
+                         const real* __restrict__ lambda, const real* __restrict__ mu, const real dt,
+                         const int nx_ghost, const int ny_ghost, const region_t& r, const int surface,
+                         const int nthreads, const plane_samples_t* samples) {
+
+  if (surface < r.k0 || surface >= r.k1) {
+    return;
+  }
+
+  const int k = surface;
+
+  #pragma omp parallel for num_threads(nthreads)
+  for (int j = r.j0; j < r.j1; j++) {
+    for (int i = r.i0; i < r.i1; i++) {
+      const int p = idx(nx_ghost, ny_ghost, i, j, k);
+      const real l = lambda[p];
+      const real dvz_dz = -l / (l + 2.0 * mu[p]) * (del2[p] + y_derivative(del3, p));
+
+      sxx[p] += dt * l * (dvz_dz - del1[p]);
+      syy[p] += dt * l * (dvz_dz - del1[p]);
+      szz[p] = 0.0;
+    }
+  }
+
+  if (sampled(samples, 4)) {
+    for (int s = samples->first[k]; s < samples->first[k + 1]; s++) {
+      if (in_columns(samples, s, r)) {
+        const int p = samples->offset[s];
+        const real l = lambda[p];
+        samples->to[4][s] = (1.0 - l / (l + 2.0 * mu[p])) * (del2[p] + y_derivative(del3, p));
+      }
+    }
+  }
+}
+
+void free_surface_image(real* szz, real* sxz, real* syz, const int nx_ghost, const int ny_ghost,
+                        const region_t& r, const int surface, const int nthreads) {
+
+  // szz lies in the integer planes, sxz and syz half a plane below theirs
+  #pragma omp parallel for num_threads(nthreads)
+  for (int m = 1; m <= half_length; m++) {
+    for (int j = r.j0; j < r.j1; j++) {
+      for (int i = r.i0; i < r.i1; i++) {
+        szz[idx(nx_ghost, ny_ghost, i, j, surface - m)] = -szz[idx(nx_ghost, ny_ghost, i, j, surface + m)];
+        sxz[idx(nx_ghost, ny_ghost, i, j, surface - m)] = -sxz[idx(nx_ghost, ny_ghost, i, j, surface + m - 1)];
+        syz[idx(nx_ghost, ny_ghost, i, j, surface - m)] = -syz[idx(nx_ghost, ny_ghost, i, j, surface + m - 1)];
       }
     }
   }
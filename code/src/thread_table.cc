@@ -0,0 +1,234 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 18, 2026
+ * Comment: Per-kernel OpenMP thread counts, read from a table file or tuned at start-up.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "thread_table.h"
+#include "differentiators.h"
+#include "env.h"
+#include "step_forward.h"
+
+#if defined(__INTEL_COMPILER) || defined(__INTEL_LLVM_COMPILER)
+#include <omp.h>
+#endif
+
+const char* const kKernelNames[kNumKernels] = {
+  "dxf", "dzb", "dyb", "cvx",
+  "dyf", "dzb2", "dxb", "cvy",
+  "dzf", "dxb2", "dyb2", "cvz",
+  "dzb3", "dxb3", "dyb3", "csxxsyyszz",
+  "dyf2", "dxf2", "csxy",
+  "dzf2", "dyf3", "csyz",
+  "dxf3", "dzf3", "csxz"
+};
+
+std::shared_ptr<thread_table_t> thread_table_setup(const int nthreads) {
+
+  std::shared_ptr<thread_table_t> table((thread_table_t*) malloc(sizeof(thread_table_t)), free_ptr());
+
+  for (int k = 0; k < kNumKernels; k++) {
+    table->nthreads[k] = nthreads;
+  }
+
+  return table;
+}
+
+int kernel_index(const std::string& name) {
+  for (int k = 0; k < kNumKernels; k++) {
+    if (name == kKernelNames[k]) {
+      return k;
+    }
+  }
+  return -1;
+}
+
+// Table format: one "<kernel> <threads>" pair per line, '#' starts a comment.
+// Kernels that are not listed keep their current thread count.
+bool read_thread_table(std::shared_ptr<thread_table_t> table, const std::string& filename, const int max_threads) {
+
+  std::ifstream table_file(filename);
+
+  if (!table_file.is_open()) {
+    std::cerr << "#Could not open thread table " << filename << std::endl;
+    return false;
+  }
+
+  std::string line;
+  int line_number = 0;
+
+  while (std::getline(table_file, line)) {
+    line_number++;
+    line = line.substr(0, line.find('#'));
+
+    std::stringstream line_stream(line);
+    std::string name;
+    int nthreads = 0;
+
+    if (!(line_stream >> name)) {
+      continue;
+    }
+
+    int k = kernel_index(name);
+
+    if (k < 0 || !(line_stream >> nthreads) || nthreads < 1) {
+      std::cerr << "#Ignoring line " << line_number << " in " << filename << ": " << line << std::endl;
+      continue;
+    }
+
+    table->nthreads[k] = std::min(nthreads, max_threads);
+  }
+
+  return true;
+}
+
+void write_thread_table(std::shared_ptr<thread_table_t> table, const std::string& filename) {
+
+  std::ofstream table_file(filename, std::ofstream::out);
+
+  table_file << "# kernel threads\n";
+  for (int k = 0; k < kNumKernels; k++) {
+    table_file << kKernelNames[k] << " " << table->nthreads[k] << "\n";
+  }
+
+  table_file.close();
+}
+
+bool kernel_launched(const int k) {
+#ifdef ELASTIC_2D
+  switch (k) {
+    case kDYB: case kDYF: case kDZB2: case kDXB: case kCVY: case kDYB2: case kDYB3:
+    case kDYF2: case kDXF2: case kCSXY: case kDZF2: case kDYF3: case kCSYZ:
+      return false;
+    default:
+      return true;
+  }
+#else
+  (void) k;
+  return true;
+#endif
+}
+
+bool park_idle_threads(std::shared_ptr<thread_table_t> table, const int max_threads) {
+
+  bool idle = false;
+  for (int k = 0; k < kNumKernels; k++) {
+    idle = idle || (kernel_launched(k) && table->nthreads[k] < max_threads);
+  }
+  if (!idle) {
+    return true;
+  }
+
+#if defined(__INTEL_COMPILER) || defined(__INTEL_LLVM_COMPILER)
+  // The Intel runtime lets the threads sleep at once when a region ends
+  kmp_set_blocktime(0);
+  return true;
+#else
+  // Other runtimes read their wait policy from the environment when the program starts
+  std::string policy = env_string("OMP_WAIT_POLICY", "");
+  std::transform(policy.begin(), policy.end(), policy.begin(), [](unsigned char c) { return std::tolower(c); });
+  return policy == "passive" || env_string("KMP_BLOCKTIME", "") == "0" || env_string("GOMP_SPINCOUNT", "") == "0";
+#endif
+}
+
+// Launches a single kernel of the time step in isolation.
+static void launch_kernel(const int k, std::shared_ptr<fdm3d_t> waves, std::shared_ptr<model3d_t> model, const int n) {
+
+  const int nx = waves->nx_ghost;
+  const int ny = waves->ny_ghost;
+  const real dt = waves->dt;
+  const region_t r = computed_region(nx, ny, waves->nz_ghost);
+
+  switch (k) {
+    case kDXF: dx_forward(waves->del1, waves->sxx, nx, ny, r, 1.0f / waves->dx, n); break;
+    case kDZB: dz_backward(waves->del2, waves->sxz, nx, ny, r, 1.0f / waves->dz, n); break;
+    case kDYB: dy_backward(waves->del3, waves->sxy, nx, ny, r, 1.0f / waves->dy, n); break;
+    case kCVX: compute_vx(waves->vx, model->rho, waves->del1, waves->del2, waves->del3, dt, nx, ny, r, n); break;
+    case kDYF: dy_forward(waves->del1, waves->syy, nx, ny, r, 1.0f / waves->dy, n); break;
+    case kDZB2: dz_backward(waves->del2, waves->syz, nx, ny, r, 1.0f / waves->dz, n); break;
+    case kDXB: dx_backward(waves->del3, waves->sxy, nx, ny, r, 1.0f / waves->dx, n); break;
+    case kCVY: compute_vy(waves->vy, model->rho, waves->del1, waves->del2, waves->del3, dt, nx, ny, r, n); break;
+    case kDZF: dz_forward(waves->del1, waves->szz, nx, ny, r, 1.0f / waves->dz, n); break;
+    case kDXB2: dx_backward(waves->del2, waves->sxz, nx, ny, r, 1.0f / waves->dx, n); break;
+    case kDYB2: dy_backward(waves->del3, waves->syz, nx, ny, r, 1.0f / waves->dy, n); break;
+    case kCVZ: compute_vz(waves->vz, model->rho, waves->del1, waves->del2, waves->del3, dt, nx, ny, r, n); break;
+    case kDZB3: dz_backward(waves->del1, waves->vz, nx, ny, r, 1.0f / waves->dz, n); break;
+    case kDXB3: dx_backward(waves->del2, waves->vx, nx, ny, r, 1.0f / waves->dx, n); break;
+    case kDYB3: dy_backward(waves->del3, waves->vy, nx, ny, r, 1.0f / waves->dy, n); break;
+    case kCSXXSYYSZZ:
+      compute_sxx_syy_szz(waves->sxx, waves->syy, waves->szz, waves->del1, waves->del2, waves->del3,
+                          model->lambda, model->mu, dt, nx, ny, r, n);
+      break;
+    case kDYF2: dy_forward(waves->del1, waves->vx, nx, ny, r, 1.0f / waves->dy, n); break;
+    case kDXF2: dx_forward(waves->del2, waves->vy, nx, ny, r, 1.0f / waves->dx, n); break;
+    case kCSXY: compute_sxy(waves->sxy, model->mu, waves->del1, waves->del2, dt, nx, ny, r, n); break;
+    case kDZF2: dz_forward(waves->del1, waves->vy, nx, ny, r, 1.0f / waves->dz, n); break;
+    case kDYF3: dy_forward(waves->del2, waves->vz, nx, ny, r, 1.0f / waves->dy, n); break;
+    case kCSYZ: compute_syz(waves->syz, model->mu, waves->del1, waves->del2, dt, nx, ny, r, n); break;
+    case kDXF3: dx_forward(waves->del1, waves->vz, nx, ny, r, 1.0f / waves->dx, n); break;
+    case kDZF3: dz_forward(waves->del2, waves->vx, nx, ny, r, 1.0f / waves->dz, n); break;
+    case kCSXZ: compute_sxz(waves->sxz, model->mu, waves->del1, waves->del2, dt, nx, ny, r, n); break;
+    default: break;
+  }
+}
+
+// Times every kernel for a ladder of thread counts on the (still quiescent) wave fields and
+// picks, per kernel, the smallest thread count whose runtime is within tolerance of the best.
+// Fewer threads at equal runtime leave cores idle so they can drop into low-power states.
+void tune_thread_table(std::shared_ptr<thread_table_t> table,
+                       std::shared_ptr<fdm3d_t> waves,
+                       std::shared_ptr<model3d_t> model,
+                       const int max_threads,
+                       const real tolerance) {
+
+  const int kRepetitions = 3;
+
+  std::vector<int> candidates;
+  for (int eighths = 8; eighths >= 1; eighths--) {
+    int n = (max_threads * eighths) / 8;
+    if (n >= 1 && (candidates.empty() || candidates.back() != n)) {
+      candidates.push_back(n);
+    }
+  }
+
+  for (int k = 0; k < kNumKernels; k++) {
+
+    if (!kernel_launched(k)) {
+      continue;
+    }
+
+    std::vector<double> runtimes(candidates.size());
+    double best = 0.0;
+
+    for (size_t c = 0; c < candidates.size(); c++) {
+      // Warm-up launch so the thread pool is resized before timing
+      launch_kernel(k, waves, model, candidates[c]);
+
+      double runtime = 0.0;
+      for (int r = 0; r < kRepetitions; r++) {
+        auto time_start = std::chrono::high_resolution_clock::now();
+        launch_kernel(k, waves, model, candidates[c]);
+        auto time_end = std::chrono::high_resolution_clock::now();
+        double elapsed = std::chrono::duration<double>(time_end - time_start).count();
+        runtime = (r == 0) ? elapsed : std::min(runtime, elapsed);
+      }
+
+      runtimes[c] = runtime;
+      best = (c == 0) ? runtime : std::min(best, runtime);
+    }
+
+    table->nthreads[k] = candidates.front();
+    for (size_t c = 0; c < candidates.size(); c++) {
+      if (runtimes[c] <= (1.0 + tolerance) * best) {
+        table->nthreads[k] = candidates[c];
+      }
+    }
+  }
+}
@@ -0,0 +1,96 @@
+/* Author: Mohammed Sourouri <mohammed.sourouri@ntnu.no>
+ * Date: October 19, 2026
+ * Comment: Binary trace file written by a background thread from double-buffered blocks.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+
+#include "trace_writer.h"
+
+trace_writer_t* trace_writer_setup(const std::string& filename, const bool root, const int n, const int nt,
+                                   const bool* recorded, const real dt, const real* positions,
+                                   const size_t block_size) {
+
+  FILE* file = NULL;
+
+  if (root) {
+    file = std::fopen(filename.c_str(), "wb");
+    if (file == NULL) {
+      std::cerr << "#Could not open " << filename << ", the traces are not written" << std::endl;
+    }
+  }
+
+  if (file != NULL) {
+    int32_t header[4 + kTraceFields] = {1, n, nt, 0};
+    for (int c = 0; c < kTraceFields; c++) {
+      header[3] += recorded[c];
+      header[4 + c] = recorded[c];
+    }
+    const float sampling = dt;
+
+    std::fwrite("OPTEWETR", 1, 8, file);
+    std::fwrite(header, sizeof(int32_t), 4 + kTraceFields, file);
+    std::fwrite(&sampling, sizeof(float), 1, file);
+    std::fwrite(positions, sizeof(real), (size_t) n * 3, file);
+  }
+
+  trace_writer_t* writer = (trace_writer_t*) malloc(sizeof(trace_writer_t));
+
+  writer->file = file;
+  writer->block_size = block_size;
+  writer->current = 0;
+  writer->thread = NULL;
+
+  // Only the root rank fills and writes blocks
+  writer->block[0] = root ? (real*) malloc(sizeof(real) * block_size) : NULL;
+  writer->block[1] = root ? (real*) malloc(sizeof(real) * block_size) : NULL;
+
+  return writer;
+}
+
+real* trace_block(trace_writer_t* writer) {
+  return writer->block[writer->current];
+}
+
+// Waits for the write of the other block
+static void wait_for_writer(trace_writer_t* writer) {
+  if (writer->thread != NULL) {
+    writer->thread->join();
+    delete writer->thread;
+    writer->thread = NULL;
+  }
+}
+
+void write_trace_block(trace_writer_t* writer, const size_t count) {
+  if (writer->file == NULL) {
+    return;
+  }
+
+  wait_for_writer(writer);
+
+  FILE* file = writer->file;
+  const real* block = writer->block[writer->current];
+  writer->thread = new std::thread([file, block, count]() {
+    std::fwrite(block, sizeof(real), count, file);
+  });
+
+  writer->current ^= 1;
+}
+
+void close_trace_writer(trace_writer_t* writer) {
+  wait_for_writer(writer);
+
+  if (writer->file != NULL) {
+    std::fclose(writer->file);
+    writer->file = NULL;
+  }
+}
+
+void free_trace_writer_arrays(trace_writer_t* writer) {
+  close_trace_writer(writer);
+  free(writer->block[0]);
+  free(writer->block[1]);
+  free(writer);
+}
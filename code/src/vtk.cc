@@ -15,36 +15,42 @@ std::string type_name() {
   }
 }
 
-void export_to_vtk(std::shared_ptr<fdm3d_t> waves, const std::string& filename) {
+void export_to_vtk(std::shared_ptr<fdm3d_t> waves, std::shared_ptr<decomp_t> decomp, const std::string& filename) {
 
   int Nx = waves->nx_ghost;
   int Ny = waves->ny_ghost;
-  int Nz = waves->nz_ghost;
 
-  std::ofstream vtk_file(filename + ".vtk", std::ofstream::out);
+  const int i0 = decomp->own_begin[0], i1 = decomp->own_end[0];
+  const int j0 = decomp->own_begin[1], j1 = decomp->own_end[1];
+  const int k0 = decomp->own_begin[2], k1 = decomp->own_end[2];
+  const int npoints = (i1 - i0) * (j1 - j0) * (k1 - k0);
+
+  std::string suffix = (decomp->nranks > 1) ? "_rank" + std::to_string(decomp->rank) : "";
+  std::ofstream vtk_file(filename + suffix + ".vtk", std::ofstream::out);
 
   vtk_file << "# vtk DataFile Version 3.0\n";
   vtk_file << "vtk output\n";
   vtk_file << "ASCII\n";
   vtk_file << "DATASET STRUCTURED_GRID\n";
   vtk_file << "DIMENSIONS ";
-  vtk_file << Nx << "" << " " << Ny << " " << Nz << "\n";
-  vtk_file << "POINTS " << Nx * Ny * Nz << " " << type_name() << "\n";
+  vtk_file << (i1 - i0) << "" << " " << (j1 - j0) << " " << (k1 - k0) << "\n";
+  vtk_file << "POINTS " << npoints << " " << type_name() << "\n";
 
-  for (int k = 0; k < Nz; k++) {
-    for (int j = 0; j < Ny; j++) {
-      for (int i = 0; i < Nx; i++) {
-        vtk_file << i * waves->dx << " " << j * waves->dy << " " << k * waves->dz << "\n";
+  for (int k = k0; k < k1; k++) {
+    for (int j = j0; j < j1; j++) {
+      for (int i = i0; i < i1; i++) {
+        vtk_file << (i + waves->x0) * waves->dx << " " << (j + waves->y0) * waves->dy << " "
+                 << (k + waves->z0) * waves->dz << "\n";
       }
     }
   }
 
-  vtk_file << "POINT_DATA " << Nx * Ny * Nz << "\n";
+  vtk_file << "POINT_DATA " << npoints << "\n";
   vtk_file << "SCALARS Sxx " << type_name() << " 1\n";
   vtk_file << "LOOKUP_TABLE default\n";
-  for (int k = 0; k < Nz; k++) {
-    for (int j = 0; j < Ny; j++) {
-      for (int i = 0; i < Nx; i++) {
+  for (int k = k0; k < k1; k++) {
+    for (int j = j0; j < j1; j++) {
+      for (int i = i0; i < i1; i++) {
         vtk_file << waves->sxx[idx(Nx, Ny, i, j, k)] << "\n";
       }
     }
@@ -52,9 +58,9 @@ void export_to_vtk(std::shared_ptr<fdm3d_t> waves, const std::string& filename)
   
   vtk_file << "SCALARS Syy " << type_name() << " 1\n";
   vtk_file << "LOOKUP_TABLE default\n";
-  for (int k = 0; k < Nz; k++) {
-    for (int j = 0; j < Ny; j++) {
-      for (int i = 0; i < Nx; i++) {
+  for (int k = k0; k < k1; k++) {
+    for (int j = j0; j < j1; j++) {
+      for (int i = i0; i < i1; i++) {
         vtk_file << waves->syy[idx(Nx, Ny, i, j, k)] << "\n";
       }
     }
@@ -62,9 +68,9 @@ void export_to_vtk(std::shared_ptr<fdm3d_t> waves, const std::string& filename)
   
   vtk_file << "SCALARS Szz " << type_name() << " 1\n";
   vtk_file << "LOOKUP_TABLE default\n";
-  for (int k = 0; k < Nz; k++) {
-    for (int j = 0; j < Ny; j++) {
-      for (int i = 0; i < Nx; i++) {
+  for (int k = k0; k < k1; k++) {
+    for (int j = j0; j < j1; j++) {
+      for (int i = i0; i < i1; i++) {
         vtk_file << waves->szz[idx(Nx, Ny, i, j, k)] << "\n";
       }
     }
@@ -72,9 +78,9 @@ void export_to_vtk(std::shared_ptr<fdm3d_t> waves, const std::string& filename)
   
   vtk_file << "SCALARS Sxz " << type_name() << " 1\n";
   vtk_file << "LOOKUP_TABLE default\n";
-  for (int k = 0; k < Nz; k++) {
-    for (int j = 0; j < Ny; j++) {
-      for (int i = 0; i < Nx; i++) {
+  for (int k = k0; k < k1; k++) {
+    for (int j = j0; j < j1; j++) {
+      for (int i = i0; i < i1; i++) {
         vtk_file << waves->sxz[idx(Nx, Ny, i, j, k)] << "\n";
       }
     }
@@ -82,9 +88,9 @@ void export_to_vtk(std::shared_ptr<fdm3d_t> waves, const std::string& filename)
   
   vtk_file << "SCALARS Sxy " << type_name() << " 1\n";
   vtk_file << "LOOKUP_TABLE default\n";
-  for (int k = 0; k < Nz; k++) {
-    for (int j = 0; j < Ny; j++) {
-      for (int i = 0; i < Nx; i++) {
+  for (int k = k0; k < k1; k++) {
+    for (int j = j0; j < j1; j++) {
+      for (int i = i0; i < i1; i++) {
         vtk_file << waves->sxy[idx(Nx, Ny, i, j, k)] << "\n";
       }
     }
@@ -92,18 +98,18 @@ void export_to_vtk(std::shared_ptr<fdm3d_t> waves, const std::string& filename)
   
   vtk_file << "SCALARS Syz " << type_name() << " 1\n";
   vtk_file << "LOOKUP_TABLE default\n";
-  for (int k = 0; k < Nz; k++) {
-    for (int j = 0; j < Ny; j++) {
-      for (int i = 0; i < Nx; i++) {
+  for (int k = k0; k < k1; k++) {
+    for (int j = j0; j < j1; j++) {
+      for (int i = i0; i < i1; i++) {
         vtk_file << waves->syz[idx(Nx, Ny, i, j, k)] << "\n";
       }
     }
   }
   
   vtk_file << "VECTORS Velocity " << type_name() << "\n";
-  for (int k = 0; k < Nz; k++) {
-    for (int j = 0; j < Ny; j++) {
-      for (int i = 0; i < Nx; i++) {
+  for (int k = k0; k < k1; k++) {
+    for (int j = j0; j < j1; j++) {
+      for (int i = i0; i < i1; i++) {
         vtk_file << waves->vx[idx(Nx, Ny, i, j, k)] << " ";
         vtk_file << waves->vy[idx(Nx, Ny, i, j, k)] << " ";
         vtk_file << waves->vz[idx(Nx, Ny, i, j, k)] << "\n";